@@ -4,6 +4,15 @@
 #include <iosfwd> // istream
 #include <vector> // vector
 #include <stdexcept> // runtime_error
+#include <string> // string
+#include <filesystem> // filesystem::path
+#include <optional> // optional
+#include <limits> // numeric_limits
+#include <cstddef> // size_t
+#include <functional> // function
+#include <span> // span
+#include <new> // bad_array_new_length
+#include <utility> // forward
 
 
 namespace mtx2img {
@@ -55,11 +64,351 @@ enum class Aggregation
 }; // enum class Aggregation
 
 
-std::vector<unsigned char> convert(std::istream& rStream,
-                                   std::size_t& rImageWidth,
-                                   std::size_t& rImageHeight,
-                                   const Aggregation aggregation,
-                                   const std::string& rColormapName);
+/// @brief Half-open range of rows and columns to render (0-based).
+/// @details The default window covers the whole matrix. Ends past the
+///          dimensions of the matrix are clamped to them.
+struct Window
+{
+    std::size_t rowBegin = 0;
+    std::size_t rowEnd = std::numeric_limits<std::size_t>::max();
+    std::size_t columnBegin = 0;
+    std::size_t columnEnd = std::numeric_limits<std::size_t>::max();
+}; // struct Window
+
+
+enum class Scale
+{
+    Linear,         // <== colors proportional to aggregated values
+    Logarithmic     // <== colors proportional to the logarithm of aggregated values
+}; // enum class Scale
+
+
+/// @brief Mapping of aggregated pixel values to the colormap.
+/// @details Values are clipped to the given percentiles of the nonempty pixels
+///          before they are scaled, so a few extreme pixels can't wash out the
+///          rest of the image. Empty pixels always get the background color.
+///          The defaults reproduce the linear mapping between the extreme values.
+struct Normalization
+{
+    Scale scale = Scale::Linear;
+    double lowPercentile = 0;
+    double highPercentile = 100;
+}; // struct Normalization
+
+
+/// @brief Files reordering the rows and columns of a matrix while it is rendered.
+/// @details Each file lists the input index of every row (or column) of the permuted
+///          matrix, so row i of the image shows row p[i] of the input (like A(p,q) in
+///          MATLAB). Text files hold whitespace separated indices, binary files hold
+///          native 32 or 64 bit integers (told apart by the size of the file). Indices
+///          are 0-based, or 1-based if none of them is 0. An empty path keeps the order
+///          of its dimension. Windows and statistics refer to the permuted matrix.
+struct Permutation
+{
+    std::filesystem::path rowPath;
+    std::filesystem::path columnPath;
+}; // struct Permutation
+
+
+/// @brief Structure of the matrix in the rendered window, gathered while rendering it.
+/// @details Indices are global (not relative to the window), and symmetric inputs
+///          are expanded to both triangles. Symmetry residuals are estimated from
+///          a sketch of the entries, and pairs of entries whose transpose falls
+///          outside the window count as asymmetric.
+struct Statistics
+{
+    std::size_t rows = 0;
+    std::size_t columns = 0;
+    std::size_t nonzeros = 0;                       // <== entries in the window
+    std::size_t emptyRows = 0;
+    std::size_t minRowNonzeros = 0;
+    std::size_t maxRowNonzeros = 0;
+    double meanRowNonzeros = 0;
+    double stddevRowNonzeros = 0;
+    std::vector<std::size_t> rowNonzeroHistogram;   // <== number of rows with 0, 1, 2-3, 4-7, ... entries
+    std::size_t lowerBandwidth = 0;                 // <== largest row-column over the entries
+    std::size_t upperBandwidth = 0;                 // <== largest column-row over the entries
+    std::size_t lowerProfile = 0;                   // <== sum of the lower bandwidths of each row
+    std::size_t upperProfile = 0;                   // <== sum of the upper bandwidths of each column
+    std::size_t diagonalNonzeros = 0;
+    std::size_t diagonalLength = 0;                 // <== number of diagonal positions in the window
+    double structuralAsymmetry = 0;                 // <== fraction of off-diagonal entries without a transposed entry
+    std::optional<double> valueAsymmetry;           // <== ||A-A^T||_F / ||A||_F (only if values are read, complex values as magnitudes)
+}; // struct Statistics
+
+
+/// @brief Allocate a zero-filled buffer for images and pixel values.
+/// @details Buffers of a huge page (2 MiB) or more are mapped straight from the kernel, aligned
+///          to transparent huge pages, so none of their pages is faulted in until a thread first
+///          writes it (and gets it placed on its own memory node). Smaller buffers come from calloc.
+/// @throws std::bad_alloc if the buffer can't be allocated.
+void* allocateBuffer(std::size_t byteCount);
+
+
+/// @brief Release a buffer of @ref allocateBuffer.
+void deallocateBuffer(void* pBuffer, std::size_t byteCount) noexcept;
+
+
+/// @brief Allocator of zero-filled buffers (see @ref allocateBuffer).
+/// @details Elements constructed without arguments are left alone instead of being value
+///          initialized, so a vector resized past its capacity keeps the zeros of the fresh
+///          allocation without touching it. Elements added within the capacity keep whatever
+///          was left there, so shrunk buffers must be filled explicitly when they grow again.
+template <class T>
+struct BufferAllocator
+{
+    using value_type = T;
+
+    BufferAllocator() noexcept = default;
+
+    template <class TOther>
+    BufferAllocator(const BufferAllocator<TOther>&) noexcept {}
+
+    T* allocate(std::size_t count)
+    {
+        if (std::numeric_limits<std::size_t>::max() / sizeof(T) < count) throw std::bad_array_new_length();
+        return static_cast<T*>(allocateBuffer(count * sizeof(T)));
+    }
+
+    void deallocate(T* pBuffer, std::size_t count) noexcept
+    {
+        deallocateBuffer(pBuffer, count * sizeof(T));
+    }
+
+    template <class TValue, class ...TArguments>
+    void construct(TValue* pValue, TArguments&&... rArguments)
+    {
+        if constexpr (sizeof...(TArguments)) {
+            ::new(static_cast<void*>(pValue)) TValue(std::forward<TArguments>(rArguments)...);
+        } else {
+            ::new(static_cast<void*>(pValue)) TValue;
+        }
+    }
+
+    friend bool operator==(const BufferAllocator&, const BufferAllocator&) noexcept
+    {
+        return true;
+    }
+}; // struct BufferAllocator
+
+
+/// @brief Pixels of a rendered image (layout: see @ref isBitPacked).
+using Image = std::vector<unsigned char,BufferAllocator<unsigned char>>;
+
+
+/// @brief Check whether images rendered with a colormap are bit-packed.
+/// @details The binary colormap only tells which pixels hold entries, so its images
+///          take a bit per pixel: each row is packed into (width + 7) / 8 bytes, the
+///          most significant bit first, and set bits mark (black) pixels holding nonzero
+///          entries, whatever the normalization. Images of the other colormaps hold 3 bytes
+///          (RGB) per pixel.
+bool isBitPacked(const std::string& rColormapName);
+
+
+/// @brief Convert a MatrixMarket input to an image.
+/// @details The layout of the image depends on the colormap (see @ref isBitPacked).
+/// @param pStatistics If not null, gets the structure of the matrix in the window,
+///                    gathered while parsing it (not supported for dense inputs).
+/// @param deterministic Make pixel sums of dense inputs bit-identical for any number
+///                      of threads, by splitting their blocks into a fixed number of
+///                      splits. Sparse inputs are scattered in file order either way.
+/// @param rPermutation Reorders the rows and columns of sparse inputs on the fly.
+/// @param pPartial If not null, gets the aggregated pixel values before they're colored,
+///                 so that renders of disjoint parts of a matrix can be combined later
+///                 (see @ref mergePartials). Bit-packed images are still returned.
+/// @param blockSize Size of the dense square blocks of a sparse input sorted by rows
+///                  (e.g.: a finite element matrix), or 0 to detect it from its leading
+///                  entries. Entries are aggregated block row by block row, which touches
+///                  each pixel once per block row instead of once per entry. Pixel sums
+///                  may round differently. Ignored for permuted inputs and mirrored windows.
+Image convert(std::istream& rStream,
+              std::size_t& rImageWidth,
+              std::size_t& rImageHeight,
+              const Aggregation aggregation,
+              const std::string& rColormapName,
+              std::size_t threadCount = 1,
+              const Window& rWindow = {},
+              const Normalization& rNormalization = {},
+              Statistics* pStatistics = nullptr,
+              bool deterministic = false,
+              const Permutation& rPermutation = {},
+              std::ostream* pPartial = nullptr,
+              std::size_t blockSize = 1);
+
+
+/// @brief Convert a MatrixMarket input sorted by rows band by band, handing rows over as soon as they're final.
+/// @details Only the band of image rows the current entries map to is aggregated, so memory doesn't
+///          grow with the height of the image, and the first rows are handed over long before the
+///          input ends. Entries may be out of order within a band. Colormaps other than binary need
+///          the distribution of all pixels first, so the input is read twice then. Seekable inputs are always read twice, the first pass
+///          of binary ones only checking their row order. Inputs that can't be rendered band by band
+///          are rendered in one piece and handed over at once: symmetric and dense inputs, inputs that
+///          need two passes through a stream that can't seek, and seekable inputs that turn out not to
+///          be sorted by rows.
+/// @param rWriteRows Called with consecutive runs of whole image rows from the top down (layout as in
+///                   @ref convert). The image size holds the size of the image by the time it's called.
+/// @throws InvalidFormat if an input that can't seek turns out not to be sorted by rows after rows were handed over.
+void convertBands(std::istream& rStream,
+                  std::size_t& rImageWidth,
+                  std::size_t& rImageHeight,
+                  const Aggregation aggregation,
+                  const std::string& rColormapName,
+                  const std::function<void(std::span<const unsigned char>)>& rWriteRows,
+                  std::size_t threadCount = 1,
+                  const Window& rWindow = {},
+                  const Normalization& rNormalization = {});
+
+
+/// @brief Render where two MatrixMarket files of the same dimensions differ.
+/// @details Both inputs are parsed concurrently, each by its own half of the threads, into
+///          separate pixel buffers of the same geometry, which are compared at the precision
+///          they're aggregated with, before anything is quantized to colors. The image uses a
+///          diverging colormap: pixels holding entries in the second input only are deep red,
+///          pixels holding entries in the first input only are deep blue, and pixels whose
+///          aggregate grew or shrank are lighter red or blue by how much they changed (relative
+///          to the largest change). Unchanged pixels holding entries are gray, and empty pixels
+///          white. Images are always RGB (see @ref isBitPacked).
+/// @throws InvalidFormat if the dimensions of the inputs differ.
+Image convertDifference(const std::filesystem::path& rFirstPath,
+                        const std::filesystem::path& rSecondPath,
+                        std::size_t& rImageWidth,
+                        std::size_t& rImageHeight,
+                        const Aggregation aggregation,
+                        std::size_t threadCount = 1,
+                        const Window& rWindow = {},
+                        bool deterministic = false);
+
+
+/// @brief Dimensions of a matrix partitioned into several files.
+/// @details Unset fields are deduced from the headers of the parts.
+struct GlobalShape
+{
+    std::optional<std::size_t> rows;
+    std::optional<std::size_t> columns;
+    std::optional<std::size_t> nonzeros;
+}; // struct GlobalShape
+
+
+/// @brief Convert a matrix split into several MatrixMarket files with global indices.
+/// @details Each part is a coordinate file holding a subset of the entries of the
+///          global matrix (usually a block of rows written by one MPI rank). Parts
+///          are parsed in parallel into the same image, and the number of entries
+///          in each of them must match its header.
+/// @param deterministic Make pixel sums bit-identical for any number of threads.
+///                      Consecutive parts are grouped into chunks by the number of
+///                      entries they declare, each chunk is summed into a private
+///                      buffer, and chunks are merged into the image in order.
+///                      Costs a copy of the pixel buffer per thread.
+/// @param rPermutation Reorders the rows and columns of the global matrix on the fly.
+/// @param pPartial Gets the pixel values before they're colored (see @ref convert).
+Image convertParts(const std::vector<std::filesystem::path>& rPartPaths,
+                   std::size_t& rImageWidth,
+                   std::size_t& rImageHeight,
+                   const Aggregation aggregation,
+                   const std::string& rColormapName,
+                   std::size_t threadCount = 1,
+                   const GlobalShape& rShape = {},
+                   const Window& rWindow = {},
+                   const Normalization& rNormalization = {},
+                   Statistics* pStatistics = nullptr,
+                   bool deterministic = false,
+                   const Permutation& rPermutation = {},
+                   std::ostream* pPartial = nullptr);
+
+
+/// @brief Default path of the row index of an input file (see @ref writeRowIndex).
+std::filesystem::path getRowIndexPath(const std::filesystem::path& rInputPath);
+
+
+/// @brief Index the byte offsets of row ranges in a MatrixMarket file sorted by rows.
+/// @details Only coordinate inputs with nondecreasing row indices can be indexed.
+void writeRowIndex(const std::filesystem::path& rInputPath,
+                   const std::filesystem::path& rIndexPath);
+
+
+/// @brief Check whether a row index exists, is valid, and was built from the current version of its input.
+/// @details Indices are optional, so renders fall back to reading the whole input
+///          instead of failing if this doesn't hold.
+bool isRowIndexCurrent(const std::filesystem::path& rInputPath,
+                       const std::filesystem::path& rIndexPath);
+
+
+/// @brief Convert a row-sorted MatrixMarket file with the help of its row index.
+/// @details Only the rows of the window are read, and threads parse
+///          disjoint byte ranges of the file in parallel.
+/// @param deterministic Make pixel sums bit-identical for any number of threads
+///                      (see @ref convertParts; rows are chunked at checkpoints of the index).
+/// @param rPermutation Reorders the rows and columns on the fly. The rows of a window
+///                     are scattered over the input then, so all of them are read.
+/// @param pPartial Gets the pixel values before they're colored (see @ref convert).
+Image convertIndexed(const std::filesystem::path& rInputPath,
+                     const std::filesystem::path& rIndexPath,
+                     std::size_t& rImageWidth,
+                     std::size_t& rImageHeight,
+                     const Aggregation aggregation,
+                     const std::string& rColormapName,
+                     std::size_t threadCount = 1,
+                     const Window& rWindow = {},
+                     const Normalization& rNormalization = {},
+                     Statistics* pStatistics = nullptr,
+                     bool deterministic = false,
+                     const Permutation& rPermutation = {},
+                     std::ostream* pPartial = nullptr);
+
+
+/// @brief Check whether a file holds a matrix in PETSc's binary format.
+bool isPETScBinary(const std::filesystem::path& rPath);
+
+
+/// @brief Convert a sparse matrix stored in PETSc's binary format (written by @p MatView).
+/// @details Rows outside the window are skipped without reading them.
+/// @param pPartial Gets the pixel values before they're colored (see @ref convert).
+Image convertPETSc(const std::filesystem::path& rPath,
+                   std::size_t& rImageWidth,
+                   std::size_t& rImageHeight,
+                   const Aggregation aggregation,
+                   const std::string& rColormapName,
+                   std::size_t threadCount = 1,
+                   const Window& rWindow = {},
+                   const Normalization& rNormalization = {},
+                   Statistics* pStatistics = nullptr,
+                   std::ostream* pPartial = nullptr);
+
+
+/// @brief Check whether a file holds a matrix in Harwell-Boeing or Rutherford-Boeing format.
+bool isHarwellBoeing(const std::filesystem::path& rPath);
+
+
+/// @brief Convert an assembled sparse matrix stored in Harwell-Boeing or Rutherford-Boeing format (.rb, .rua, .rsa, ...).
+/// @details Columns outside the window are skipped without reading them, the rest
+///          are decoded in parallel from the fixed width fields of the file.
+/// @param pPartial Gets the pixel values before they're colored (see @ref convert).
+Image convertHarwellBoeing(const std::filesystem::path& rPath,
+                           std::size_t& rImageWidth,
+                           std::size_t& rImageHeight,
+                           const Aggregation aggregation,
+                           const std::string& rColormapName,
+                           std::size_t threadCount = 1,
+                           const Window& rWindow = {},
+                           const Normalization& rNormalization = {},
+                           Statistics* pStatistics = nullptr,
+                           std::ostream* pPartial = nullptr);
+
+
+/// @brief Combine partial renders of disjoint parts of a matrix into one image.
+/// @details Partials (written by the converters) hold the aggregated pixel values of a render before
+///          they're colored. Those of the same window of the same matrix, rendered into the same image
+///          size with the same aggregation, are reduced like the entries themselves: counts and sums are
+///          added up, maxima keep the largest value. The result is normalized and colored as if the
+///          entries of every part had been rendered at once. Sums are accumulated in single precision
+///          in the order of the partials. The layout of the image depends on the colormap (see @ref isBitPacked).
+/// @throws InvalidFormat if a file isn't a partial render, or its geometry or aggregation differs from the others.
+Image mergePartials(const std::vector<std::filesystem::path>& rPartialPaths,
+                    std::size_t& rImageWidth,
+                    std::size_t& rImageHeight,
+                    const std::string& rColormapName,
+                    std::size_t threadCount = 1,
+                    const Normalization& rNormalization = {});
 
 
 #define MTX2IMG_DEFINE_EXCEPTION(exceptionName)         \
@@ -77,6 +426,9 @@ MTX2IMG_DEFINE_EXCEPTION(InvalidFormat);
 MTX2IMG_DEFINE_EXCEPTION(UnsupportedFormat);
 
 
+MTX2IMG_DEFINE_EXCEPTION(IOError);
+
+
 #undef MTX2IMG_DEFINE_EXCEPTION
 
 
@@ -16,26 +16,137 @@
 #include <optional> // optional
 #include <set> // set
 #include <cstring> // strlen
+#include <string_view> // string_view
+#include <array> // array
+#include <cctype> // isspace
+#include <sstream> // ostringstream
+#include <cstdint> // uint32_t
+#include <limits> // numeric_limits
+#include <cassert> // assert
+#include <memory> // shared_ptr, make_shared
+#include <mutex> // mutex, unique_lock, scoped_lock
+#include <condition_variable> // condition_variable
+#include <atomic> // atomic
+#include <exception> // exception_ptr, current_exception, rethrow_exception
+#include <span> // span
+#include <cstdlib> // abs
+
+#if defined(__unix__) || defined(__APPLE__)
+    #define MTX2IMG_HAS_SOCKETS
+    #include <sys/socket.h> // socket, bind, listen, connect, accept, setsockopt, recv, send, shutdown
+    #include <sys/un.h> // sockaddr_un
+    #include <sys/time.h> // timeval
+    #include <unistd.h> // close
+    #include <signal.h> // sigwait, pthread_sigmask
+    #include <csignal> // signal
+    #include <cerrno> // errno
+#endif
+#if defined(__unix__) || defined(__APPLE__)
+    #define MTX2IMG_HAS_STAT
+    #include <sys/stat.h> // stat
+#endif
+#if defined(__linux__) && __has_include(<linux/io_uring.h>)
+    #define MTX2IMG_HAS_IO_URING
+    #include <linux/io_uring.h> // io_uring_params, io_uring_sqe, io_uring_cqe
+    #include <sys/syscall.h> // SYS_io_uring_setup, SYS_io_uring_enter
+    #include <sys/mman.h> // mmap, munmap
+    #include <sys/stat.h> // fstat
+    #include <fcntl.h> // open, O_DIRECT
+    #include <unistd.h> // syscall, pread, close
+    #include <atomic> // atomic_ref
+    #include <cstdlib> // aligned_alloc, free
+    #include <cstdint> // uint64_t, int64_t
+    #include <limits> // numeric_limits
+    #include <cerrno> // errno
+#endif
+#include <thread> // thread::hardware_concurrency
+#include <algorithm> // max, sort
+#include <vector> // vector
+#include <random> // random_device
+#include <chrono> // hours
 
 
 /** Default arguments:
  *  - 1080x1080 pixel output image
  *  - binary colormap (any pixel with a nonzero is black, rest are white)
+ *  - use all available hardware threads
+ *  - deduce the global shape of partitioned inputs from their parts
+ *  - render the whole matrix
+ *  - keep the order of the rows and columns
+ *  - map pixel values linearly between their extremes to the colormap
+ *  - read input files through a standard file stream
+ *  - sum pixels in whatever order the threads happen to scatter entries in
+ *  - combine several inputs as parts of one matrix instead of a sequence of frames
+ *  - play sequences at 10 frames per second
+ *  - aggregate the whole image before writing it
+ *  - don't write the pixel values before they're colored
+ *  - don't cache rendered images (1 GiB per cache directory if they are)
+ *  - aggregate entries one by one instead of block row by block row
  */
 const std::map<std::string,std::string> defaultArguments {
     {"-r", "1080"},
     {"-a", "count"},
-    {"-c", "binary"}
+    {"-c", "binary"},
+    {"-t", "0"},
+    {"-s", ""},
+    {"--window", ""},
+    {"--row-perm", ""},
+    {"--col-perm", ""},
+    {"--scale", "linear"},
+    {"--clip", ""},
+    {"--stats", ""},
+    {"--io", "stream"},
+    {"--deterministic", ""},
+    {"--sequence", ""},
+    {"--fps", "10"},
+    {"--stream", ""},
+    {"--emit-partial", ""},
+    {"--cache", ""},
+    {"--cache-size", "1024"},
+    {"--block", "1"}
+};
+
+
+/// Options that don't take a value.
+const std::set<std::string> flagArguments {
+    "--deterministic",
+    "--sequence",
+    "--stream"
 };
 
 
+/// @brief Backend reading MatrixMarket input files.
+enum class ReadEngine
+{
+    Stream,     // <== std::ifstream
+    URing,      // <== io_uring with several reads in flight
+    URingDirect // <== io_uring bypassing the page cache
+}; // enum class ReadEngine
+
+
 struct Arguments
 {
     std::filesystem::path inputPath;
+    std::vector<std::filesystem::path> partPaths; // <== parts of a partitioned input
+    std::vector<std::filesystem::path> framePaths; // <== inputs of a sequence, in the order of their frames
+    std::size_t frameRate;
+    mtx2img::GlobalShape shape;
+    mtx2img::Window window;
+    mtx2img::Permutation permutation; // <== empty paths keep the order of the input
+    mtx2img::Normalization normalization;
+    std::filesystem::path statisticsPath; // <== empty if no statistics are requested
+    std::filesystem::path partialPath; // <== empty if no partial render is requested
+    std::filesystem::path cachePath; // <== directory of the render cache, empty if images aren't cached
+    std::uintmax_t cacheBytes; // <== size cap of the render cache
+    std::size_t blockSize; // <== size of the dense blocks of the input, 0 to detect it, 1 to aggregate entries one by one
+    ReadEngine readEngine;
+    bool deterministic;
+    bool stream; // <== render band by band and write the image while the input is read
     std::filesystem::path outputPath;
     std::size_t resolution;
     mtx2img::Aggregation aggregation;
     std::string colormap;
+    std::size_t threads;
 }; // struct Arguments
 
 
@@ -52,14 +163,262 @@ void printHelp()
         << "                       \"max\" reads values and keeps the one with the largest absolute value for each pixel\n"
         << "    -c <colormap>    : colormap to use for aggregated pixel values.\n"
         << "                       Options: [binary, kindlmann, viridis, glasbey256, glasbey64, glasbey8] (default: "  << defaultArguments.at("-c") << ").\n"
+        << "    -t <threads>     : number of threads to use. 0 uses all hardware threads (default: " << defaultArguments.at("-t") << ").\n"
+        << "    -s <shape>       : global shape of a partitioned input as <rows>,<columns>[,<nonzeros>].\n"
+        << "                       Deduced from the headers of the parts by default.\n"
+        << "    --window <range> : render only the rows and columns in <row-begin>:<row-end>,<column-begin>:<column-end>\n"
+        << "                       (0-based, end excluded). Omitted bounds extend to the edges of the matrix.\n"
+        << "    --row-perm <path>: reorder the rows on the fly: row i of the image shows row p[i] of the input, where p is\n"
+        << "                       read from <path> as whitespace separated text or native 32/64 bit binary integers\n"
+        << "                       (0-based, or 1-based if there is no 0). Windows refer to the permuted matrix.\n"
+        << "    --col-perm <path>: reorder the columns on the fly, like --row-perm.\n"
+        << "    --scale <scale>  : how aggregated pixel values are mapped to the colormap. Options: [linear, log] (default: " << defaultArguments.at("--scale") << ").\n"
+        << "                       The binary colormap ignores --scale and --clip.\n"
+        << "    --clip <range>   : clip pixel values to the percentiles <low>:<high> of the nonempty pixels before scaling them,\n"
+        << "                       so that a few extreme pixels don't wash out the rest of the image (for example 1:99.5).\n"
+        << "                       Omitted bounds don't clip.\n"
+        << "    --stats <path>   : write structural statistics of the rendered matrix (nonzeros per row, bandwidth,\n"
+        << "                       profile, diagonal coverage, symmetry) to <path> as JSON, gathered while rendering.\n"
+        << "    --deterministic  : make summed pixels bit-identical for any number of threads, at the cost of a copy of\n"
+        << "                       the pixel buffer per thread (only affects the \"sum\" aggregation).\n"
+        << "    --sequence       : render each input matched by the input pattern (or listed in the input list) into a frame of\n"
+        << "                       an animated PNG, instead of combining them as parts of one matrix. Matched inputs are ordered\n"
+        << "                       by the numbers in their names. If the output file name holds \"%d\" or \"%0<width>d\" (such\n"
+        << "                       as frame_%04d.png), each frame is written to a numbered PNG instead.\n"
+        << "    --fps <rate>     : frames per second of an animated sequence (default: " << defaultArguments.at("--fps") << ").\n"
+        << "    --stream         : render an input sorted by rows band by band, and write the image while the input is read,\n"
+        << "                       so that memory doesn't grow with the height of the image. Files take a first pass over\n"
+        << "                       the input (as do colormaps other than binary), and render it in one piece if it turns out\n"
+        << "                       unsorted. Symmetric and dense inputs are always rendered in one piece.\n"
+        << "    --emit-partial <path>: also write the aggregated pixel values to <path> before they're colored, so that renders\n"
+        << "                       of disjoint parts of a matrix (with the same -r, -a, -s and --window) can be combined by\n"
+        << "                       'mtx2img merge'.\n"
+        << "    --cache <dir>    : look the image up in a render cache in <dir> (created if needed) before rendering it, and\n"
+        << "                       store it there after rendering it. Images are keyed by the size, modification time and\n"
+        << "                       inode of the inputs, and by the options that change the image.\n"
+        << "    --cache-size <MiB>: evict the least recently used images of the cache past this size (default: " << defaultArguments.at("--cache-size") << ").\n"
+        << "    --block <size>   : aggregate the entries of an input made of dense <size> x <size> blocks (such as a finite\n"
+        << "                       element matrix) block row by block row, which touches each pixel once per block row instead\n"
+        << "                       of once per entry. \"auto\" detects the block size from the first rows. Only affects sparse\n"
+        << "                       inputs sorted by rows without permutations, and may round summed pixels differently (default: " << defaultArguments.at("--block") << ").\n"
+        << "    --io <engine>    : how MatrixMarket input files are read. Options: [stream, uring, uring-direct] (default: " << defaultArguments.at("--io") << ").\n"
+        << "                       \"uring\" keeps several large reads in flight through io_uring (Linux only), \"uring-direct\"\n"
+        << "                       additionally bypasses the page cache if the file system supports it.\n"
+        << "\n"
+        << "The input path must point to an existing MatrixMarket, PETSc binary or Harwell-Boeing/Rutherford-Boeing file\n"
+        << "(or pass '-' to read MatrixMarket from stdin).\n"
+        << "A matrix partitioned into several MatrixMarket files with global indices can be passed as a pattern (such as\n"
+        << "'dump/rank_*.mtx', '*' and '?' are expanded in the file name), or as '@<list-path>' pointing to a file that\n"
+        << "lists the path of each part on a separate line.\n"
         << "\n"
-        << "The input path must point to an existing MatrixMarket file (or pass '-' to read the same format from stdin).\n"
+        << "mtx2img --serve <socket-path> [-t <threads>] runs a render daemon on a Unix domain socket (see the readme).\n"
+        << "mtx2img index <path-to-source> [<index-path>] indexes the rows of a MatrixMarket file sorted by rows. Renders\n"
+        << "of the file then use its index (<path-to-source>.idx by default) to read only the rows they need in parallel.\n"
+        << "mtx2img diff <path-to-first> <path-to-second> <path-to-output> [OPTION ARGUMENT] ... renders where two MatrixMarket\n"
+        << "files of the same dimensions differ: red pixels gained entries (or grew), blue ones lost entries (or shrank), and\n"
+        << "gray ones didn't change. Takes -r, -a, -t, --window and --deterministic, other options are rejected.\n"
+        << "mtx2img merge <partial>... <path-to-output> [OPTION ARGUMENT] ... combines partial renders written by --emit-partial\n"
+        << "into one image (adding up counts and sums, keeping the largest maxima). Takes -c, -t, --scale and --clip.\n"
         << "The parent directory of the output path must exist, and the output path is assumed to either not exist, or\n"
         << "point to an existing file (in which case it will be overwritten).\n"
         ;
 }
 
 
+void validateInputFile(const std::filesystem::path& rPath)
+{
+    const auto inputStatus = std::filesystem::status(rPath);
+    switch (inputStatus.type()) {
+        case std::filesystem::file_type::regular: break; // <== ok
+        case std::filesystem::file_type::none: throw std::invalid_argument(std::format(
+            "Error: input file does not exist: {}\n",
+            rPath.string()
+        ));
+        case std::filesystem::file_type::directory: throw std::invalid_argument(std::format(
+            "Error: provided input path is a directory: {}\n",
+            rPath.string()
+        ));
+        default: throw std::invalid_argument(std::format(
+            "Error: input is not a file: {}\n",
+            rPath.string()
+        ));
+    } // switch inputStatus
+
+    if ((inputStatus.permissions() & std::filesystem::perms::owner_read) == std::filesystem::perms::none) {
+        throw std::invalid_argument(std::format(
+            "Error: missing read access to input file {}\n",
+            rPath.string()
+        ));
+    } // if !readPermission
+}
+
+
+/// @brief Match a file name against a pattern of '*' (any sequence) and '?' (any character) wildcards.
+bool matchWildcards(std::string_view name, std::string_view pattern)
+{
+    // Greedy matching that backtracks to the last '*'.
+    std::size_t iName = 0ul, iPattern = 0ul;
+    std::size_t iStar = std::string_view::npos, iStarName = 0ul;
+    while (iName < name.size()) {
+        if (iPattern < pattern.size() && (pattern[iPattern] == '?' || pattern[iPattern] == name[iName])) {
+            ++iName;
+            ++iPattern;
+        } else if (iPattern < pattern.size() && pattern[iPattern] == '*') {
+            iStar = iPattern++;
+            iStarName = iName;
+        } else if (iStar != std::string_view::npos) {
+            iPattern = iStar + 1;
+            iName = ++iStarName;
+        } else {
+            return false;
+        }
+    }
+    while (iPattern < pattern.size() && pattern[iPattern] == '*') ++iPattern;
+    return iPattern == pattern.size();
+}
+
+
+/// @brief Collect the parts of a partitioned input.
+/// @details The input path is either a file name pattern or '@' followed
+///          by the path of a file listing the parts (one per line).
+/// @return An empty list if the input is a single file.
+std::vector<std::filesystem::path> expandInputParts(const std::filesystem::path& rInputPath)
+{
+    std::vector<std::filesystem::path> parts;
+    const std::string input = rInputPath.string();
+
+    if (input.starts_with('@')) {
+        // List file: paths are relative to the list's directory.
+        const std::filesystem::path listPath = input.substr(1);
+        validateInputFile(listPath);
+        std::ifstream list(listPath);
+        for (std::string line; std::getline(list, line);) {
+            while (!line.empty() && std::isspace(static_cast<unsigned char>(line.back()))) line.pop_back();
+            if (!line.empty()) {
+                parts.push_back(listPath.parent_path() / line);
+            }
+        }
+        if (parts.empty()) {
+            throw std::invalid_argument(std::format(
+                "Error: no input parts listed in {}\n",
+                listPath.string()
+            ));
+        }
+    } else {
+        const std::string pattern = rInputPath.filename().string();
+        if (pattern.find_first_of("*?") == std::string::npos) {
+            return parts;
+        }
+
+        const std::filesystem::path directory = rInputPath.has_parent_path() ? rInputPath.parent_path() : ".";
+        std::error_code error;
+        for (const auto& rEntry : std::filesystem::directory_iterator(directory, error)) {
+            if (rEntry.is_regular_file() && matchWildcards(rEntry.path().filename().string(), pattern)) {
+                parts.push_back(rInputPath.has_parent_path() ? rEntry.path() : rEntry.path().filename());
+            }
+        }
+        if (parts.empty()) {
+            throw std::invalid_argument(std::format(
+                "Error: no input files match {}\n",
+                input
+            ));
+        }
+
+        // Directory iteration order is unspecified.
+        std::sort(parts.begin(), parts.end());
+    }
+
+    for (const auto& rPart : parts) {
+        validateInputFile(rPart);
+    }
+
+    return parts;
+}
+
+
+/// @brief Compare file names with their runs of digits ordered by value ("step_2" before "step_10").
+bool isNaturallyLess(std::string_view left, std::string_view right)
+{
+    std::size_t iLeft = 0ul, iRight = 0ul;
+    while (iLeft < left.size() && iRight < right.size()) {
+        if (std::isdigit(static_cast<unsigned char>(left[iLeft])) && std::isdigit(static_cast<unsigned char>(right[iRight]))) {
+            // Compare numbers by their digit count without leading zeros, then digit by digit.
+            const auto getNumber = [](std::string_view name, std::size_t& rIndex) {
+                const std::size_t iBegin = rIndex;
+                while (rIndex < name.size() && std::isdigit(static_cast<unsigned char>(name[rIndex]))) ++rIndex;
+                const std::string_view number = name.substr(iBegin, rIndex - iBegin);
+                return number.substr(std::min(number.find_first_not_of('0'), number.size()));
+            };
+            const std::string_view leftNumber = getNumber(left, iLeft);
+            const std::string_view rightNumber = getNumber(right, iRight);
+            if (leftNumber.size() != rightNumber.size()) return leftNumber.size() < rightNumber.size();
+            if (leftNumber != rightNumber) return leftNumber < rightNumber;
+        } else if (left[iLeft] != right[iRight]) {
+            return left[iLeft] < right[iRight];
+        } else {
+            ++iLeft;
+            ++iRight;
+        }
+    }
+    return left.size() - iLeft < right.size() - iRight;
+}
+
+
+/// @brief Substitute a frame number into the file name of an output path.
+/// @details The file name holds a printf-style placeholder: "%d", or "%0<width>d" to pad
+///          the number with zeros (such as "frame_%04d.png").
+/// @return Empty if the file name has no placeholder.
+std::optional<std::filesystem::path> getFramePath(const std::filesystem::path& rPattern, std::size_t iFrame)
+{
+    const std::string pattern = rPattern.filename().string();
+    const std::size_t iBegin = pattern.find('%');
+    if (iBegin == std::string::npos) return {};
+
+    std::size_t width = 0ul;
+    std::size_t iEnd = iBegin + 1;
+    if (iEnd < pattern.size() && pattern[iEnd] == '0') {
+        while (++iEnd < pattern.size() && std::isdigit(static_cast<unsigned char>(pattern[iEnd]))) {
+            width = 10 * width + static_cast<std::size_t>(pattern[iEnd] - '0');
+        }
+    }
+    if (pattern.size() <= iEnd || pattern[iEnd] != 'd' || pattern.find('%', iEnd) != std::string::npos) {
+        throw std::invalid_argument(std::format(
+            "Error: invalid frame number placeholder in output path: {}\n",
+            rPattern.string()
+        ));
+    }
+
+    std::string number = std::to_string(iFrame);
+    if (number.size() < width) number.insert(0ul, width - number.size(), '0');
+    return rPattern.parent_path() / (pattern.substr(0ul, iBegin) + number + pattern.substr(iEnd + 1));
+}
+
+
+/// @brief Convert and validate a number of threads, 0 meaning all hardware threads.
+/// @throws std::invalid_argument if the string is not a nonnegative integer.
+std::size_t parseThreadCount(const std::string& rThreadString)
+{
+    char* itEnd = nullptr;
+    const long long threads = std::strtoll(rThreadString.data(), &itEnd, 0);
+    if (itEnd < rThreadString.data() ||
+        static_cast<std::size_t>(std::distance(rThreadString.data(), static_cast<const char*>(itEnd))) != rThreadString.size()) {
+        throw std::invalid_argument(std::format(
+            "Error: invalid number of threads: {}\n",
+            rThreadString
+        ));
+    } else if (threads < 0) {
+        throw std::invalid_argument(std::format(
+            "Error: negative number of threads: {}\n",
+            rThreadString
+        ));
+    } else if (threads == 0) {
+        return std::max(std::thread::hardware_concurrency(), 1u);
+    } else {
+        return static_cast<std::size_t>(threads);
+    }
+}
+
+
 std::optional<Arguments> parseArguments(int argc, char const* const* argv)
 {
     Arguments arguments;
@@ -84,6 +443,10 @@ std::optional<Arguments> parseArguments(int argc, char const* const* argv)
                         "Error: unrecognized option: {}\n",
                         arg
                     ));
+                } else if (flagArguments.contains(arg)) {
+                    // Flags are set by their presence.
+                    it_argument->second = "on";
+                    it_argument = argMap.end();
                 }
             } else {
                 // No value was provided for the last key
@@ -137,29 +500,10 @@ std::optional<Arguments> parseArguments(int argc, char const* const* argv)
 
     // Validate input path
     if (arguments.inputPath != "-") {
-        const auto inputStatus = std::filesystem::status(arguments.inputPath);
-        switch (inputStatus.type()) {
-            case std::filesystem::file_type::regular: break; // <== ok
-            case std::filesystem::file_type::none: throw std::invalid_argument(std::format(
-                "Error: input file does not exist: {}\n",
-                arguments.inputPath.string()
-            ));
-            case std::filesystem::file_type::directory: throw std::invalid_argument(std::format(
-                "Error: provided input path is a directory: {}\n",
-                arguments.inputPath.string()
-            ));
-            default: throw std::invalid_argument(std::format(
-                "Error: input is not a file: {}\n",
-                arguments.inputPath.string()
-            ));
-        } // switch inputStatus
-
-        if ((inputStatus.permissions() & std::filesystem::perms::owner_read) == std::filesystem::perms::none) {
-            throw std::invalid_argument(std::format(
-                "Error: missing read access to input file {}\n",
-                arguments.inputPath.string()
-            ));
-        } // if !readPermission
+        arguments.partPaths = expandInputParts(arguments.inputPath);
+        if (arguments.partPaths.empty()) {
+            validateInputFile(arguments.inputPath);
+        }
     } // if arguments.inputPath != "-"
 
     // Validate output path
@@ -233,6 +577,234 @@ std::optional<Arguments> parseArguments(int argc, char const* const* argv)
         arguments.resolution = static_cast<std::size_t>(resolution);
     }
 
+    // Convert and validate thread count
+    arguments.threads = parseThreadCount(argMap["-t"]);
+
+    // Convert and validate the global shape
+    const std::string& rShapeString = argMap["-s"];
+    if (!rShapeString.empty()) {
+        std::array<std::optional<std::size_t>*,3> shape {&arguments.shape.rows,
+                                                         &arguments.shape.columns,
+                                                         &arguments.shape.nonzeros};
+        std::size_t iComponent = 0ul;
+        for (const char* it=rShapeString.data(); iComponent<shape.size(); ++iComponent) {
+            const long long component = std::strtoll(it, &itEnd, 10);
+            if (itEnd == it || component < 0) break;
+            *shape[iComponent] = static_cast<std::size_t>(component);
+            it = itEnd;
+            if (*it != ',') break;
+            ++it;
+        }
+
+        if (iComponent < 1 || !arguments.shape.columns.has_value()
+            || itEnd != rShapeString.data() + rShapeString.size()) {
+            throw std::invalid_argument(std::format(
+                "Error: invalid global shape: {}\n",
+                rShapeString
+            ));
+        } else if (arguments.inputPath == "-") {
+            throw std::invalid_argument("Error: a global shape cannot be applied to input from the pipe\n");
+        }
+
+        // The global shape of a single file is applied to it as if it was the only part.
+        if (arguments.partPaths.empty()) {
+            arguments.partPaths.push_back(arguments.inputPath);
+        }
+    }
+
+    // Convert and validate the window
+    const std::string& rWindowString = argMap["--window"];
+    if (!rWindowString.empty()) {
+        std::array<std::size_t*,4> bounds {&arguments.window.rowBegin,
+                                           &arguments.window.rowEnd,
+                                           &arguments.window.columnBegin,
+                                           &arguments.window.columnEnd};
+        const std::array<char,4> separators {':', ',', ':', '\0'};
+        const char* it = rWindowString.c_str();
+        bool isValid = true;
+        for (std::size_t iBound=0ul; iBound<bounds.size() && isValid; ++iBound) {
+            if (*it != separators[iBound]) {
+                const long long bound = std::strtoll(it, &itEnd, 10);
+                isValid = itEnd != it && 0 <= bound;
+                *bounds[iBound] = static_cast<std::size_t>(bound);
+                it = itEnd;
+            }
+            isValid = isValid && *it == separators[iBound];
+            if (*it) ++it;
+        }
+
+        if (!isValid
+            || arguments.window.rowEnd <= arguments.window.rowBegin
+            || arguments.window.columnEnd <= arguments.window.columnBegin) {
+            throw std::invalid_argument(std::format(
+                "Error: invalid window: {}\n",
+                rWindowString
+            ));
+        }
+    }
+
+    // Convert and validate the normalization
+    const std::string& rScaleString = argMap["--scale"];
+    if (rScaleString == "linear") {
+        arguments.normalization.scale = mtx2img::Scale::Linear;
+    } else if (rScaleString == "log") {
+        arguments.normalization.scale = mtx2img::Scale::Logarithmic;
+    } else {
+        throw std::invalid_argument(std::format(
+            "Error: invalid scale: {}\n",
+            rScaleString
+        ));
+    }
+
+    arguments.permutation.rowPath = argMap["--row-perm"];
+    arguments.permutation.columnPath = argMap["--col-perm"];
+    arguments.statisticsPath = argMap["--stats"];
+    arguments.partialPath = argMap["--emit-partial"];
+    arguments.deterministic = !argMap["--deterministic"].empty();
+
+    // Validate the read engine
+    const std::string& rEngineString = argMap["--io"];
+    if (rEngineString == "stream") {
+        arguments.readEngine = ReadEngine::Stream;
+    } else if (rEngineString == "uring" || rEngineString == "uring-direct") {
+        #ifdef MTX2IMG_HAS_IO_URING
+        arguments.readEngine = rEngineString == "uring" ? ReadEngine::URing : ReadEngine::URingDirect;
+        #else
+        throw std::invalid_argument(std::format(
+            "Error: read engine is not supported on this platform: {}\n",
+            rEngineString
+        ));
+        #endif
+    } else {
+        throw std::invalid_argument(std::format(
+            "Error: invalid read engine: {}\n",
+            rEngineString
+        ));
+    }
+
+    const std::string& rClipString = argMap["--clip"];
+    if (!rClipString.empty()) {
+        std::array<double*,2> bounds {&arguments.normalization.lowPercentile,
+                                      &arguments.normalization.highPercentile};
+        const std::array<char,2> separators {':', '\0'};
+        const char* it = rClipString.c_str();
+        bool isValid = true;
+        for (std::size_t iBound=0ul; iBound<bounds.size() && isValid; ++iBound) {
+            if (*it != separators[iBound]) {
+                char* itBoundEnd = nullptr;
+                *bounds[iBound] = std::strtod(it, &itBoundEnd);
+                isValid = itBoundEnd != it;
+                it = itBoundEnd;
+            }
+            isValid = isValid && *it == separators[iBound];
+            if (*it) ++it;
+        }
+
+        if (!isValid
+            || arguments.normalization.lowPercentile < 0
+            || arguments.normalization.highPercentile <= arguments.normalization.lowPercentile
+            || 100 < arguments.normalization.highPercentile) {
+            throw std::invalid_argument(std::format(
+                "Error: invalid percentile range: {}\n",
+                rClipString
+            ));
+        }
+    }
+
+    // Inputs of a sequence are rendered into frames of their own instead of being combined as parts.
+    if (!argMap["--sequence"].empty()) {
+        if (arguments.inputPath == "-") {
+            throw std::invalid_argument("Error: a sequence cannot be read from the pipe\n");
+        } else if (!rShapeString.empty()) {
+            throw std::invalid_argument("Error: a global shape cannot be applied to a sequence\n");
+        } else if (!arguments.statisticsPath.empty()) {
+            throw std::invalid_argument("Error: statistics are not supported for sequences\n");
+        } else if (!arguments.partialPath.empty()) {
+            throw std::invalid_argument("Error: partial renders are not supported for sequences\n");
+        }
+        getFramePath(arguments.outputPath, 0ul); // <== validate the frame number placeholder
+
+        arguments.framePaths = std::move(arguments.partPaths);
+        arguments.partPaths.clear();
+        if (arguments.framePaths.empty()) {
+            arguments.framePaths.push_back(arguments.inputPath);
+        } else if (!arguments.inputPath.string().starts_with('@')) {
+            // Listed inputs keep their order, matched ones are sorted by their numbers.
+            std::sort(arguments.framePaths.begin(), arguments.framePaths.end(), [](const auto& rLeft, const auto& rRight){
+                return isNaturallyLess(rLeft.string(), rRight.string());
+            });
+        }
+    }
+
+    // Only single MatrixMarket inputs are streamed.
+    arguments.stream = !argMap["--stream"].empty();
+    if (arguments.stream) {
+        if (!arguments.partPaths.empty() || !arguments.framePaths.empty()) {
+            throw std::invalid_argument("Error: only single inputs can be streamed\n");
+        } else if (!arguments.statisticsPath.empty()) {
+            throw std::invalid_argument("Error: statistics are not supported for streamed inputs\n");
+        } else if (!arguments.partialPath.empty()) {
+            throw std::invalid_argument("Error: partial renders are not supported for streamed inputs\n");
+        } else if (!arguments.permutation.rowPath.empty() || !arguments.permutation.columnPath.empty()) {
+            throw std::invalid_argument("Error: permutations are not supported for streamed inputs\n");
+        } else if (arguments.readEngine != ReadEngine::Stream) {
+            // Streamed inputs may be read twice, which takes a seekable file stream.
+            throw std::invalid_argument("Error: streamed inputs can only be read with --io stream\n");
+        }
+    }
+
+    // Only images rendered from files in one piece are cached.
+    arguments.cachePath = argMap["--cache"];
+    if (!arguments.cachePath.empty()) {
+        if (arguments.inputPath == "-") {
+            throw std::invalid_argument("Error: input from the pipe cannot be cached\n");
+        } else if (!arguments.framePaths.empty() || arguments.stream) {
+            throw std::invalid_argument("Error: sequences and streamed inputs cannot be cached\n");
+        } else if (!arguments.statisticsPath.empty() || !arguments.partialPath.empty()) {
+            throw std::invalid_argument("Error: --stats and --emit-partial are not supported with --cache\n");
+        }
+    }
+
+    const std::string& rCacheSizeString = argMap["--cache-size"];
+    const long long cacheSize = std::strtoll(rCacheSizeString.data(), &itEnd, 10);
+    if (itEnd != rCacheSizeString.data() + rCacheSizeString.size()
+        || cacheSize < 1 || static_cast<long long>(std::numeric_limits<std::uintmax_t>::max() >> 20) < cacheSize) {
+        throw std::invalid_argument(std::format(
+            "Error: invalid render cache size (expecting a positive number of MiB): {}\n",
+            rCacheSizeString
+        ));
+    }
+    arguments.cacheBytes = static_cast<std::uintmax_t>(cacheSize) << 20;
+
+    // Convert and validate the block size ("auto" => 0 => detect it)
+    const std::string& rBlockString = argMap["--block"];
+    if (rBlockString == "auto") {
+        arguments.blockSize = 0ul;
+    } else {
+        const long long blockSize = std::strtoll(rBlockString.data(), &itEnd, 10);
+        if (itEnd != rBlockString.data() + rBlockString.size() || blockSize < 1) {
+            throw std::invalid_argument(std::format(
+                "Error: invalid block size (expecting a positive integer or \"auto\"): {}\n",
+                rBlockString
+            ));
+        }
+        arguments.blockSize = static_cast<std::size_t>(blockSize);
+    }
+    if (arguments.blockSize != 1ul && (!arguments.partPaths.empty() || arguments.stream)) {
+        throw std::invalid_argument("Error: partitioned and streamed inputs cannot be aggregated block-wise\n");
+    }
+
+    // Convert and validate the frame rate
+    const std::string& rFrameRateString = argMap["--fps"];
+    const long long frameRate = std::strtoll(rFrameRateString.data(), &itEnd, 10);
+    if (itEnd != rFrameRateString.data() + rFrameRateString.size() || frameRate < 1 || 0xffff < frameRate) {
+        throw std::invalid_argument(std::format(
+            "Error: invalid frame rate (expecting 1-65535 frames per second): {}\n",
+            rFrameRateString
+        ));
+    }
+    arguments.frameRate = static_cast<std::size_t>(frameRate);
+
     return arguments;
 }
 
@@ -250,107 +822,2069 @@ void writeImageData(void* pContext,     // <== pointer to an std::ostream
 }
 
 
-int main(int argc, char const* const* argv)
+/// @brief Pixel rectangle of an image.
+struct Rectangle
 {
-    // Parse arguments
-    Arguments arguments;
-    try {
-        auto parsed = parseArguments(argc, argv);
-        if (parsed.has_value()) {
-            arguments = std::move(parsed.value());
-        } else {
-            printHelp();
-            return 0;
+    std::size_t x;
+    std::size_t y;
+    std::size_t width;
+    std::size_t height;
+}; // struct Rectangle
+
+
+/// @brief Store a 32 bit value in network byte order.
+void storeBigEndian(unsigned char* pBegin, std::uint32_t value)
+{
+    pBegin[0] = static_cast<unsigned char>(value >> 24);
+    pBegin[1] = static_cast<unsigned char>(value >> 16);
+    pBegin[2] = static_cast<unsigned char>(value >> 8);
+    pBegin[3] = static_cast<unsigned char>(value);
+}
+
+
+/// @brief Write a PNG chunk: its size, type, data and the CRC-32 of its type and data.
+void writePNGChunk(std::ostream& rStream,
+                   const char* pType,
+                   const unsigned char* pData,
+                   std::size_t size)
+{
+    static const std::array<std::uint32_t,256> crcTable = [](){
+        std::array<std::uint32_t,256> table;
+        for (std::uint32_t iByte=0u; iByte<table.size(); ++iByte) {
+            std::uint32_t crc = iByte;
+            for (int iBit=0; iBit<8; ++iBit) crc = (crc & 1u) ? 0xedb88320u ^ (crc >> 1) : crc >> 1;
+            table[iByte] = crc;
         }
-    } catch (std::invalid_argument& rException) {
-        std::cerr << rException.what();
-        printHelp();
-        return 1;
-    }
+        return table;
+    }();
 
-    // Set up input stream
-    std::istream* pInputStream = nullptr;
-    std::optional<std::ifstream> maybeInputFile;
+    std::array<unsigned char,8> header;
+    storeBigEndian(header.data(), static_cast<std::uint32_t>(size));
+    std::copy(pType, pType + 4, header.begin() + 4);
+    std::uint32_t crc = 0xffffffffu;
+    for (std::size_t i=4ul; i<header.size(); ++i) crc = crcTable[(crc ^ header[i]) & 0xffu] ^ (crc >> 8);
+    for (std::size_t i=0ul; i<size; ++i) crc = crcTable[(crc ^ pData[i]) & 0xffu] ^ (crc >> 8);
+    std::array<unsigned char,4> footer;
+    storeBigEndian(footer.data(), crc ^ 0xffffffffu);
 
-    if (arguments.inputPath == "-") {
-        // Special case: read from the pipe.
-        if (!std::cin.eof()) {
-            pInputStream = &std::cin;
-        } else {
-            std::cerr << "Error: requested to read input from the pipe, but it is closed.\n";
-            return 2;
+    rStream.write(reinterpret_cast<const char*>(header.data()), header.size());
+    rStream.write(reinterpret_cast<const char*>(pData), static_cast<std::streamsize>(size));
+    rStream.write(reinterpret_cast<const char*>(footer.data()), footer.size());
+}
+
+
+/// @brief Write the PNG signature and the header of an image.
+/// @details Bit-packed images (see @ref mtx2img::isBitPacked) are 1 bit grayscale, the rest 8 bit RGB.
+void writePNGHeader(std::ostream& rStream,
+                    std::pair<std::size_t,std::size_t> imageSize,
+                    bool isBitPacked)
+{
+    const std::array<unsigned char,8> signature {0x89, 'P', 'N', 'G', '\r', '\n', 0x1a, '\n'};
+    std::array<unsigned char,13> header {
+        0, 0, 0, 0,                                         // <== width
+        0, 0, 0, 0,                                         // <== height
+        static_cast<unsigned char>(isBitPacked ? 1 : 8),    // <== bit depth
+        static_cast<unsigned char>(isBitPacked ? 0 : 2),    // <== grayscale or RGB
+        0,                                                  // <== deflate
+        0,                                                  // <== adaptive filtering
+        0                                                   // <== no interlacing
+    };
+    storeBigEndian(header.data(), static_cast<std::uint32_t>(imageSize.first));
+    storeBigEndian(header.data() + 4, static_cast<std::uint32_t>(imageSize.second));
+    rStream.write(reinterpret_cast<const char*>(signature.data()), signature.size());
+    writePNGChunk(rStream, "IHDR", header.data(), header.size());
+}
+
+
+/// @brief Filter and compress a rectangle of an image into the data of its PNG chunks.
+/// @details The rectangle of bit-packed images must begin on a whole byte. RGB images
+///          are filtered and compressed by stb, and their data is taken out of its PNG.
+/// @param rScanlines Buffer for the filtered scanlines of bit-packed images.
+/// @return Empty if the rectangle could not be compressed.
+std::vector<unsigned char> compressImageData(const mtx2img::Image& rImage,
+                                             std::pair<std::size_t,std::size_t> imageSize,
+                                             bool isBitPacked,
+                                             const Rectangle& rRectangle,
+                                             std::vector<unsigned char>& rScanlines)
+{
+    std::vector<unsigned char> data;
+    if (isBitPacked) {
+        // Prepend the filter type (none) to each row, and flip the bits
+        // since set bits mark black pixels but are white in grayscale.
+        assert(rRectangle.x % 8 == 0);
+        const std::size_t imageRowBytes = (imageSize.first + 7) / 8;
+        const std::size_t rowBytes = (rRectangle.width + 7) / 8;
+        rScanlines.resize((rowBytes + 1) * rRectangle.height);
+        for (std::size_t iRow=0ul; iRow<rRectangle.height; ++iRow) {
+            unsigned char* pScanline = rScanlines.data() + iRow * (rowBytes + 1);
+            *pScanline++ = 0;
+            const unsigned char* pRow = rImage.data() + (rRectangle.y + iRow) * imageRowBytes + rRectangle.x / 8;
+            for (std::size_t iByte=0ul; iByte<rowBytes; ++iByte) pScanline[iByte] = static_cast<unsigned char>(~pRow[iByte]);
         }
+
+        if (std::numeric_limits<int>::max() < rScanlines.size()) return data;
+        int compressedSize = 0;
+        unsigned char* pCompressed = stbi_zlib_compress(rScanlines.data(),
+                                                        static_cast<int>(rScanlines.size()),
+                                                        &compressedSize,
+                                                        stbi_write_png_compression_level);
+        if (!pCompressed) return data;
+        data.assign(pCompressed, pCompressed + compressedSize);
+        STBIW_FREE(pCompressed);
     } else {
-        // Otherwise read from a file.
-        maybeInputFile.emplace(arguments.inputPath);
-        pInputStream = &maybeInputFile.value();
-        if (!maybeInputFile.value().good()) {
-            std::cerr << "Error: failed to open input file: " << arguments.inputPath << '\n';
-            return 3;
+        const std::size_t stride = 3 * imageSize.first;
+        if (std::numeric_limits<int>::max() < stride * rRectangle.height) return data;
+        int pngSize = 0;
+        unsigned char* pPNG = stbi_write_png_to_mem(rImage.data() + rRectangle.y * stride + 3 * rRectangle.x,
+                                                    static_cast<int>(stride),
+                                                    static_cast<int>(rRectangle.width),
+                                                    static_cast<int>(rRectangle.height),
+                                                    3,
+                                                    &pngSize);
+        if (!pPNG) return data;
+
+        // Concatenate the data of the IDAT chunks following the 8 byte signature.
+        for (std::size_t iChunk=8ul; iChunk + 12 <= static_cast<std::size_t>(pngSize);) {
+            const std::size_t chunkSize = (std::size_t(pPNG[iChunk]) << 24) | (std::size_t(pPNG[iChunk + 1]) << 16)
+                                        | (std::size_t(pPNG[iChunk + 2]) << 8) | std::size_t(pPNG[iChunk + 3]);
+            if (std::equal(pPNG + iChunk + 4, pPNG + iChunk + 8, "IDAT")) {
+                data.insert(data.end(), pPNG + iChunk + 8, pPNG + iChunk + 8 + chunkSize);
+            }
+            iChunk += chunkSize + 12;
         }
+        STBIW_FREE(pPNG);
     }
 
-    // Set up output stream
-    const std::string outputPath = arguments.outputPath.string();
-    std::ostream* pOutputStream = nullptr;
-    std::optional<std::ofstream> maybeOutputFile;
+    return data;
+}
 
-    if (arguments.outputPath == "-") {
-        // Special case: write to stdout.
-        pOutputStream = &std::cout;
-    } else {
-        // Otherwise write to a file.
-        maybeOutputFile.emplace(arguments.outputPath, std::ios::binary);
-        pOutputStream = &maybeOutputFile.value();
+
+/// @brief Write an image rendered with a colormap as a PNG.
+/// @return False if the image could not be compressed or written.
+bool writePNG(const mtx2img::Image& rImage,
+              std::pair<std::size_t,std::size_t> imageSize,
+              const std::string& rColormapName,
+              std::ostream& rStream)
+{
+    if (!mtx2img::isBitPacked(rColormapName)) {
+        return stbi_write_png_to_func(
+            writeImageData,                                                         // <== write functor
+            reinterpret_cast<void*>(&rStream),                                      // <== write context (output stream)
+            imageSize.first,                                                        // <== image width
+            imageSize.second,                                                       // <== image height
+            rImage.size() / imageSize.first / imageSize.second,                     // <== number of color channels
+            static_cast<const void*>(rImage.data()),                                // <== pointer to image data
+            rImage.size() / imageSize.second * sizeof(unsigned char)                // <== bytes per row
+        ) != 0;
     }
 
-    std::vector<unsigned char> image;
-    std::pair<
-        std::size_t,    // <== width
-        std::size_t     // <== height
-    > imageSize {arguments.resolution, arguments.resolution};
+    // stb can't write 1 bit images.
+    std::vector<unsigned char> scanlines;
+    const std::vector<unsigned char> data = compressImageData(rImage,
+                                                              imageSize,
+                                                              true,
+                                                              {0ul, 0ul, imageSize.first, imageSize.second},
+                                                              scanlines);
+    if (data.empty()) return false;
+    writePNGHeader(rStream, imageSize, true);
+    writePNGChunk(rStream, "IDAT", data.data(), data.size());
+    writePNGChunk(rStream, "IEND", nullptr, 0ul);
+    return rStream.good();
+}
 
-    #ifdef NDEBUG
-    try {
-    #endif
 
-    // Parse the input file and fill an output image buffer
-    // Note: the image gets resized if the matrix dimensions
-    //       are smaller than the requested image dimensions.
-    image = mtx2img::convert(*pInputStream,
-                             imageSize.first,
-                             imageSize.second,
-                             arguments.aggregation,
-                             arguments.colormap);
+/// @brief zlib stream compressed piece by piece, for images that are written while they're rendered.
+/// @details Each piece is compressed into a block with fixed Huffman codes (like stb does for whole
+///          images), whose matches may reach back into the preceding 32 KiB of the stream. Blocks
+///          follow each other bit by bit, so every whole byte is ready once its piece is compressed.
+class DeflateStream
+{
+public:
+    DeflateStream()
+        : _output {0x78, 0x5e},
+          _bitBuffer(0u),
+          _bitCount(0u),
+          _window(),
+          _windowBegin(0ul),
+          _heads(hashSize, noPosition),
+          _links(windowSize, noPosition),
+          _adlerLow(1u),
+          _adlerHigh(0u)
+    {}
 
-    #ifdef NDEBUG
-    } catch (mtx2img::ParsingException& rException) {
-        std::cerr << rException.what();
-        return 4;
-    } catch (mtx2img::InvalidFormat& rException) {
-        std::cerr << rException.what();
-        return 5;
-    } catch (mtx2img::UnsupportedFormat& rException) {
-        std::cerr << rException.what();
-        return 6;
-    } catch (std::invalid_argument& rException) {
-        std::cerr << rException.what();
-        return 7;
+    /// @brief Compress the next piece of the stream.
+    /// @param isLast Terminate the stream after the piece.
+    void write(std::span<const unsigned char> data, bool isLast)
+    {
+        // Adler-32 of the uncompressed stream (sums are reduced before they can overflow).
+        for (std::size_t iBegin=0ul; iBegin<data.size(); iBegin+=5552ul) {
+            for (const unsigned char byte : data.subspan(iBegin, std::min<std::size_t>(5552ul, data.size() - iBegin))) {
+                _adlerLow += byte;
+                _adlerHigh += _adlerLow;
+            }
+            _adlerLow %= 65521u;
+            _adlerHigh %= 65521u;
+        }
+
+        // Block header: final flag and fixed Huffman codes.
+        this->writeBits(isLast ? 1u : 0u, 1u);
+        this->writeBits(1u, 2u);
+
+        // Find the longest match at each position in the hash chain of its first 3 bytes.
+        const std::size_t iBegin = _window.size();
+        _window.insert(_window.end(), data.begin(), data.end());
+        const std::size_t iEnd = _window.size();
+        for (std::size_t i=iBegin; i<iEnd;) {
+            std::size_t bestLength = 0ul, bestDistance = 0ul;
+            if (i + minMatch <= iEnd) {
+                const std::size_t position = _windowBegin + i;
+                const std::size_t maxLength = std::min(maxMatch, iEnd - i);
+                std::size_t candidate = _heads[this->getHash(i)];
+                for (std::size_t iLink=0ul; iLink<maxChain && candidate != noPosition && position - candidate <= windowSize; ++iLink) {
+                    const unsigned char* pCandidate = _window.data() + (candidate - _windowBegin);
+                    const unsigned char* pCurrent = _window.data() + i;
+                    std::size_t length = 0ul;
+                    while (length < maxLength && pCandidate[length] == pCurrent[length]) ++length;
+                    if (bestLength < length) {
+                        bestLength = length;
+                        bestDistance = position - candidate;
+                        if (length == maxLength) break;
+                    }
+                    candidate = _links[candidate % windowSize];
+                }
+            }
+
+            if (minMatch <= bestLength) {
+                this->writeMatch(bestLength, bestDistance);
+            } else {
+                this->writeSymbol(_window[i]);
+                bestLength = 1ul;
+            }
+
+            for (std::size_t iInsert=i; iInsert<i+bestLength && iInsert+minMatch<=iEnd; ++iInsert) {
+                this->insert(iInsert);
+            }
+            i += bestLength;
+        }
+        this->writeSymbol(256u); // <== end of block
+
+        if (isLast) {
+            if (_bitCount % 8u) this->writeBits(0u, 8u - _bitCount % 8u);
+            const std::uint32_t adler = (_adlerHigh << 16) | _adlerLow;
+            for (int shift=24; 0<=shift; shift-=8) _output.push_back(static_cast<unsigned char>(adler >> shift));
+        }
+
+        // Keep the last 32 KiB for matches of the next piece.
+        if (windowSize < _window.size()) {
+            const std::size_t dropped = _window.size() - windowSize;
+            _window.erase(_window.begin(), _window.begin() + static_cast<std::ptrdiff_t>(dropped));
+            _windowBegin += dropped;
+        }
     }
-    #endif
 
-    if (stbi_write_png_to_func(
-        writeImageData,                                                         // <== write functor
-        reinterpret_cast<void*>(pOutputStream),                                 // <== write context (output stream)
-        imageSize.first,                                                        // <== image width
-        imageSize.second,                                                       // <== image height
-        image.size() / imageSize.first / imageSize.second,                      // <== number of color channels
-        static_cast<const void*>(image.data()),                                 // <== pointer to image data
-        image.size() / imageSize.second * sizeof(decltype(image)::value_type)   // <== bytes per row
-        ) == 0) {
-            std::cerr << "Error: failed to write output image.\n";
-            return 1;
+    /// @brief Whole bytes of the stream compressed so far, to be taken out by the caller.
+    std::vector<unsigned char>& getOutput() noexcept
+    {
+        return _output;
     }
 
-    return 0;
+private:
+    static constexpr std::size_t windowSize = 0x8000ul;
+
+    static constexpr std::size_t hashSize = 0x8000ul;
+
+    static constexpr std::size_t maxChain = 32ul;
+
+    static constexpr std::size_t minMatch = 3ul;
+
+    static constexpr std::size_t maxMatch = 258ul;
+
+    static constexpr std::size_t noPosition = std::numeric_limits<std::size_t>::max();
+
+    std::size_t getHash(std::size_t i) const noexcept
+    {
+        const std::uint32_t key = std::uint32_t(_window[i]) | (std::uint32_t(_window[i + 1]) << 8) | (std::uint32_t(_window[i + 2]) << 16);
+        return ((key * 2654435761u) >> 17) & (hashSize - 1);
+    }
+
+    void insert(std::size_t i) noexcept
+    {
+        const std::size_t position = _windowBegin + i;
+        std::size_t& rHead = _heads[this->getHash(i)];
+        _links[position % windowSize] = rHead;
+        rHead = position;
+    }
+
+    void writeBits(std::uint32_t bits, unsigned count)
+    {
+        _bitBuffer |= std::uint64_t(bits) << _bitCount;
+        _bitCount += count;
+        for (; 8u <= _bitCount; _bitCount-=8u) {
+            _output.push_back(static_cast<unsigned char>(_bitBuffer));
+            _bitBuffer >>= 8;
+        }
+    }
+
+    /// @brief Write a Huffman code, which is packed starting at its most significant bit.
+    void writeCode(std::uint32_t code, unsigned length)
+    {
+        std::uint32_t reversed = 0u;
+        for (unsigned iBit=0u; iBit<length; ++iBit) reversed |= ((code >> iBit) & 1u) << (length - 1u - iBit);
+        this->writeBits(reversed, length);
+    }
+
+    /// @brief Write a literal or length symbol with its fixed Huffman code.
+    void writeSymbol(unsigned symbol)
+    {
+        if (symbol < 144u) this->writeCode(0x30u + symbol, 8u);
+        else if (symbol < 256u) this->writeCode(0x190u + symbol - 144u, 9u);
+        else if (symbol < 280u) this->writeCode(symbol - 256u, 7u);
+        else this->writeCode(0xc0u + symbol - 280u, 8u);
+    }
+
+    void writeMatch(std::size_t length, std::size_t distance)
+    {
+        static constexpr std::array<std::uint16_t,29> lengthBases {3, 4, 5, 6, 7, 8, 9, 10, 11, 13, 15, 17, 19, 23, 27, 31, 35, 43, 51, 59, 67, 83, 99, 115, 131, 163, 195, 227, 258};
+        static constexpr std::array<std::uint8_t,29> lengthBits {0, 0, 0, 0, 0, 0, 0, 0, 1, 1, 1, 1, 2, 2, 2, 2, 3, 3, 3, 3, 4, 4, 4, 4, 5, 5, 5, 5, 0};
+        static constexpr std::array<std::uint16_t,30> distanceBases {1, 2, 3, 4, 5, 7, 9, 13, 17, 25, 33, 49, 65, 97, 129, 193, 257, 385, 513, 769, 1025, 1537, 2049, 3073, 4097, 6145, 8193, 12289, 16385, 24577};
+        static constexpr std::array<std::uint8_t,30> distanceBits {0, 0, 0, 0, 1, 1, 2, 2, 3, 3, 4, 4, 5, 5, 6, 6, 7, 7, 8, 8, 9, 9, 10, 10, 11, 11, 12, 12, 13, 13};
+
+        const std::size_t iLength = static_cast<std::size_t>(std::upper_bound(lengthBases.begin(), lengthBases.end(), length) - lengthBases.begin()) - 1;
+        this->writeSymbol(257u + static_cast<unsigned>(iLength));
+        this->writeBits(static_cast<std::uint32_t>(length - lengthBases[iLength]), lengthBits[iLength]);
+
+        const std::size_t iDistance = static_cast<std::size_t>(std::upper_bound(distanceBases.begin(), distanceBases.end(), distance) - distanceBases.begin()) - 1;
+        this->writeCode(static_cast<std::uint32_t>(iDistance), 5u);
+        this->writeBits(static_cast<std::uint32_t>(distance - distanceBases[iDistance]), distanceBits[iDistance]);
+    }
+
+    std::vector<unsigned char> _output;
+
+    std::uint64_t _bitBuffer;
+
+    unsigned _bitCount;
+
+    /// The last 32 KiB of the uncompressed stream, followed by the piece being compressed.
+    std::vector<unsigned char> _window;
+
+    /// Position of the first byte of @ref _window in the uncompressed stream.
+    std::size_t _windowBegin;
+
+    /// Last position of each hash of 3 bytes.
+    std::vector<std::size_t> _heads;
+
+    /// Previous position with the same hash as each position in the window.
+    std::vector<std::size_t> _links;
+
+    std::uint32_t _adlerLow;
+
+    std::uint32_t _adlerHigh;
+}; // class DeflateStream
+
+
+/// @brief Writes a PNG band by band while its image is rendered (see @ref mtx2img::convertBands).
+/// @details Only the previous row and the compressor's window are kept, and IDAT chunks are
+///          written as soon as enough compressed data piled up, so memory doesn't depend on
+///          the height of the image. Rows of RGB images get the filter that minimizes the sum
+///          of their absolute bytes (like stb does), bit-packed rows aren't filtered.
+class PNGBandWriter
+{
+public:
+    PNGBandWriter(std::ostream& rStream,
+                  std::pair<std::size_t,std::size_t> imageSize,
+                  bool isBitPacked)
+        : _pStream(&rStream),
+          _isBitPacked(isBitPacked),
+          _rowBytes(isBitPacked ? (imageSize.first + 7) / 8 : 3 * imageSize.first),
+          _remainingRows(imageSize.second),
+          _previousRow(_rowBytes, 0),
+          _scanlines(),
+          _candidates(),
+          _deflate()
+    {
+        writePNGHeader(rStream, imageSize, isBitPacked);
+    }
+
+    /// @brief Filter, compress and write the next rows of the image.
+    /// @details The PNG is complete once the last row is written.
+    void write(std::span<const unsigned char> rows)
+    {
+        assert(rows.size() % _rowBytes == 0);
+        const std::size_t rowCount = rows.size() / _rowBytes;
+        assert(rowCount <= _remainingRows);
+
+        _scanlines.resize((_rowBytes + 1) * rowCount);
+        std::array<std::vector<unsigned char>,5>& candidates = _candidates;
+        for (std::size_t iRow=0ul; iRow<rowCount; ++iRow) {
+            const std::span<const unsigned char> row = rows.subspan(iRow * _rowBytes, _rowBytes);
+            unsigned char* pScanline = _scanlines.data() + iRow * (_rowBytes + 1);
+            if (_isBitPacked) {
+                // Set bits mark black pixels, but are white in grayscale.
+                *pScanline++ = 0;
+                for (std::size_t iByte=0ul; iByte<_rowBytes; ++iByte) pScanline[iByte] = static_cast<unsigned char>(~row[iByte]);
+            } else {
+                std::size_t bestFilter = 0ul, bestEstimate = std::numeric_limits<std::size_t>::max();
+                for (std::size_t iFilter=0ul; iFilter<candidates.size(); ++iFilter) {
+                    std::vector<unsigned char>& rCandidate = candidates[iFilter];
+                    rCandidate.resize(_rowBytes);
+                    std::size_t estimate = 0ul;
+                    for (std::size_t iByte=0ul; iByte<_rowBytes; ++iByte) {
+                        const int left = 3 <= iByte ? row[iByte - 3] : 0;
+                        const int up = _previousRow[iByte];
+                        const int upLeft = 3 <= iByte ? _previousRow[iByte - 3] : 0;
+                        int prediction = 0;
+                        switch (iFilter) {
+                            case 1: prediction = left; break;
+                            case 2: prediction = up; break;
+                            case 3: prediction = (left + up) / 2; break;
+                            case 4: {
+                                const int distanceLeft = std::abs(up - upLeft);
+                                const int distanceUp = std::abs(left - upLeft);
+                                const int distanceUpLeft = std::abs(left + up - 2 * upLeft);
+                                prediction = (distanceLeft <= distanceUp && distanceLeft <= distanceUpLeft) ? left
+                                           : (distanceUp <= distanceUpLeft ? up : upLeft);
+                                break;
+                            }
+                            default: break;
+                        }
+                        rCandidate[iByte] = static_cast<unsigned char>(row[iByte] - prediction);
+                        estimate += static_cast<std::size_t>(std::abs(static_cast<int>(static_cast<signed char>(rCandidate[iByte]))));
+                    }
+                    if (estimate < bestEstimate) {
+                        bestEstimate = estimate;
+                        bestFilter = iFilter;
+                    }
+                }
+                *pScanline++ = static_cast<unsigned char>(bestFilter);
+                std::copy(candidates[bestFilter].begin(), candidates[bestFilter].end(), pScanline);
+            }
+            std::copy(row.begin(), row.end(), _previousRow.begin());
+        }
+
+        _remainingRows -= rowCount;
+        _deflate.write(_scanlines, _remainingRows == 0ul);
+        std::vector<unsigned char>& rData = _deflate.getOutput();
+        if (chunkBytes <= rData.size() || _remainingRows == 0ul) {
+            writePNGChunk(*_pStream, "IDAT", rData.data(), rData.size());
+            rData.clear();
+        }
+        if (_remainingRows == 0ul) {
+            writePNGChunk(*_pStream, "IEND", nullptr, 0ul);
+        }
+    }
+
+    /// @brief Check whether every row of the image was written.
+    bool isComplete() const noexcept
+    {
+        return _remainingRows == 0ul;
+    }
+
+private:
+    static constexpr std::size_t chunkBytes = 0x10000ul;
+
+    std::ostream* _pStream;
+
+    bool _isBitPacked;
+
+    std::size_t _rowBytes;
+
+    std::size_t _remainingRows;
+
+    std::vector<unsigned char> _previousRow;
+
+    std::vector<unsigned char> _scanlines;
+
+    /// Row filtered by each filter type.
+    std::array<std::vector<unsigned char>,5> _candidates;
+
+    DeflateStream _deflate;
+}; // class PNGBandWriter
+
+
+/// @brief Write structural statistics as a JSON object.
+void writeStatistics(const mtx2img::Statistics& rStatistics, std::ostream& rStream)
+{
+    std::string histogram;
+    for (const std::size_t rowCount : rStatistics.rowNonzeroHistogram) {
+        histogram += std::format("{}{}", histogram.empty() ? "" : ", ", rowCount);
+    }
+
+    rStream
+        << "{\n"
+        << std::format("    \"rows\": {},\n", rStatistics.rows)
+        << std::format("    \"columns\": {},\n", rStatistics.columns)
+        << std::format("    \"nonzeros\": {},\n", rStatistics.nonzeros)
+        << "    \"row_nonzeros\": {\n"
+        << std::format("        \"min\": {},\n", rStatistics.minRowNonzeros)
+        << std::format("        \"max\": {},\n", rStatistics.maxRowNonzeros)
+        << std::format("        \"mean\": {},\n", rStatistics.meanRowNonzeros)
+        << std::format("        \"stddev\": {},\n", rStatistics.stddevRowNonzeros)
+        << std::format("        \"empty_rows\": {},\n", rStatistics.emptyRows)
+        << std::format("        \"log2_histogram\": [{}]\n", histogram)
+        << "    },\n"
+        << std::format("    \"lower_bandwidth\": {},\n", rStatistics.lowerBandwidth)
+        << std::format("    \"upper_bandwidth\": {},\n", rStatistics.upperBandwidth)
+        << std::format("    \"lower_profile\": {},\n", rStatistics.lowerProfile)
+        << std::format("    \"upper_profile\": {},\n", rStatistics.upperProfile)
+        << std::format("    \"diagonal_nonzeros\": {},\n", rStatistics.diagonalNonzeros)
+        << std::format("    \"diagonal_coverage\": {},\n",
+                       rStatistics.diagonalLength ? static_cast<double>(rStatistics.diagonalNonzeros) / rStatistics.diagonalLength : 0.0)
+        << std::format("    \"structural_asymmetry\": {},\n", rStatistics.structuralAsymmetry)
+        << std::format("    \"value_asymmetry\": {}\n",
+                       rStatistics.valueAsymmetry.has_value() ? std::format("{}", rStatistics.valueAsymmetry.value()) : "null")
+        << "}\n";
+}
+
+
+#ifdef MTX2IMG_HAS_IO_URING
+/// @brief Stream buffer reading a file through io_uring.
+/// @details Keeps @ref queueDepth aligned reads of @ref chunkSize bytes in flight,
+///          and exposes completed buffers in file order. Once the parser moves
+///          past a buffer, it is resubmitted for the next unread chunk of the file,
+///          so the kernel fills buffers while the current one is being tokenized.
+///          Direct I/O bypasses the page cache if the file system supports it, and
+///          falls back to buffered reads otherwise.
+class URingBuffer : public std::streambuf
+{
+public:
+    static constexpr std::size_t queueDepth = 8;
+
+    static constexpr std::size_t chunkSize = 0x200000; // <== multiple of any logical block size
+
+    static constexpr std::size_t alignment = 0x1000;
+
+    /// @throws mtx2img::IOError if the ring cannot be set up or the file cannot be opened.
+    URingBuffer(const std::filesystem::path& rPath, bool direct)
+    {
+        try {
+            this->setUp(rPath, direct);
+        } catch (...) {
+            this->release();
+            throw;
+        }
+    }
+
+    URingBuffer(const URingBuffer&) = delete;
+
+    URingBuffer& operator=(const URingBuffer&) = delete;
+
+    ~URingBuffer()
+    {
+        this->release();
+    }
+
+protected:
+    int_type underflow() override
+    {
+        if (_isStarted) {
+            // Reached the end of the file.
+            if (!_sizes[_iCurrent]) return traits_type::eof();
+
+            // Hand the consumed buffer back to the kernel.
+            this->recycle(_iCurrent);
+            _iCurrent = (_iCurrent + 1) % queueDepth;
+        }
+        _isStarted = true;
+
+        this->wait(_iCurrent);
+        const std::size_t size = static_cast<std::size_t>(_sizes[_iCurrent]);
+        if (!size) return traits_type::eof();
+
+        char* pBegin = _buffers[_iCurrent];
+        this->setg(pBegin, pBegin, pBegin + size);
+        return traits_type::to_int_type(*this->gptr());
+    }
+
+private:
+    void setUp(const std::filesystem::path& rPath, bool direct)
+    {
+        // Set up the ring.
+        io_uring_params parameters {};
+        _ring = static_cast<int>(::syscall(SYS_io_uring_setup, static_cast<unsigned>(queueDepth), &parameters));
+        if (_ring < 0) {
+            throw mtx2img::IOError(std::format(
+                "Error: failed to set up io_uring: {}\n",
+                std::strerror(errno)
+            ));
+        }
+
+        _submissionRingSize = parameters.sq_off.array + parameters.sq_entries * sizeof(unsigned);
+        _completionRingSize = parameters.cq_off.cqes + parameters.cq_entries * sizeof(io_uring_cqe);
+        _isSingleMap = parameters.features & IORING_FEAT_SINGLE_MMAP;
+        if (_isSingleMap) {
+            _submissionRingSize = _completionRingSize = std::max(_submissionRingSize, _completionRingSize);
+        }
+        _submissionEntryCount = parameters.sq_entries;
+
+        _pSubmissionRing = this->map(_submissionRingSize, IORING_OFF_SQ_RING);
+        _pCompletionRing = _isSingleMap ? _pSubmissionRing : this->map(_completionRingSize, IORING_OFF_CQ_RING);
+        _pSubmissionEntries = static_cast<io_uring_sqe*>(this->map(_submissionEntryCount * sizeof(io_uring_sqe), IORING_OFF_SQES));
+
+        char* pSubmissionRing = static_cast<char*>(_pSubmissionRing);
+        char* pCompletionRing = static_cast<char*>(_pCompletionRing);
+        _pSubmissionTail = reinterpret_cast<unsigned*>(pSubmissionRing + parameters.sq_off.tail);
+        _submissionMask = *reinterpret_cast<unsigned*>(pSubmissionRing + parameters.sq_off.ring_mask);
+        _pSubmissionArray = reinterpret_cast<unsigned*>(pSubmissionRing + parameters.sq_off.array);
+        _pCompletionHead = reinterpret_cast<unsigned*>(pCompletionRing + parameters.cq_off.head);
+        _pCompletionTail = reinterpret_cast<unsigned*>(pCompletionRing + parameters.cq_off.tail);
+        _completionMask = *reinterpret_cast<unsigned*>(pCompletionRing + parameters.cq_off.ring_mask);
+        _pCompletions = reinterpret_cast<io_uring_cqe*>(pCompletionRing + parameters.cq_off.cqes);
+
+        // Open the file. Direct I/O is not supported by every file system.
+        _file = ::open(rPath.c_str(), O_RDONLY | O_CLOEXEC | (direct ? O_DIRECT : 0));
+        if (_file < 0 && direct && errno == EINVAL) {
+            direct = false;
+            _file = ::open(rPath.c_str(), O_RDONLY | O_CLOEXEC);
+        }
+        if (_file < 0) {
+            throw mtx2img::IOError(std::format(
+                "Error: failed to open input file {}: {}\n",
+                rPath.string(),
+                std::strerror(errno)
+            ));
+        }
+
+        // Short reads are completed synchronously, which needs
+        // a descriptor that doesn't impose alignment constraints.
+        _bufferedFile = direct ? ::open(rPath.c_str(), O_RDONLY | O_CLOEXEC) : _file;
+        if (_bufferedFile < 0) {
+            throw mtx2img::IOError(std::format(
+                "Error: failed to open input file {}: {}\n",
+                rPath.string(),
+                std::strerror(errno)
+            ));
+        }
+
+        struct stat status;
+        if (::fstat(_file, &status)) {
+            throw mtx2img::IOError(std::format(
+                "Error: failed to query input file {}: {}\n",
+                rPath.string(),
+                std::strerror(errno)
+            ));
+        }
+        _fileSize = static_cast<std::uint64_t>(status.st_size);
+
+        // Fill the queue.
+        for (std::size_t iBuffer=0ul; iBuffer<queueDepth; ++iBuffer) {
+            _buffers[iBuffer] = static_cast<char*>(std::aligned_alloc(alignment, chunkSize));
+            if (!_buffers[iBuffer]) throw std::bad_alloc();
+        }
+        for (std::size_t iBuffer=0ul; iBuffer<queueDepth; ++iBuffer) {
+            this->recycle(iBuffer);
+        }
+    }
+
+    void* map(std::size_t size, std::uint64_t offset)
+    {
+        void* pMap = ::mmap(nullptr, size, PROT_READ | PROT_WRITE, MAP_SHARED | MAP_POPULATE, _ring, static_cast<off_t>(offset));
+        if (pMap == MAP_FAILED) {
+            throw mtx2img::IOError(std::format(
+                "Error: failed to map io_uring: {}\n",
+                std::strerror(errno)
+            ));
+        }
+        return pMap;
+    }
+
+    /// @brief Submit a read of the next unread chunk into a buffer, or mark it empty at the end of the file.
+    void recycle(std::size_t iBuffer)
+    {
+        if (_fileSize <= _nextOffset) {
+            _offsets[iBuffer] = _fileSize;
+            _sizes[iBuffer] = 0;
+            return;
+        }
+
+        _offsets[iBuffer] = _nextOffset;
+        _sizes[iBuffer] = pending;
+        _nextOffset += chunkSize;
+
+        const unsigned tail = *_pSubmissionTail;
+        const unsigned iEntry = tail & _submissionMask;
+        io_uring_sqe& rEntry = _pSubmissionEntries[iEntry];
+        std::memset(&rEntry, 0, sizeof(rEntry));
+        rEntry.opcode = IORING_OP_READ;
+        rEntry.fd = _file;
+        rEntry.addr = reinterpret_cast<std::uint64_t>(_buffers[iBuffer]);
+        rEntry.len = static_cast<std::uint32_t>(chunkSize);
+        rEntry.off = _offsets[iBuffer];
+        rEntry.user_data = iBuffer;
+        _pSubmissionArray[iEntry] = iEntry;
+        std::atomic_ref<unsigned>(*_pSubmissionTail).store(tail + 1, std::memory_order_release);
+        ++_inFlight;
+
+        this->enter(1u, 0u, 0u);
+    }
+
+    /// @brief Block until the read into a buffer completes.
+    void wait(std::size_t iBuffer)
+    {
+        while (_sizes[iBuffer] == pending) {
+            if (!this->reap()) this->enter(0u, 1u, IORING_ENTER_GETEVENTS);
+        }
+
+        if (_sizes[iBuffer] < 0) {
+            const int error = static_cast<int>(-_sizes[iBuffer]);
+            _sizes[iBuffer] = 0;
+            throw mtx2img::IOError(std::format(
+                "Error: failed to read input file: {}\n",
+                std::strerror(error)
+            ));
+        }
+
+        // Complete short reads before the end of the file.
+        const std::uint64_t expected = std::min<std::uint64_t>(chunkSize, _fileSize - _offsets[iBuffer]);
+        std::uint64_t size = static_cast<std::uint64_t>(_sizes[iBuffer]);
+        while (size < expected) {
+            const ssize_t readCount = ::pread(_bufferedFile,
+                                              _buffers[iBuffer] + size,
+                                              expected - size,
+                                              static_cast<off_t>(_offsets[iBuffer] + size));
+            if (readCount < 0 && errno == EINTR) continue;
+            if (readCount <= 0) break;
+            size += static_cast<std::uint64_t>(readCount);
+        }
+        _sizes[iBuffer] = static_cast<std::int64_t>(size);
+    }
+
+    /// @brief Record all available completions.
+    /// @return Number of completions reaped.
+    std::size_t reap()
+    {
+        unsigned head = *_pCompletionHead;
+        const unsigned tail = std::atomic_ref<unsigned>(*_pCompletionTail).load(std::memory_order_acquire);
+        std::size_t reapCount = 0ul;
+        for (; head != tail; ++head, ++reapCount) {
+            const io_uring_cqe& rCompletion = _pCompletions[head & _completionMask];
+            _sizes[rCompletion.user_data] = rCompletion.res;
+            --_inFlight;
+        }
+        std::atomic_ref<unsigned>(*_pCompletionHead).store(head, std::memory_order_release);
+        return reapCount;
+    }
+
+    void enter(unsigned submitCount, unsigned waitCount, unsigned flags)
+    {
+        while (::syscall(SYS_io_uring_enter, _ring, submitCount, waitCount, flags, nullptr, 0ul) < 0) {
+            if (errno != EINTR) {
+                throw mtx2img::IOError(std::format(
+                    "Error: failed to read input file: {}\n",
+                    std::strerror(errno)
+                ));
+            }
+        }
+    }
+
+    void release() noexcept
+    {
+        // The kernel may still write into buffers with reads in flight.
+        if (0 <= _ring && _pCompletionHead) {
+            try {
+                while (_inFlight) {
+                    if (!this->reap()) this->enter(0u, 1u, IORING_ENTER_GETEVENTS);
+                }
+            } catch (...) {
+                // Leak the buffers rather than freeing memory the kernel might still write to.
+                _buffers.fill(nullptr);
+            }
+        }
+
+        for (char*& rpBuffer : _buffers) {
+            std::free(rpBuffer);
+            rpBuffer = nullptr;
+        }
+        if (_pSubmissionEntries) ::munmap(_pSubmissionEntries, _submissionEntryCount * sizeof(io_uring_sqe));
+        if (_pCompletionRing && !_isSingleMap) ::munmap(_pCompletionRing, _completionRingSize);
+        if (_pSubmissionRing) ::munmap(_pSubmissionRing, _submissionRingSize);
+        _pSubmissionEntries = nullptr;
+        _pCompletionRing = _pSubmissionRing = nullptr;
+        _pCompletionHead = nullptr;
+        if (_bufferedFile != _file && 0 <= _bufferedFile) ::close(_bufferedFile);
+        if (0 <= _file) ::close(_file);
+        if (0 <= _ring) ::close(_ring);
+        _bufferedFile = _file = _ring = -1;
+    }
+
+    static constexpr std::int64_t pending = std::numeric_limits<std::int64_t>::min();
+
+    int _ring = -1;
+
+    int _file = -1;
+
+    int _bufferedFile = -1;
+
+    std::uint64_t _fileSize = 0;
+
+    std::uint64_t _nextOffset = 0;
+
+    std::array<char*,queueDepth> _buffers {};
+
+    std::array<std::uint64_t,queueDepth> _offsets {};
+
+    std::array<std::int64_t,queueDepth> _sizes {}; // <== byte count, negative error code, or pending
+
+    std::size_t _iCurrent = 0;
+
+    std::size_t _inFlight = 0;
+
+    bool _isStarted = false;
+
+    bool _isSingleMap = false;
+
+    void* _pSubmissionRing = nullptr;
+
+    void* _pCompletionRing = nullptr;
+
+    std::size_t _submissionRingSize = 0;
+
+    std::size_t _completionRingSize = 0;
+
+    std::size_t _submissionEntryCount = 0;
+
+    io_uring_sqe* _pSubmissionEntries = nullptr;
+
+    unsigned* _pSubmissionTail = nullptr;
+
+    unsigned _submissionMask = 0;
+
+    unsigned* _pSubmissionArray = nullptr;
+
+    unsigned* _pCompletionHead = nullptr;
+
+    unsigned* _pCompletionTail = nullptr;
+
+    unsigned _completionMask = 0;
+
+    io_uring_cqe* _pCompletions = nullptr;
+}; // class URingBuffer
+#endif
+
+
+/// @brief Identity of a file that changes whenever the file is replaced or rewritten.
+/// @throws std::filesystem::filesystem_error if the file can't be inspected.
+std::string getFileIdentity(const std::filesystem::path& rPath)
+{
+    const std::uintmax_t size = std::filesystem::file_size(rPath);
+    const auto time = std::filesystem::last_write_time(rPath).time_since_epoch().count();
+
+    #ifdef MTX2IMG_HAS_STAT
+    struct stat status;
+    if (::stat(rPath.c_str(), &status) == 0) {
+        return std::format("{}:{}:{}:{}", status.st_dev, status.st_ino, size, time);
+    }
+    #endif
+
+    return std::format("{}:{}:{}", std::filesystem::absolute(rPath).string(), size, time);
+}
+
+
+/// @brief Describe everything a rendered image depends on (see @ref RenderCache).
+/// @return The key of the image, or nothing if an input can't be inspected (the render reports it).
+std::optional<std::string> getCacheKey(const Arguments& rArguments)
+{
+    try {
+        // A rebuilt executable may render differently.
+        std::string key = "mtx2img render cache 1";
+        std::error_code error;
+        const std::filesystem::path executablePath = std::filesystem::read_symlink("/proc/self/exe", error);
+        if (!error) {
+            key += std::format(" {}", getFileIdentity(executablePath));
+        }
+
+        key += "\ninputs";
+        for (const auto& rPath : rArguments.partPaths.empty() ? std::vector<std::filesystem::path> {rArguments.inputPath} : rArguments.partPaths) {
+            key += std::format(" {}", getFileIdentity(rPath));
+        }
+
+        const auto& rShape = rArguments.shape;
+        const auto& rWindow = rArguments.window;
+        key += std::format("\n-r {} -a {} -c {} -s {},{},{} --window {}:{},{}:{} --scale {} --clip {}:{} --deterministic {}",
+                           rArguments.resolution,
+                           static_cast<int>(rArguments.aggregation),
+                           rArguments.colormap,
+                           rShape.rows.value_or(0), rShape.columns.value_or(0), rShape.nonzeros.value_or(0),
+                           rWindow.rowBegin, rWindow.rowEnd, rWindow.columnBegin, rWindow.columnEnd,
+                           static_cast<int>(rArguments.normalization.scale),
+                           rArguments.normalization.lowPercentile,
+                           rArguments.normalization.highPercentile,
+                           rArguments.deterministic);
+        key += std::format(" --row-perm {} --col-perm {}",
+                           rArguments.permutation.rowPath.empty() ? "-" : getFileIdentity(rArguments.permutation.rowPath),
+                           rArguments.permutation.columnPath.empty() ? "-" : getFileIdentity(rArguments.permutation.columnPath));
+        key += std::format(" --block {}", rArguments.blockSize);
+        return key;
+    } catch (std::filesystem::filesystem_error&) {
+        return {};
+    }
+}
+
+
+/// @brief Directory of rendered PNG images, keyed by everything they depend on (see @ref getCacheKey).
+/// @details Entries are written to a temporary file and renamed into place, so processes sharing
+///          the directory only ever see complete entries. Each entry begins with its whole key on
+///          a line of its own, so a collision of the hashes naming the entries reads as a miss. The
+///          modification time of an entry marks its last use: hits touch it, and stores evict the
+///          least recently used entries past the size cap. An entry evicted by another process while
+///          it's read stays readable through the open file.
+class RenderCache
+{
+public:
+    RenderCache(const std::filesystem::path& rDirectory, std::uintmax_t capacity)
+        : _directory(rDirectory),
+          _capacity(capacity)
+    {}
+
+    /// @brief Write the image cached under a key to a stream.
+    /// @return False if the image isn't cached.
+    bool load(const std::string& rKey, std::ostream& rStream) const
+    {
+        const std::filesystem::path entryPath = this->getEntryPath(rKey);
+        std::ifstream file(entryPath, std::ios::binary);
+        std::string entryKey;
+        for (std::string line; entryKey.size() < rKey.size() && std::getline(file, line);) {
+            entryKey += entryKey.empty() ? "" : "\n";
+            entryKey += line;
+        }
+        if (!file.good() || entryKey != rKey) {
+            return false;
+        }
+
+        const std::string image {std::istreambuf_iterator<char>(file), std::istreambuf_iterator<char>()};
+        if (image.empty()) {
+            return false;
+        }
+
+        std::error_code error;
+        std::filesystem::last_write_time(entryPath, std::filesystem::file_time_type::clock::now(), error);
+
+        #ifndef NDEBUG
+            std::cout << "mtx2img: render cache hit " << entryPath.string() << '\n';
+        #endif
+        rStream.write(image.data(), static_cast<std::streamsize>(image.size()));
+        return true;
+    }
+
+    /// @brief Cache an image, then evict the least recently used entries past the size cap.
+    /// @details The cache is best effort: images that can't be stored are left out.
+    void store(const std::string& rKey, std::string_view image) const
+    {
+        if (_capacity < rKey.size() + 1 + image.size()) {
+            return;
+        }
+
+        std::error_code error;
+        std::filesystem::create_directories(_directory, error);
+        const std::filesystem::path entryPath = this->getEntryPath(rKey);
+        std::filesystem::path temporaryPath = entryPath;
+        temporaryPath.replace_extension(std::format("{:08x}{:08x}.tmp", std::random_device()(), std::random_device()()));
+
+        {
+            std::ofstream file(temporaryPath, std::ios::binary);
+            file << rKey << '\n';
+            file.write(image.data(), static_cast<std::streamsize>(image.size()));
+            file.close();
+            if (!file.good()) {
+                std::filesystem::remove(temporaryPath, error);
+                return;
+            }
+        }
+
+        std::filesystem::rename(temporaryPath, entryPath, error);
+        if (error) {
+            std::filesystem::remove(temporaryPath, error);
+            return;
+        }
+
+        this->evict();
+    }
+
+private:
+    /// @brief Name the entry of a key by its 64 bit FNV-1a hash.
+    std::filesystem::path getEntryPath(const std::string& rKey) const
+    {
+        std::uint64_t hash = 0xcbf29ce484222325ull;
+        for (const char c : rKey) {
+            hash = (hash ^ static_cast<unsigned char>(c)) * 0x100000001b3ull;
+        }
+        return _directory / std::format("{:016x}.entry", hash);
+    }
+
+    /// @brief Remove the least recently used entries until the cache fits its size cap.
+    /// @details Temporary files left over by processes that died while storing an entry are
+    ///          removed after an hour. Files other processes remove in the meantime are skipped.
+    void evict() const
+    {
+        struct Entry
+        {
+            std::filesystem::path path;
+            std::uintmax_t size;
+            std::filesystem::file_time_type time;
+        }; // struct Entry
+
+        std::vector<Entry> entries;
+        std::uintmax_t totalSize = 0;
+        const auto now = std::filesystem::file_time_type::clock::now();
+        std::error_code error;
+        for (const auto& rFile : std::filesystem::directory_iterator(_directory, error)) {
+            std::error_code fileError;
+            Entry entry {rFile.path(), rFile.file_size(fileError), rFile.last_write_time(fileError)};
+            if (fileError) continue;
+
+            if (entry.path.extension() == ".entry") {
+                totalSize += entry.size;
+                entries.push_back(std::move(entry));
+            } else if (entry.path.extension() == ".tmp" && entry.time + std::chrono::hours(1) < now) {
+                std::filesystem::remove(entry.path, fileError);
+            }
+        }
+
+        std::sort(entries.begin(), entries.end(), [](const Entry& rLeft, const Entry& rRight){
+            return rLeft.time < rRight.time;
+        });
+        for (auto itEntry=entries.begin(); _capacity < totalSize && itEntry!=entries.end(); ++itEntry) {
+            #ifndef NDEBUG
+                std::cout << "mtx2img: evict " << itEntry->path.string() << " from the render cache\n";
+            #endif
+            std::filesystem::remove(itEntry->path, error);
+            totalSize -= itEntry->size;
+        }
+    }
+
+    std::filesystem::path _directory;
+
+    std::uintmax_t _capacity;
+}; // class RenderCache
+
+
+/// @brief Convert a single input file, reading it the way its format allows.
+/// @details PETSc binary and Harwell-Boeing files are mapped, MatrixMarket files with a row index are
+///          read in row ranges, and the rest goes through a stream.
+mtx2img::Image convertFile(const Arguments& rArguments,
+                           const std::filesystem::path& rInputPath,
+                           std::size_t threadCount,
+                           std::pair<std::size_t,std::size_t>& rImageSize,
+                           mtx2img::Statistics* pStatistics,
+                           std::ostream* pPartial)
+{
+    if (mtx2img::isPETScBinary(rInputPath)) {
+        if (!rArguments.permutation.rowPath.empty() || !rArguments.permutation.columnPath.empty()) {
+            throw mtx2img::UnsupportedFormat("Error: permutations are not supported for PETSc binary inputs\n");
+        }
+        return mtx2img::convertPETSc(rInputPath,
+                                     rImageSize.first,
+                                     rImageSize.second,
+                                     rArguments.aggregation,
+                                     rArguments.colormap,
+                                     threadCount,
+                                     rArguments.window,
+                                     rArguments.normalization,
+                                     pStatistics,
+                                     pPartial);
+    } else if (mtx2img::isHarwellBoeing(rInputPath)) {
+        if (!rArguments.permutation.rowPath.empty() || !rArguments.permutation.columnPath.empty()) {
+            throw mtx2img::UnsupportedFormat("Error: permutations are not supported for Harwell-Boeing inputs\n");
+        }
+        return mtx2img::convertHarwellBoeing(rInputPath,
+                                             rImageSize.first,
+                                             rImageSize.second,
+                                             rArguments.aggregation,
+                                             rArguments.colormap,
+                                             threadCount,
+                                             rArguments.window,
+                                             rArguments.normalization,
+                                             pStatistics,
+                                             pPartial);
+    } else if (const std::filesystem::path indexPath = mtx2img::getRowIndexPath(rInputPath);
+               std::filesystem::exists(indexPath)) {
+        // An index is only an accelerator, so a stale one falls back to reading the whole input.
+        if (mtx2img::isRowIndexCurrent(rInputPath, indexPath)) {
+            return mtx2img::convertIndexed(rInputPath,
+                                           indexPath,
+                                           rImageSize.first,
+                                           rImageSize.second,
+                                           rArguments.aggregation,
+                                           rArguments.colormap,
+                                           threadCount,
+                                           rArguments.window,
+                                           rArguments.normalization,
+                                           pStatistics,
+                                           rArguments.deterministic,
+                                           rArguments.permutation,
+                                           pPartial);
+        }
+        std::cerr << std::format("mtx2img: WARNING: ignoring out of date or invalid row index {}\n",
+                                 indexPath.string());
+    }
+
+    std::ifstream file(rInputPath);
+    if (!file.good()) {
+        throw mtx2img::IOError(std::format("Error: failed to open input file: {}\n", rInputPath.string()));
+    }
+    std::istream* pInputStream = &file;
+
+    #ifdef MTX2IMG_HAS_IO_URING
+    // Replace the file stream with one reading through io_uring.
+    std::optional<URingBuffer> maybeRing;
+    std::optional<std::istream> maybeRingStream;
+    if (rArguments.readEngine != ReadEngine::Stream) {
+        file.close();
+        maybeRing.emplace(rInputPath, rArguments.readEngine == ReadEngine::URingDirect);
+        maybeRingStream.emplace(&maybeRing.value());
+
+        // Let read errors propagate instead of ending the stream.
+        maybeRingStream.value().exceptions(std::ios::badbit);
+        pInputStream = &maybeRingStream.value();
+    }
+    #endif
+
+    return mtx2img::convert(*pInputStream,
+                            rImageSize.first,
+                            rImageSize.second,
+                            rArguments.aggregation,
+                            rArguments.colormap,
+                            threadCount,
+                            rArguments.window,
+                            rArguments.normalization,
+                            pStatistics,
+                            rArguments.deterministic,
+                            rArguments.permutation,
+                            pPartial,
+                            rArguments.blockSize);
+}
+
+
+/// @brief Render an input band by band, and write its PNG while the input is read (see @ref mtx2img::convertBands).
+/// @param rInput Stream to read from if the input path is '-'.
+/// @return False if the image could not be written.
+bool streamImage(const Arguments& rArguments,
+                 std::istream& rInput,
+                 std::pair<std::size_t,std::size_t>& rImageSize,
+                 std::ostream& rOutput)
+{
+    std::istream* pInputStream = &rInput;
+    std::optional<std::ifstream> maybeFile;
+    if (rArguments.inputPath != "-") {
+        if (mtx2img::isPETScBinary(rArguments.inputPath)) {
+            throw mtx2img::UnsupportedFormat("Error: PETSc binary inputs can't be streamed\n");
+        } else if (mtx2img::isHarwellBoeing(rArguments.inputPath)) {
+            throw mtx2img::UnsupportedFormat("Error: Harwell-Boeing inputs can't be streamed\n");
+        }
+        maybeFile.emplace(rArguments.inputPath);
+        if (!maybeFile.value().good()) {
+            throw mtx2img::IOError(std::format("Error: failed to open input file: {}\n", rArguments.inputPath.string()));
+        }
+        pInputStream = &maybeFile.value();
+    }
+
+    // The header goes out with the first rows, once the size of the image is known.
+    std::optional<PNGBandWriter> maybeWriter;
+    mtx2img::convertBands(*pInputStream,
+                          rImageSize.first,
+                          rImageSize.second,
+                          rArguments.aggregation,
+                          rArguments.colormap,
+                          [&](std::span<const unsigned char> rows) {
+                              if (!maybeWriter.has_value()) {
+                                  maybeWriter.emplace(rOutput, rImageSize, mtx2img::isBitPacked(rArguments.colormap));
+                              }
+                              maybeWriter.value().write(rows);
+                          },
+                          rArguments.threads,
+                          rArguments.window,
+                          rArguments.normalization);
+
+    // Images without pixels don't hand over any rows.
+    if (!maybeWriter.has_value()) {
+        return writePNG({}, rImageSize, rArguments.colormap, rOutput);
+    }
+    return maybeWriter.value().isComplete() && rOutput.good();
+}
+
+
+/// @brief Find the smallest rectangle holding every pixel that differs between two images.
+/// @details Rectangles of bit-packed images are widened to whole bytes. Identical images
+///          get a single pixel, since frames of an animated PNG can't be empty.
+Rectangle getChangedRectangle(const mtx2img::Image& rPrevious,
+                              const mtx2img::Image& rCurrent,
+                              std::pair<std::size_t,std::size_t> imageSize,
+                              bool isBitPacked)
+{
+    const std::size_t rowBytes = rCurrent.size() / imageSize.second;
+    std::size_t rowBegin = imageSize.second, rowEnd = 0ul;
+    std::size_t byteBegin = rowBytes, byteEnd = 0ul;
+    for (std::size_t iRow=0ul; iRow<imageSize.second; ++iRow) {
+        const unsigned char* pCurrent = rCurrent.data() + iRow * rowBytes;
+        const unsigned char* pPrevious = rPrevious.data() + iRow * rowBytes;
+        const std::size_t firstChange = std::mismatch(pCurrent, pCurrent + rowBytes, pPrevious).first - pCurrent;
+        if (firstChange == rowBytes) continue;
+
+        const auto itLastChange = std::mismatch(std::make_reverse_iterator(pCurrent + rowBytes),
+                                                std::make_reverse_iterator(pCurrent),
+                                                std::make_reverse_iterator(pPrevious + rowBytes)).first;
+        rowBegin = std::min(rowBegin, iRow);
+        rowEnd = iRow + 1;
+        byteBegin = std::min(byteBegin, firstChange);
+        byteEnd = std::max(byteEnd, static_cast<std::size_t>(itLastChange.base() - pCurrent));
+    }
+
+    if (rowEnd == 0ul) {
+        return {0ul, 0ul, 1ul, 1ul};
+    } else if (isBitPacked) {
+        return {8 * byteBegin, rowBegin, std::min(imageSize.first, 8 * byteEnd) - 8 * byteBegin, rowEnd - rowBegin};
+    } else {
+        return {byteBegin / 3, rowBegin, (byteEnd + 2) / 3 - byteBegin / 3, rowEnd - rowBegin};
+    }
+}
+
+
+/// @brief Run a task and report the errors it throws to @p rErrors.
+/// @details Errors are only caught in release builds, debug builds let them propagate.
+/// @return Exit code of the error thrown by @p rTask, or 0 if it succeeded.
+template <class TTask>
+int runReporting([[maybe_unused]] std::ostream& rErrors, TTask&& rTask)
+{
+    #ifdef NDEBUG
+    try {
+    #endif
+
+    rTask();
+
+    #ifdef NDEBUG
+    } catch (mtx2img::ParsingException& rException) {
+        rErrors << rException.what();
+        return 4;
+    } catch (mtx2img::InvalidFormat& rException) {
+        rErrors << rException.what();
+        return 5;
+    } catch (mtx2img::UnsupportedFormat& rException) {
+        rErrors << rException.what();
+        return 6;
+    } catch (std::invalid_argument& rException) {
+        rErrors << rException.what();
+        return 7;
+    } catch (mtx2img::IOError& rException) {
+        rErrors << rException.what();
+        return 3;
+    }
+    #endif
+
+    return 0;
+}
+
+
+/// @brief Render the inputs of a sequence into the frames of an animated PNG, or into numbered PNGs.
+/// @details Several frames are rendered at once, each with a share of the threads, by workers
+///          that also compress them. Frames of an animated PNG only hold the rectangle that
+///          changed since the previous frame, so each worker waits for the previous frame to
+///          be rendered before compressing its own, while the calling thread writes compressed
+///          frames in order. Images are released as soon as the next frame was compared to them.
+/// @return Exit code of the conversion.
+int renderSequence(const Arguments& rArguments,
+                   std::ostream& rOutput,
+                   std::ostream& rErrors)
+{
+    const std::size_t frameCount = rArguments.framePaths.size();
+    const bool isBitPacked = mtx2img::isBitPacked(rArguments.colormap);
+    const bool isNumbered = getFramePath(rArguments.outputPath, 0ul).has_value();
+    const std::size_t workerCount = std::clamp<std::size_t>(rArguments.threads, 1ul, frameCount);
+    const std::size_t frameThreads = std::max<std::size_t>(rArguments.threads / workerCount, 1ul);
+
+    struct Frame
+    {
+        std::shared_ptr<const mtx2img::Image> pImage;               // <== until the next frame is compared to it
+        std::pair<std::size_t,std::size_t> imageSize;
+        Rectangle rectangle;
+        std::vector<unsigned char> data;                            // <== compressed rectangle
+        bool isRendered = false;
+        bool isEncoded = false;
+    }; // struct Frame
+
+    std::vector<Frame> frames(frameCount);
+    std::mutex mutex;
+    std::condition_variable condition;
+    std::atomic<std::size_t> nextFrame = 0ul;
+    std::exception_ptr failure;
+    std::atomic<bool> isAborted = false;
+
+    const auto work = [&]() {
+        std::vector<unsigned char> scanlines;
+        try {
+            for (std::size_t iFrame=nextFrame++; iFrame<frameCount && !isAborted; iFrame=nextFrame++) {
+                const std::filesystem::path& rFramePath = rArguments.framePaths[iFrame];
+                std::pair<std::size_t,std::size_t> imageSize {rArguments.resolution, rArguments.resolution};
+                std::shared_ptr<const mtx2img::Image> pImage;
+                try {
+                    pImage = std::make_shared<const mtx2img::Image>(
+                        convertFile(rArguments, rFramePath, frameThreads, imageSize, nullptr, nullptr)
+                    );
+                } catch (mtx2img::ParsingException& rException) {
+                    // Point to the input the error is in.
+                    throw mtx2img::ParsingException(std::format(
+                        "In {}:\n{}",
+                        rFramePath.string(),
+                        rException.what()
+                    ));
+                }
+
+                if (isNumbered) {
+                    const std::filesystem::path outputPath = getFramePath(rArguments.outputPath, iFrame).value();
+                    std::ofstream outputFile(outputPath, std::ios::binary);
+                    if (!writePNG(*pImage, imageSize, rArguments.colormap, outputFile)) {
+                        throw mtx2img::IOError(std::format("Error: failed to write output image {}\n", outputPath.string()));
+                    }
+                    continue;
+                }
+
+                // Publish the image, and take the previous one to compare against.
+                std::shared_ptr<const mtx2img::Image> pPrevious;
+                {
+                    std::unique_lock<std::mutex> lock(mutex);
+                    frames[iFrame].pImage = pImage;
+                    frames[iFrame].imageSize = imageSize;
+                    frames[iFrame].isRendered = true;
+                    condition.notify_all();
+                    if (iFrame) {
+                        condition.wait(lock, [&](){return isAborted || frames[iFrame - 1].isRendered;});
+                        if (isAborted) return;
+                        pPrevious = std::move(frames[iFrame - 1].pImage);
+                        if (frames[iFrame - 1].imageSize != imageSize) {
+                            throw mtx2img::InvalidFormat(std::format(
+                                "Error: all frames of a sequence must have the same size, but {} renders to {}x{} pixels and {} to {}x{}\n",
+                                rArguments.framePaths[iFrame - 1].string(),
+                                frames[iFrame - 1].imageSize.first,
+                                frames[iFrame - 1].imageSize.second,
+                                rFramePath.string(),
+                                imageSize.first,
+                                imageSize.second
+                            ));
+                        }
+                    }
+                }
+
+                const Rectangle rectangle = pPrevious ? getChangedRectangle(*pPrevious, *pImage, imageSize, isBitPacked)
+                                                      : Rectangle {0ul, 0ul, imageSize.first, imageSize.second};
+                pPrevious.reset();
+                std::vector<unsigned char> data = compressImageData(*pImage, imageSize, isBitPacked, rectangle, scanlines);
+                if (data.empty()) {
+                    throw mtx2img::IOError(std::format("Error: failed to compress the frame of {}\n", rFramePath.string()));
+                }
+
+                std::scoped_lock<std::mutex> lock(mutex);
+                frames[iFrame].rectangle = rectangle;
+                frames[iFrame].data = std::move(data);
+                frames[iFrame].isEncoded = true;
+                condition.notify_all();
+            } // for iFrame
+        } catch (...) {
+            std::scoped_lock<std::mutex> lock(mutex);
+            if (!failure) failure = std::current_exception();
+            isAborted = true;
+            condition.notify_all();
+        }
+    };
+
+    // Set up output stream
+    std::ostream* pOutputStream = &rOutput;
+    std::optional<std::ofstream> maybeOutputFile;
+    if (!isNumbered && rArguments.outputPath != "-") {
+        maybeOutputFile.emplace(rArguments.outputPath, std::ios::binary);
+        pOutputStream = &maybeOutputFile.value();
+    }
+
+    {
+        std::vector<std::jthread> workers;
+        for (std::size_t iWorker=0ul; iWorker<workerCount; ++iWorker) {
+            workers.emplace_back(work);
+        }
+
+        // Write the frames of the animated PNG in order as they get compressed.
+        // Note: fcTL and fdAT chunks share their sequence numbers.
+        std::vector<unsigned char> chunk;
+        std::uint32_t sequenceNumber = 0u;
+        for (std::size_t iFrame=0ul; iFrame<frameCount && !isNumbered; ++iFrame) {
+            Frame frame;
+            {
+                std::unique_lock<std::mutex> lock(mutex);
+                condition.wait(lock, [&](){return isAborted || frames[iFrame].isEncoded;});
+                if (isAborted) break;
+                frame.imageSize = frames[iFrame].imageSize;
+                frame.rectangle = frames[iFrame].rectangle;
+                frame.data = std::move(frames[iFrame].data);
+            }
+
+            if (iFrame == 0ul) {
+                writePNGHeader(*pOutputStream, frame.imageSize, isBitPacked);
+                std::array<unsigned char,8> animationControl;
+                storeBigEndian(animationControl.data(), static_cast<std::uint32_t>(frameCount));
+                storeBigEndian(animationControl.data() + 4, 0u); // <== loop forever
+                writePNGChunk(*pOutputStream, "acTL", animationControl.data(), animationControl.size());
+            }
+
+            std::array<unsigned char,26> frameControl {};
+            storeBigEndian(frameControl.data(), sequenceNumber++);
+            storeBigEndian(frameControl.data() + 4, static_cast<std::uint32_t>(frame.rectangle.width));
+            storeBigEndian(frameControl.data() + 8, static_cast<std::uint32_t>(frame.rectangle.height));
+            storeBigEndian(frameControl.data() + 12, static_cast<std::uint32_t>(frame.rectangle.x));
+            storeBigEndian(frameControl.data() + 16, static_cast<std::uint32_t>(frame.rectangle.y));
+            frameControl[21] = 1; // <== delay of 1 / frame rate seconds
+            frameControl[22] = static_cast<unsigned char>(rArguments.frameRate >> 8);
+            frameControl[23] = static_cast<unsigned char>(rArguments.frameRate);
+            // Note: the rest of the frame is kept (APNG_DISPOSE_OP_NONE), and
+            //       the rectangle replaces its pixels (APNG_BLEND_OP_SOURCE).
+            writePNGChunk(*pOutputStream, "fcTL", frameControl.data(), frameControl.size());
+
+            // The first frame doubles as the default image.
+            if (iFrame == 0ul) {
+                writePNGChunk(*pOutputStream, "IDAT", frame.data.data(), frame.data.size());
+            } else {
+                chunk.resize(4 + frame.data.size());
+                storeBigEndian(chunk.data(), sequenceNumber++);
+                std::copy(frame.data.begin(), frame.data.end(), chunk.begin() + 4);
+                writePNGChunk(*pOutputStream, "fdAT", chunk.data(), chunk.size());
+            }
+        } // for iFrame
+
+        if (!isNumbered && !isAborted) {
+            writePNGChunk(*pOutputStream, "IEND", nullptr, 0ul);
+        }
+    } // <== join workers
+
+    const int exitCode = runReporting(rErrors, [&failure](){
+        if (failure) std::rethrow_exception(failure);
+    });
+    if (exitCode) {
+        return exitCode;
+    }
+
+    if (!pOutputStream->good()) {
+        rErrors << "Error: failed to write output image.\n";
+        return 1;
+    }
+
+    return 0;
+}
+
+
+/// @brief Convert the input of a request and write the image to its output.
+/// @param rInput Stream to read from if the input path is '-'.
+/// @param rOutput Stream to write the image to if the output path is '-'.
+/// @param rErrors Stream to report errors to.
+/// @return Exit code of the conversion.
+int render(const Arguments& rArguments,
+           std::istream& rInput,
+           std::ostream& rOutput,
+           std::ostream& rErrors)
+{
+    // Sequences render each input into a frame of their own.
+    if (!rArguments.framePaths.empty()) {
+        return renderSequence(rArguments, rOutput, rErrors);
+    }
+
+    // Special case: read from the pipe.
+    if (rArguments.inputPath == "-" && rInput.eof()) {
+        rErrors << "Error: requested to read input from the pipe, but it is closed.\n";
+        return 2;
+    }
+
+    // Set up output stream
+    std::ostream* pOutputStream = nullptr;
+    std::optional<std::ofstream> maybeOutputFile;
+
+    if (rArguments.outputPath == "-") {
+        // Special case: write to the provided stream.
+        pOutputStream = &rOutput;
+    } else {
+        // Otherwise write to a file.
+        maybeOutputFile.emplace(rArguments.outputPath, std::ios::binary);
+        pOutputStream = &maybeOutputFile.value();
+    }
+
+    // Cached images are copied without parsing the input.
+    std::optional<RenderCache> maybeCache;
+    const std::optional<std::string> maybeCacheKey = rArguments.cachePath.empty() ? std::nullopt : getCacheKey(rArguments);
+    if (maybeCacheKey.has_value()) {
+        maybeCache.emplace(rArguments.cachePath, rArguments.cacheBytes);
+        if (maybeCache.value().load(maybeCacheKey.value(), *pOutputStream)) {
+            if (!pOutputStream->good()) {
+                rErrors << "Error: failed to write output image.\n";
+                return 1;
+            }
+            return 0;
+        }
+    }
+
+    mtx2img::Image image;
+    std::pair<
+        std::size_t,    // <== width
+        std::size_t     // <== height
+    > imageSize {rArguments.resolution, rArguments.resolution};
+
+    mtx2img::Statistics statistics;
+    mtx2img::Statistics* pStatistics = rArguments.statisticsPath.empty() ? nullptr : &statistics;
+    bool isWritten = false;
+
+    // Partial renders are written while the image is rendered.
+    std::optional<std::ofstream> maybePartialFile;
+    if (!rArguments.partialPath.empty()) {
+        maybePartialFile.emplace(rArguments.partialPath, std::ios::binary);
+        if (!maybePartialFile.value().good()) {
+            rErrors << "Error: failed to open partial render " << rArguments.partialPath.string() << "\n";
+            return 3;
+        }
+    }
+    std::ostream* pPartial = maybePartialFile ? &maybePartialFile.value() : nullptr;
+
+    // Parse the input file and fill an output image buffer
+    // Note: the image gets resized if the matrix dimensions
+    //       are smaller than the requested image dimensions.
+    const int exitCode = runReporting(rErrors, [&](){
+        if (!rArguments.partPaths.empty()) {
+            // Parts of a partitioned input are opened by the converter.
+            image = mtx2img::convertParts(rArguments.partPaths,
+                                          imageSize.first,
+                                          imageSize.second,
+                                          rArguments.aggregation,
+                                          rArguments.colormap,
+                                          rArguments.threads,
+                                          rArguments.shape,
+                                          rArguments.window,
+                                          rArguments.normalization,
+                                          pStatistics,
+                                          rArguments.deterministic,
+                                          rArguments.permutation,
+                                          pPartial);
+        } else if (rArguments.stream) {
+            // Streamed images are written while they're rendered.
+            isWritten = streamImage(rArguments, rInput, imageSize, *pOutputStream);
+        } else if (rArguments.inputPath == "-") {
+            image = mtx2img::convert(rInput,
+                                     imageSize.first,
+                                     imageSize.second,
+                                     rArguments.aggregation,
+                                     rArguments.colormap,
+                                     rArguments.threads,
+                                     rArguments.window,
+                                     rArguments.normalization,
+                                     pStatistics,
+                                     rArguments.deterministic,
+                                     rArguments.permutation,
+                                     pPartial,
+                                     rArguments.blockSize);
+        } else {
+            image = convertFile(rArguments, rArguments.inputPath, rArguments.threads, imageSize, pStatistics, pPartial);
+        }
+    });
+    if (exitCode) {
+        return exitCode;
+    }
+
+    // Cached images are encoded in memory first, then copied to the output and the cache.
+    if (maybeCache.has_value()) {
+        std::ostringstream png;
+        isWritten = writePNG(image, imageSize, rArguments.colormap, png);
+        if (isWritten) {
+            pOutputStream->write(png.view().data(), static_cast<std::streamsize>(png.view().size()));
+            isWritten = pOutputStream->good();
+            maybeCache.value().store(maybeCacheKey.value(), png.view());
+        }
+    } else if (!rArguments.stream) {
+        isWritten = writePNG(image, imageSize, rArguments.colormap, *pOutputStream);
+    }
+
+    if (!isWritten) {
+        rErrors << "Error: failed to write output image.\n";
+        return 1;
+    }
+
+    if (pStatistics) {
+        std::ofstream statisticsFile(rArguments.statisticsPath);
+        writeStatistics(statistics, statisticsFile);
+        if (!statisticsFile.good()) {
+            rErrors << "Error: failed to write statistics to " << rArguments.statisticsPath.string() << "\n";
+            return 3;
+        }
+    }
+
+    return 0;
+}
+
+
+/// @brief Render where two input files differ.
+/// @param rArguments Arguments of a render of the first input.
+int diff(const Arguments& rArguments,
+         const std::filesystem::path& rSecondPath,
+         std::ostream& rOutput,
+         std::ostream& rErrors)
+{
+    std::optional<std::ofstream> maybeOutputFile;
+    std::ostream* pOutputStream = &rOutput;
+    if (rArguments.outputPath != "-") {
+        maybeOutputFile.emplace(rArguments.outputPath, std::ios::binary);
+        pOutputStream = &maybeOutputFile.value();
+    }
+
+    mtx2img::Image image;
+    std::pair<std::size_t,std::size_t> imageSize {rArguments.resolution, rArguments.resolution};
+
+    const int exitCode = runReporting(rErrors, [&](){
+        for (const auto& rPath : {rArguments.inputPath, rSecondPath}) {
+            if (mtx2img::isPETScBinary(rPath) || mtx2img::isHarwellBoeing(rPath)) {
+                throw mtx2img::UnsupportedFormat(std::format(
+                    "Error: differences of PETSc binary and Harwell-Boeing inputs are not supported: {}\n",
+                    rPath.string()
+                ));
+            }
+        }
+
+        image = mtx2img::convertDifference(rArguments.inputPath,
+                                           rSecondPath,
+                                           imageSize.first,
+                                           imageSize.second,
+                                           rArguments.aggregation,
+                                           rArguments.threads,
+                                           rArguments.window,
+                                           rArguments.deterministic);
+    });
+    if (exitCode) {
+        return exitCode;
+    }
+
+    // Note: any colormap but the binary one makes an RGB image.
+    if (!writePNG(image, imageSize, "diverging", *pOutputStream)) {
+        rErrors << "Error: failed to write output image.\n";
+        return 1;
+    }
+
+    return 0;
+}
+
+
+/// @brief Combine partial renders into one image.
+/// @param rArguments Arguments of a render of the first partial.
+int merge(const Arguments& rArguments,
+          const std::vector<std::filesystem::path>& rPartialPaths,
+          std::ostream& rOutput,
+          std::ostream& rErrors)
+{
+    std::optional<std::ofstream> maybeOutputFile;
+    std::ostream* pOutputStream = &rOutput;
+    if (rArguments.outputPath != "-") {
+        maybeOutputFile.emplace(rArguments.outputPath, std::ios::binary);
+        pOutputStream = &maybeOutputFile.value();
+    }
+
+    mtx2img::Image image;
+    std::pair<std::size_t,std::size_t> imageSize {0ul, 0ul};
+
+    const int exitCode = runReporting(rErrors, [&](){
+        image = mtx2img::mergePartials(rPartialPaths,
+                                       imageSize.first,
+                                       imageSize.second,
+                                       rArguments.colormap,
+                                       rArguments.threads,
+                                       rArguments.normalization);
+    });
+    if (exitCode) {
+        return exitCode;
+    }
+
+    if (!writePNG(image, imageSize, rArguments.colormap, *pOutputStream)) {
+        rErrors << "Error: failed to write output image.\n";
+        return 1;
+    }
+
+    return 0;
+}
+
+
+/// @brief Build the row index of an input file.
+int index(const std::filesystem::path& rInputPath,
+          const std::filesystem::path& rIndexPath,
+          std::ostream& rErrors)
+{
+    return runReporting(rErrors, [&](){
+        validateInputFile(rInputPath);
+        mtx2img::writeRowIndex(rInputPath, rIndexPath);
+    });
+}
+
+
+#ifdef MTX2IMG_HAS_SOCKETS
+/// @brief Stream buffer reading from and writing to a connected socket.
+class SocketBuffer : public std::streambuf
+{
+public:
+    explicit SocketBuffer(int socket)
+        : _socket(socket),
+          _inputBuffer(0x10000)
+    {
+        this->setg(_inputBuffer.data(), _inputBuffer.data(), _inputBuffer.data());
+    }
+
+protected:
+    int_type underflow() override
+    {
+        ssize_t readCount = 0;
+        do {
+            readCount = ::recv(_socket, _inputBuffer.data(), _inputBuffer.size(), 0);
+        } while (readCount < 0 && errno == EINTR);
+
+        if (readCount <= 0) {
+            return traits_type::eof();
+        }
+
+        this->setg(_inputBuffer.data(), _inputBuffer.data(), _inputBuffer.data() + readCount);
+        return traits_type::to_int_type(*this->gptr());
+    }
+
+    std::streamsize xsputn(const char* pBegin, std::streamsize count) override
+    {
+        std::streamsize writeCount = 0;
+        while (writeCount < count) {
+            const ssize_t sent = ::send(_socket, pBegin + writeCount, static_cast<std::size_t>(count - writeCount), 0);
+            if (sent < 0) {
+                if (errno == EINTR) continue;
+                break;
+            }
+            writeCount += sent;
+        }
+        return writeCount;
+    }
+
+    int_type overflow(int_type character) override
+    {
+        if (traits_type::eq_int_type(character, traits_type::eof())) {
+            return traits_type::not_eof(character);
+        }
+        const char c = traits_type::to_char_type(character);
+        return this->xsputn(&c, 1) == 1 ? character : traits_type::eof();
+    }
+
+private:
+    int _socket;
+
+    std::vector<char> _inputBuffer;
+}; // class SocketBuffer
+
+
+/// @brief Split a request line into arguments.
+/// @details Arguments are separated by whitespace, unless enclosed in double quotes.
+std::vector<std::string> splitRequest(std::string_view request)
+{
+    std::vector<std::string> arguments;
+    auto it = request.begin();
+    while (true) {
+        it = std::find_if_not(it, request.end(), [](char c){return std::isspace(static_cast<unsigned char>(c));});
+        if (it == request.end()) break;
+
+        if (*it == '"') {
+            const auto itEnd = std::find(++it, request.end(), '"');
+            arguments.emplace_back(it, itEnd);
+            it = itEnd == request.end() ? itEnd : itEnd + 1;
+        } else {
+            const auto itEnd = std::find_if(it, request.end(), [](char c){return std::isspace(static_cast<unsigned char>(c));});
+            arguments.emplace_back(it, itEnd);
+            it = itEnd;
+        }
+    }
+    return arguments;
+}
+
+
+/// @brief Serve a single request on a connected socket.
+/// @details The request is a single line of command line arguments (without
+///          the name of the executable). If the input path is '-', the
+///          MatrixMarket input follows the request line until the client shuts
+///          down its end of the connection. The response begins with a status line:
+///          - "OK <byte-count>\n" followed by the PNG image if the output path is '-',
+///            or "OK 0\n" if the image was written to the requested output path.
+///          - "ERROR <exit-code>\n" followed by the error message.
+void serveRequest(int socket, std::string& rImageBuffer)
+{
+    SocketBuffer socketBuffer(socket);
+    std::iostream stream(&socketBuffer);
+    std::ostringstream errors;
+    int status = 0;
+
+    std::string request;
+    std::getline(stream, request);
+
+    try {
+        const std::vector<std::string> requestArguments = splitRequest(request);
+        std::vector<const char*> argv {"mtx2img"};
+        for (const auto& rArgument : requestArguments) argv.push_back(rArgument.c_str());
+
+        auto maybeArguments = parseArguments(static_cast<int>(argv.size()), argv.data());
+        if (!maybeArguments.has_value()) {
+            throw std::invalid_argument("Error: missing input and output paths\n");
+        }
+
+        // Requests are processed concurrently, so each one runs on a single thread unless requested otherwise.
+        if (std::find(requestArguments.begin(), requestArguments.end(), "-t") == requestArguments.end()) {
+            maybeArguments.value().threads = 1ul;
+        }
+
+        // Reuse the image buffer of the previous request.
+        std::ostringstream image(std::move(rImageBuffer));
+        image.str("");
+        status = render(maybeArguments.value(), stream, image, errors);
+        rImageBuffer = std::move(image).str();
+    } catch (std::invalid_argument& rException) {
+        errors << rException.what();
+        status = 1;
+    } catch (std::exception& rException) {
+        errors << rException.what();
+        status = 1;
+    }
+
+    // Reading inline input until the end sets the error state of the shared stream.
+    stream.clear();
+    if (status == 0) {
+        stream << "OK " << rImageBuffer.size() << '\n';
+        stream.write(rImageBuffer.data(), static_cast<std::streamsize>(rImageBuffer.size()));
+    } else {
+        stream << "ERROR " << status << '\n' << errors.str();
+    }
+    stream.flush();
+}
+
+
+/// @brief Longest time a connection of the render daemon may go silent while its request is read.
+constexpr std::chrono::seconds requestTimeout(60);
+
+
+/// @brief Serve render requests on a Unix domain socket until interrupted.
+/// @details Each worker thread accepts connections on its own and serves
+///          their requests one after the other, so up to @p threadCount
+///          requests are processed concurrently.
+int serve(const std::filesystem::path& rSocketPath, std::size_t threadCount)
+{
+    sockaddr_un address {};
+    address.sun_family = AF_UNIX;
+    const std::string socketPath = rSocketPath.string();
+    if (sizeof(address.sun_path) <= socketPath.size()) {
+        std::cerr << "Error: socket path is too long: " << socketPath << '\n';
+        return 1;
+    }
+    std::copy(socketPath.begin(), socketPath.end(), address.sun_path);
+
+    // Replace sockets left behind by previous instances, unless one still accepts connections.
+    if (std::filesystem::is_socket(rSocketPath)) {
+        const int probe = ::socket(AF_UNIX, SOCK_STREAM, 0);
+        const bool isServed = 0 <= probe
+                              && ::connect(probe, reinterpret_cast<const sockaddr*>(&address), sizeof(address)) == 0;
+        if (0 <= probe) ::close(probe);
+        if (isServed) {
+            std::cerr << "Error: another daemon is already serving on " << socketPath << '\n';
+            return 1;
+        }
+        std::filesystem::remove(rSocketPath);
+    }
+
+    const int listener = ::socket(AF_UNIX, SOCK_STREAM, 0);
+    if (listener < 0
+        || ::bind(listener, reinterpret_cast<const sockaddr*>(&address), sizeof(address)) != 0
+        || ::listen(listener, SOMAXCONN) != 0) {
+        std::cerr << "Error: failed to listen on " << socketPath << ": " << std::strerror(errno) << '\n';
+        if (0 <= listener) ::close(listener);
+        return 1;
+    }
+
+    // Clients closing their connection early must not terminate the daemon.
+    std::signal(SIGPIPE, SIG_IGN);
+
+    // Handle termination signals on this thread only.
+    sigset_t signals;
+    sigemptyset(&signals);
+    sigaddset(&signals, SIGINT);
+    sigaddset(&signals, SIGTERM);
+    pthread_sigmask(SIG_BLOCK, &signals, nullptr);
+
+    {
+        std::vector<std::jthread> workers;
+        for (std::size_t iWorker=0ul; iWorker<std::max(threadCount, 1ul); ++iWorker) {
+            workers.emplace_back([listener](){
+                std::string imageBuffer;
+                while (true) {
+                    const int connection = ::accept(listener, nullptr, nullptr);
+                    if (connection < 0) {
+                        if (errno == EINTR || errno == ECONNABORTED) continue;
+                        break; // <== the listener was shut down
+                    }
+
+                    // Clients that stop sending must not hold on to a worker forever.
+                    timeval timeout {};
+                    timeout.tv_sec = static_cast<decltype(timeout.tv_sec)>(requestTimeout.count());
+                    ::setsockopt(connection, SOL_SOCKET, SO_RCVTIMEO, &timeout, sizeof(timeout));
+                    serveRequest(connection, imageBuffer);
+                    ::close(connection);
+                }
+            });
+        }
+
+        int signal = 0;
+        sigwait(&signals, &signal);
+
+        // Wake up the workers blocked in accept.
+        ::shutdown(listener, SHUT_RDWR);
+    } // <== join workers
+
+    ::close(listener);
+    std::filesystem::remove(rSocketPath);
+    return 0;
+}
+#endif
+
+
+int main(int argc, char const* const* argv)
+{
+    // Special case: render daemon
+    if (2 < argc && std::string(argv[1]) == "--serve") {
+        #ifdef MTX2IMG_HAS_SOCKETS
+            const char* usage = "Error: usage: mtx2img --serve <socket-path> [-t <threads>]\n";
+            if (argc != 3 && !(argc == 5 && std::string(argv[3]) == "-t")) {
+                std::cerr << usage;
+                return 1;
+            }
+
+            std::size_t threadCount = 1ul;
+            try {
+                threadCount = parseThreadCount(argc == 5 ? argv[4] : "0");
+            } catch (std::invalid_argument& rException) {
+                std::cerr << rException.what() << usage;
+                return 1;
+            }
+            return serve(argv[2], threadCount);
+        #else
+            std::cerr << "Error: --serve is not supported on this platform\n";
+            return 1;
+        #endif
+    }
+
+    // Special case: build a row index
+    if (2 < argc && std::string(argv[1]) == "index") {
+        if (4 < argc) {
+            std::cerr << "Error: usage: mtx2img index <path-to-source> [<index-path>]\n";
+            return 1;
+        }
+        return index(argv[2],
+                     argc == 4 ? std::filesystem::path(argv[3]) : mtx2img::getRowIndexPath(argv[2]),
+                     std::cerr);
+    }
+
+    // Special case: render the difference of two inputs
+    if (2 < argc && std::string(argv[1]) == "diff") {
+        if (argc < 5) {
+            std::cerr << "Error: usage: mtx2img diff <path-to-first> <path-to-second> <path-to-output> [OPTION ARGUMENT] ...\n";
+            return 1;
+        }
+
+        // Options are parsed as if the first input was rendered on its own.
+        std::vector<char const*> renderArguments {argv[0], argv[2]};
+        renderArguments.insert(renderArguments.end(), argv + 4, argv + argc);
+        Arguments arguments;
+        try {
+            auto parsed = parseArguments(static_cast<int>(renderArguments.size()), renderArguments.data());
+            if (!parsed.has_value()) {
+                printHelp();
+                return 0;
+            }
+            arguments = std::move(parsed.value());
+            if (arguments.inputPath == "-" || !arguments.partPaths.empty() || !arguments.framePaths.empty()) {
+                throw std::invalid_argument("Error: differences are rendered between two single files\n");
+            } else if (arguments.stream
+                       || !arguments.statisticsPath.empty()
+                       || !arguments.permutation.rowPath.empty()
+                       || !arguments.permutation.columnPath.empty()) {
+                throw std::invalid_argument("Error: --stream, --stats, --row-perm and --col-perm are not supported for differences\n");
+            }
+
+            // Options that only affect regular renders are rejected even if they
+            // repeat their defaults, since they'd be ignored anyway.
+            const std::set<std::string> renderOptions {"-c", "--scale", "--clip", "--emit-partial", "--cache",
+                                                       "--cache-size", "--block", "--io"};
+            for (int iArg=5; iArg<argc; ++iArg) {
+                if (renderOptions.contains(argv[iArg])) {
+                    throw std::invalid_argument(std::format(
+                        "Error: {} is not supported for differences\n",
+                        argv[iArg]
+                    ));
+                }
+            }
+            validateInputFile(argv[3]);
+        } catch (std::invalid_argument& rException) {
+            std::cerr << rException.what();
+            printHelp();
+            return 1;
+        }
+        return diff(arguments, argv[3], std::cout, std::cerr);
+    }
+
+    // Special case: combine partial renders
+    if (2 < argc && std::string(argv[1]) == "merge") {
+        // Partials and the output come before the first option.
+        int iOptions = 2;
+        while (iOptions < argc && (argv[iOptions][0] != '-' || std::string(argv[iOptions]) == "-")) ++iOptions;
+        if (iOptions < 4) {
+            std::cerr << "Error: usage: mtx2img merge <partial>... <path-to-output> [OPTION ARGUMENT] ...\n";
+            return 1;
+        }
+
+        // Options are parsed as if the first partial was rendered on its own.
+        std::vector<char const*> renderArguments {argv[0], argv[2], argv[iOptions - 1]};
+        renderArguments.insert(renderArguments.end(), argv + iOptions, argv + argc);
+        Arguments arguments;
+        std::vector<std::filesystem::path> partialPaths;
+        try {
+            auto parsed = parseArguments(static_cast<int>(renderArguments.size()), renderArguments.data());
+            if (!parsed.has_value()) {
+                printHelp();
+                return 0;
+            }
+            arguments = std::move(parsed.value());
+            if (arguments.inputPath == "-" || !arguments.framePaths.empty() || arguments.stream) {
+                throw std::invalid_argument("Error: partial renders are merged from files\n");
+            } else if (arguments.shape.columns.has_value()
+                       || !arguments.statisticsPath.empty()
+                       || !arguments.partialPath.empty()
+                       || !arguments.permutation.rowPath.empty()
+                       || !arguments.permutation.columnPath.empty()) {
+                throw std::invalid_argument("Error: -s, --stats, --emit-partial, --row-perm and --col-perm are not supported for merging\n");
+            }
+
+            // Each partial may be a pattern or a list, like the parts of an input.
+            for (int iArg=2; iArg<iOptions - 1; ++iArg) {
+                std::vector<std::filesystem::path> matches = expandInputParts(argv[iArg]);
+                if (matches.empty()) {
+                    validateInputFile(argv[iArg]);
+                    matches.push_back(argv[iArg]);
+                }
+                partialPaths.insert(partialPaths.end(), matches.begin(), matches.end());
+            }
+        } catch (std::invalid_argument& rException) {
+            std::cerr << rException.what();
+            printHelp();
+            return 1;
+        }
+        return merge(arguments, partialPaths, std::cout, std::cerr);
+    }
+
+    // Parse arguments
+    Arguments arguments;
+    try {
+        auto parsed = parseArguments(argc, argv);
+        if (parsed.has_value()) {
+            arguments = std::move(parsed.value());
+        } else {
+            printHelp();
+            return 0;
+        }
+    } catch (std::invalid_argument& rException) {
+        std::cerr << rException.what();
+        printHelp();
+        return 1;
+    }
+
+    return render(arguments, std::cin, std::cout, std::cerr);
 }
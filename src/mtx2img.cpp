@@ -17,6 +17,51 @@
 #include <regex> // regex, regex_match
 #include <variant> // monostate
 #include <complex> // complex
+#include <cstdint> // uint8_t, uint16_t, uint32_t, uintptr_t
+#include <algorithm> // minmax_element, min, max, find
+#include <charconv> // from_chars
+#include <cstring> // memmove
+#include <string_view> // string_view
+#include <iterator> // make_reverse_iterator
+#include <cmath> // hypot
+#include <memory> // unique_ptr
+#include <thread> // jthread
+#include <exception> // exception_ptr, current_exception, rethrow_exception
+#include <atomic> // atomic, atomic_ref
+#include <map> // map
+#include <filesystem> // filesystem::path
+#include <cstddef> // byte
+#include <bit> // bit_cast, bit_width, countl_zero
+#include <mutex> // mutex, scoped_lock, unique_lock
+#include <condition_variable> // condition_variable
+#include <functional> // function
+#include <cstdlib> // calloc, free
+#include <new> // bad_alloc
+#include <cctype> // isspace
+#include <numeric> // gcd
+
+#if defined(__unix__) || defined(__APPLE__)
+    #define MTX2IMG_HAS_MMAP
+    #include <sys/mman.h> // mmap, munmap, madvise
+    #include <sys/stat.h> // fstat
+    #include <fcntl.h> // open
+    #include <unistd.h> // close
+#endif
+
+#ifdef __linux__
+    #define MTX2IMG_HAS_AFFINITY
+    #include <sched.h> // sched_getaffinity, sched_setaffinity, cpu_set_t
+#endif
+
+// Hot kernels are compiled for several x86-64 levels and picked when the program
+// loads (through an ifunc), so that a portable build still runs AVX2/AVX-512 code
+// on machines that support them. Other compilers and platforms get a single version,
+// and so do ThreadSanitizer builds, whose runtime isn't up yet when ifuncs are resolved.
+#if defined(__GNUC__) && !defined(__clang__) && defined(__x86_64__) && defined(__linux__) && !defined(__SANITIZE_THREAD__)
+    #define MTX2IMG_MULTIVERSION __attribute__((target_clones("default", "arch=x86-64-v3", "arch=x86-64-v4")))
+#else
+    #define MTX2IMG_MULTIVERSION
+#endif
 
 #ifndef NDEBUG
     #include <iostream> // cout, cerr
@@ -59,6 +104,10 @@ struct Properties
 constexpr std::size_t CHANNELS = 3ul;
 
 
+/// @brief Pixel buffers larger than this (in bytes) are filled via @ref BinnedScatter.
+constexpr std::size_t binnedScatterThreshold = 0x1000000ul;
+
+
 std::vector<std::array<unsigned char, CHANNELS>> makeColormap(const std::string& rColormapName) {
     if (rColormapName == "binary") {
         return {
@@ -234,31 +283,189 @@ std::vector<std::array<unsigned char, CHANNELS>> makeColormap(const std::string&
 }
 
 
+/// @brief Get a colormap by name, constructing the tables only once per process.
+const std::vector<std::array<unsigned char, CHANNELS>>& getColormap(const std::string& rColormapName)
+{
+    static const std::map<std::string,std::vector<std::array<unsigned char, CHANNELS>>> colormaps = [](){
+        std::map<std::string,std::vector<std::array<unsigned char, CHANNELS>>> output;
+        for (const char* pName : {"binary", "kindlmann", "viridis", "glasbey256", "glasbey64", "glasbey8"}) {
+            output.emplace(pName, makeColormap(pName));
+        }
+        return output;
+    }();
+
+    const auto itColormap = colormaps.find(rColormapName);
+    if (itColormap == colormaps.end()) {
+        throw std::invalid_argument(std::format(
+            "Error: invalid colormap: {}\n",
+            rColormapName
+        ));
+    }
+    return itColormap->second;
+}
+
+
+/// @brief Diverging colormap of @ref convertDifference, from removed entries (blue) over unchanged ones (gray) to added ones (red).
+/// @details Has an odd number of colors, so the middle one is the neutral gray.
+const std::vector<std::array<unsigned char, CHANNELS>>& getDivergingColormap()
+{
+    static const std::vector<std::array<unsigned char, CHANNELS>> colormap = [](){
+        // Smooth cool-warm colormap sampled at 9 points, interpolated to 255 colors
+        // Source: https://www.kennethmoreland.com/color-advice/#smooth-cool-warm
+        constexpr std::array<std::array<double, CHANNELS>,9> controlPoints {{
+            { 59, 76,192},{ 98,130,234},{141,176,254},{184,208,249},{221,221,221},
+            {245,196,173},{244,154,123},{222, 96, 77},{180,  4, 38}
+        }};
+        constexpr std::size_t colorCount = 0xfful;
+        std::vector<std::array<unsigned char, CHANNELS>> output(colorCount);
+        for (std::size_t iColor=0ul; iColor<colorCount; ++iColor) {
+            const double position = static_cast<double>(iColor * (controlPoints.size() - 1)) / (colorCount - 1);
+            const std::size_t iLow = std::min(static_cast<std::size_t>(position), controlPoints.size() - 2);
+            const double weight = position - iLow;
+            for (std::size_t iComponent=0ul; iComponent<CHANNELS; ++iComponent) {
+                output[iColor][iComponent] = static_cast<unsigned char>(std::lround(
+                    (1 - weight) * controlPoints[iLow][iComponent] + weight * controlPoints[iLow + 1][iComponent]
+                ));
+            }
+        }
+        return output;
+    }();
+    return colormap;
+}
+
+
+/// @brief Structure-of-arrays storage for a fixed number of parsed entries.
+/// @details Row and column indices are 0-based. Values are only stored if
+///          they were requested (@p TValue is not @p std::monostate).
+template <class TValue>
+struct EntryBatch
+{
+    static constexpr std::size_t capacity = 0x400ul;
+
+    std::size_t size = 0ul;
+
+    std::array<std::size_t,capacity> rows;
+
+    std::array<std::size_t,capacity> columns;
+
+    [[no_unique_address]] std::conditional_t<
+        std::is_same_v<TValue,std::monostate>,
+        std::monostate,
+        std::array<TValue,capacity>
+    > values;
+}; // struct EntryBatch
+
+
+/// @brief Skip spaces, tabs and carriage returns.
+inline const char* skipBlanks(const char* it) noexcept
+{
+    while (*it == ' ' || *it == '\t' || *it == '\r') ++it;
+    return it;
+}
+
+
+/// @brief Parse a 1-based index and convert it to 0-based.
+/// @return Pointer past the parsed index, or nullptr on failure.
+inline const char* parseIndex(const char* itBegin,
+                              const char* itEnd,
+                              std::size_t& rIndex) noexcept
+{
+    const auto [itParsed, error] = std::from_chars(skipBlanks(itBegin), itEnd, rIndex);
+    if (error != std::errc() || rIndex == 0ul) [[unlikely]] {
+        return nullptr;
+    }
+    --rIndex;
+    return itParsed;
+}
+
+
+/// @brief Parse a real number.
+/// @return Pointer past the parsed number, or nullptr on failure.
+inline const char* parseReal(const char* itBegin,
+                             const char* itEnd,
+                             double& rValue) noexcept
+{
+    itBegin = skipBlanks(itBegin);
+    if (*itBegin == '+') ++itBegin; // <== from_chars doesn't accept explicit positive signs
+    const auto [itParsed, error] = std::from_chars(itBegin, itEnd, rValue);
+    return error == std::errc() ? itParsed : nullptr;
+}
+
+
+/// @brief Parse the value(s) of an entry and convert them to a magnitude.
+/// @details Pattern entries have a magnitude of 1, complex entries are
+///          converted to their absolute value.
+/// @return Pointer past the parsed value(s), or nullptr on failure.
+inline const char* parseMagnitude(const char* itBegin,
+                                  const char* itEnd,
+                                  format::Data data,
+                                  double& rValue) noexcept
+{
+    switch (data) {
+        case format::Data::Pattern:
+            rValue = 1.0;
+            return itBegin;
+        case format::Data::Complex: {
+            double imaginary = 0.0;
+            itBegin = parseReal(itBegin, itEnd, rValue);
+            if (itBegin) itBegin = parseReal(itBegin, itEnd, imaginary);
+            rValue = std::hypot(rValue, imaginary);
+            return itBegin;
+        }
+        default:
+            return parseReal(itBegin, itEnd, rValue);
+    }
+}
+
+
 class Parser
 {
 public:
     Parser(std::istream& rStream)
+        : Parser(rStream, format::Properties(), std::numeric_limits<std::size_t>::max(), 0ul)
+    {
+        this->parseHeader();
+    }
+
+    /// @brief Parse a range of lines in the data section of an input with known properties.
+    /// @details The stream must be positioned at the beginning of the first line in the range.
+    /// @param rProperties Properties of the input, except that the number of nonzeros is
+    ///                    the index of the first entry past the range.
+    /// @param byteCount Number of bytes in the range.
+    /// @param firstEntry Index of the first entry in the range.
+    Parser(std::istream& rStream,
+           const format::Properties& rProperties,
+           std::size_t byteCount,
+           std::size_t firstEntry)
         : _pStream(&rStream),
+          _entryCount(firstEntry),
+          _remainingBytes(byteCount),
           _inputBuffer(0x400, '\0'),
-          _properties()
+          _dataBuffer(0x100000, '\0'),
+          _itData(_dataBuffer.data()),
+          _itDataEnd(_dataBuffer.data()),
+          _itBufferEnd(_dataBuffer.data()),
+          _properties(rProperties)
     {
         // Make sure that the input buffer ends with a \0 that doesn't appear in its size.
         [[maybe_unused]] const char* dummy = _inputBuffer.c_str();
-        this->parseHeader();
     }
 
+    // The parser holds pointers to its own buffer.
+    Parser(const Parser&) = delete;
+
+    Parser& operator=(const Parser&) = delete;
+
+    /// @brief Parse the next batch of entries from the input.
+    /// @details Reads entries until the batch is full or the input is exhausted.
+    ///          Only available for the coordinate format; dense inputs have implicit
+    ///          positions and are read in raw blocks instead (see @ref readLines).
+    /// @return Number of entries in the batch (0 if the input is exhausted).
     template <class TValue>
-    std::optional<std::conditional_t<
-        std::is_same_v<TValue,std::monostate>,
-        std::tuple<std::size_t,std::size_t>,        // <== no values requested, only row and column indices
-        std::tuple<std::size_t,std::size_t,TValue>  // <== values requested
-    >>
-    parseLine()
+    std::size_t parseBatch(EntryBatch<TValue>& rBatch)
     {
         if (_properties.format.value() == format::Format::Coordinate) {
-            return this->parseSparseDataLine<TValue>();
-        } else if (_properties.format.value() == format::Format::Array) {
-            return this->parseDenseDataLine<TValue>();
+            return this->parseSparseBatch(rBatch);
         } else {
             throw InvalidFormat(std::format(
                 "Error: unhandled format {}",
@@ -267,16 +474,52 @@ public:
         }
     }
 
+    /// @brief Consume a block of complete lines from the input.
+    /// @details The returned block is at least @p blockSize bytes long, unless the
+    ///          input is exhausted, and remains valid until the next call to the parser.
+    /// @return An empty block if the input is exhausted.
+    std::span<const char> readLines(std::size_t blockSize)
+    {
+        if (_itData == _itDataEnd) {
+            if (_dataBuffer.size() <= blockSize) {
+                // Keep the incomplete trailing line while growing the buffer.
+                const std::size_t tailSize = static_cast<std::size_t>(_itBufferEnd - _itDataEnd);
+                std::memmove(_dataBuffer.data(), _itDataEnd, tailSize);
+                _dataBuffer.resize(blockSize + 1);
+                _itData = _itDataEnd = _dataBuffer.data();
+                _itBufferEnd = _itDataEnd + tailSize;
+            }
+
+            if (!this->refill()) {
+                return {};
+            }
+        }
+
+        const std::span<const char> block(_itData, _itDataEnd);
+        _itData = _itDataEnd;
+        return block;
+    }
+
     format::Properties getProperties() const
     {
         return _properties;
     }
 
+    /// @brief Check entries against the dimensions of a larger matrix.
+    /// @details Used for parts of a partitioned matrix that store global indices,
+    ///          but declare the dimensions of their own block in their header.
+    void setDimensions(std::size_t rows, std::size_t columns) noexcept
+    {
+        _properties.rows = rows;
+        _properties.columns = columns;
+    }
+
 private:
     void parseHeader()
     {
-        std::regex formatPattern(R"(^%%MatrixMarket (\w+) (\w+) (.*)?)");
-        std::regex qualifierPattern(R"(\w+)");
+        // Compiling the patterns is expensive compared to parsing small inputs.
+        static const std::regex formatPattern(R"(^%%MatrixMarket (\w+) (\w+) (.*)?)");
+        static const std::regex qualifierPattern(R"([\w-]+)");
         std::size_t iLine = 0ul;
         std::istream& rStream = *_pStream;
 
@@ -433,7 +676,20 @@ private:
                 break;
             } // case format::Format::Coordinate
             case format::Format::Array: {
-                _properties.nonzeros = _properties.rows.value() * _properties.columns.value();
+                // Symmetric arrays only store their lower triangle.
+                const std::size_t rowCount = _properties.rows.value();
+                const std::size_t columnCount = _properties.columns.value();
+                switch (_properties.structure.value_or(format::Structure::General)) {
+                    case format::Structure::Symmetric:
+                    case format::Structure::Hermitian:
+                        _properties.nonzeros = rowCount * (rowCount + 1) / 2;
+                        break;
+                    case format::Structure::SkewSymmetric:
+                        _properties.nonzeros = rowCount ? rowCount * (rowCount - 1) / 2 : 0ul;
+                        break;
+                    default:
+                        _properties.nonzeros = rowCount * columnCount;
+                }
                 break;
             } // case format::Format::Array
             default:
@@ -466,125 +722,148 @@ private:
         #endif
     }
 
-    template <class TValue>
-    std::optional<std::conditional_t<
-        std::is_same_v<TValue,std::monostate>,
-        std::tuple<std::size_t,std::size_t>,        // <== no values requested, only row and column indices
-        std::tuple<std::size_t,std::size_t,TValue>  // <== values requested
-    >>
-    parseSparseDataLine()
-    {
-        constexpr std::streamsize ignoreSize = std::numeric_limits<std::streamsize>::max();
-        using Entry = std::conditional_t<
-            std::is_same_v<TValue,std::monostate>,
-            std::tuple<std::size_t,std::size_t>,
-            std::tuple<std::size_t,std::size_t,TValue>
-        >;
-        Entry output;
+    /// @brief Make sure that the data buffer holds at least one complete line.
+    /// @details Only complete lines are exposed in [_itData, _itDataEnd) so that
+    ///          the tokenizer never has to check for the end of the buffer mid-line.
+    ///          A missing newline at the end of the input is patched.
+    /// @return False if the input is exhausted.
+    bool refill()
+    {
         std::istream& rStream = *_pStream;
 
-        // Read row index
-        rStream >> std::get<0>(output);
-        if (rStream.eof() || rStream.bad()) {
-            rStream.clear();
-            rStream.ignore(ignoreSize, '\n');
-            return {};
-        }
-
-        // Read column index
-        rStream >> std::get<1>(output);
-        if (rStream.eof() || rStream.bad()) {
-            rStream.clear();
-            rStream.ignore(ignoreSize, '\n');
-            return {};
-        }
+        // Move the incomplete trailing line to the front of the buffer.
+        const std::size_t tailSize = static_cast<std::size_t>(_itBufferEnd - _itDataEnd);
+        std::memmove(_dataBuffer.data(), _itDataEnd, tailSize);
+        std::size_t size = tailSize;
 
-        // Read value if requested
-        if constexpr (!std::is_same_v<TValue,std::monostate>) {
-            rStream >> std::get<2>(output);
-            if (rStream.eof() || rStream.bad()) {
-                rStream.clear();
-                rStream.ignore(ignoreSize, '\n');
-                return {};
+        while (true) {
+            // Fill the rest of the buffer, but keep an extra byte for patching a missing newline.
+            if (!rStream.eof() && !rStream.bad() && _remainingBytes) {
+                rStream.read(_dataBuffer.data() + size,
+                             static_cast<std::streamsize>(std::min(_dataBuffer.size() - size - 1, _remainingBytes)));
+                size += static_cast<std::size_t>(rStream.gcount());
+                _remainingBytes -= static_cast<std::size_t>(rStream.gcount());
             }
-        }
-
-        rStream.ignore(ignoreSize, '\n');
 
-        #ifndef NDEBUG
-            // Check indices in debug mode
-            // => matrix market indices begin with 1,
-            //    so it's usually safe to subtract 1 from them.
-            if (std::get<0>(output) == 0ul) {
-                std::cerr << "mtx2img: WARNING: unexpected 0-based row index!\n";
-            }
-            if (std::get<1>(output) == 0ul) {
-                std::cerr << "mtx2img: WARNING: unexpected 0-based column index!\n";
+            const char* itBegin = _dataBuffer.data();
+            const auto itLastNewline = std::find(std::make_reverse_iterator(itBegin + size),
+                                                 std::make_reverse_iterator(itBegin),
+                                                 '\n');
+            if (itLastNewline.base() != itBegin) {
+                // Found at least one complete line.
+                _itData = itBegin;
+                _itDataEnd = itLastNewline.base();
+                _itBufferEnd = itBegin + size;
+                return true;
+            } else if (rStream.eof() || rStream.bad() || !_remainingBytes) {
+                // The input is exhausted; terminate the last line if there's one.
+                if (size == 0ul) {
+                    _itData = _itDataEnd = _itBufferEnd = itBegin;
+                    return false;
+                }
+                _dataBuffer[size++] = '\n';
+                _itData = itBegin;
+                _itDataEnd = _itBufferEnd = itBegin + size;
+                return true;
+            } else {
+                // The line is longer than the buffer => grow it.
+                _dataBuffer.resize(2 * _dataBuffer.size());
             }
-        #endif
+        } // while (true)
+    }
 
-        // Convert (row,column) indices to 0-based indices
-        --std::get<0>(output);
-        --std::get<1>(output);
+    [[noreturn]] void throwInvalidEntry(const char* itLine) const
+    {
+        throw ParsingException(std::format(
+            "Error: failed to parse entry {}:\n{}\n",
+            _entryCount + 1,
+            std::string_view(itLine, std::find(itLine, _itDataEnd, '\n'))
+        ));
+    }
 
-        return output;
+    [[noreturn]] void throwExcessEntry() const
+    {
+        throw ParsingException(std::format(
+            "Error: input contains more entries than the {} declared in its header\n",
+            _properties.nonzeros.value()
+        ));
     }
 
     template <class TValue>
-    std::optional<std::conditional_t<
-        std::is_same_v<TValue,std::monostate>,
-        std::tuple<std::size_t,std::size_t>,        // <== no values requested, only row and column indices
-        std::tuple<std::size_t,std::size_t,TValue>  // <== values requested
-    >>
-    parseDenseDataLine()
-    {
-        constexpr std::streamsize ignoreSize = std::numeric_limits<std::streamsize>::max();
-        using Entry = std::conditional_t<
-            std::is_same_v<TValue,std::monostate>,
-            std::tuple<std::size_t,std::size_t>,
-            std::tuple<std::size_t,std::size_t,TValue>
-        >;
-        Entry output;
-        std::istream& rStream = *_pStream;
+    std::size_t parseSparseBatch(EntryBatch<TValue>& rBatch)
+    {
+        const std::size_t rows = _properties.rows.value();
+        const std::size_t columns = _properties.columns.value();
+        const std::size_t nonzeros = _properties.nonzeros.value();
+        [[maybe_unused]] const format::Data data = _properties.data.value();
+        rBatch.size = 0ul;
 
-        // Advance row or column index
-        if (_lastPosition.has_value()) {
-            if (_properties.columns.value() <= ++_lastPosition->second) {
-                _lastPosition = std::make_pair(++_lastPosition->first, 0ul);
+        while (rBatch.size < rBatch.capacity) {
+            if (_itData == _itDataEnd && !this->refill()) {
+                break;
+            }
+
+            const char* itLine = skipBlanks(_itData);
+            if (*itLine == '\n') {
+                // Skip empty lines
+                _itData = itLine + 1;
+                continue;
             }
-        } else {
-            _lastPosition = std::make_pair(0ul, 0ul);
-        }
 
-        std::get<0>(output) = _lastPosition->first;
-        std::get<1>(output) = _lastPosition->second;
+            // Read row and column indices
+            std::size_t& rRow = rBatch.rows[rBatch.size];
+            std::size_t& rColumn = rBatch.columns[rBatch.size];
+            const char* it = parseIndex(itLine, _itDataEnd, rRow);
+            if (it) it = parseIndex(it, _itDataEnd, rColumn);
+            if (!it || rows <= rRow || columns <= rColumn) [[unlikely]] {
+                this->throwInvalidEntry(itLine);
+            }
 
-        // Read value if requested
-        if constexpr (!std::is_same_v<TValue,std::monostate>) {
-            rStream >> std::get<2>(output);
-            if (rStream.eof() || rStream.bad()) {
-                rStream.clear();
-                rStream.ignore(ignoreSize, '\n');
-                return {};
+            // Read value if requested
+            if constexpr (!std::is_same_v<TValue,std::monostate>) {
+                double value;
+                it = parseMagnitude(it, _itDataEnd, data, value);
+                if (!it) [[unlikely]] {
+                    this->throwInvalidEntry(itLine);
+                }
+                rBatch.values[rBatch.size] = static_cast<TValue>(value);
             }
-        }
 
-        return output;
+            if (nonzeros <= _entryCount++) [[unlikely]] {
+                this->throwExcessEntry();
+            }
+
+            // Ignore the rest of the line
+            _itData = std::find(it, _itDataEnd, '\n') + 1;
+            ++rBatch.size;
+        } // while (rBatch.size < rBatch.capacity)
+
+        return rBatch.size;
     }
 
 private:
     std::istream* _pStream;
 
-    /// The dense format does not store the row and column indices
-    /// in the data lines, so they must be stored separately in the
-    /// parser.
-    std::optional<std::pair<
-        std::size_t,
-        std::size_t
-    >> _lastPosition;
+    /// Number of entries parsed so far.
+    std::size_t _entryCount;
+
+    /// Number of bytes left to read from the stream.
+    std::size_t _remainingBytes;
 
     std::string _inputBuffer;
 
+    /// Block buffer for the data section of the input.
+    std::vector<char> _dataBuffer;
+
+    /// Begin of the unparsed data in @ref _dataBuffer.
+    const char* _itData;
+
+    /// End of the last complete line in @ref _dataBuffer.
+    const char* _itDataEnd;
+
+    /// End of the data read into @ref _dataBuffer.
+    const char* _itBufferEnd;
+
     format::Properties _properties;
 }; // class Parser
 
@@ -617,32 +896,43 @@ void fillSymmetricPart(std::span<TValue> nnzMap,
 }
 
 
+/// @brief Eight pixels of a bit-packed image that only tracks which pixels hold entries.
+/// @details Used as the pixel type of the binary colormap. Pixels are packed into bytes
+///          the most significant bit first, rows are padded to whole bytes, and set bits
+///          mark pixels holding entries (see @ref isBitPacked).
+enum class Occupancy : std::uint8_t {};
+
+
+/// @brief Number of elements of a pixel buffer holding @p width consecutive pixels of a row.
+template <class TPixel>
+constexpr std::size_t getRowElements(std::size_t width) noexcept
+{
+    if constexpr (std::is_same_v<TPixel,Occupancy>) {
+        return (width + 7) / 8;
+    } else {
+        return width;
+    }
+}
+
+
 template <Aggregation TAggregation, class TValue, class TPixel>
 void registerEntry([[maybe_unused]] const TValue value,
                    TPixel& rPixel)
 {
-    if constexpr (std::is_same_v<TValue,std::monostate> || std::is_integral_v<TValue>) {
-        // No value is available => assume we're just counting the number of entries
+    if constexpr (TAggregation == Aggregation::Count) {
+        // Values are ignored => count the number of entries.
+        // Narrow counters saturate instead of wrapping around
+        // (only possible if the input has duplicate entries).
         static_assert(std::is_integral_v<TPixel>);
-        ++rPixel;
-    } else if constexpr (std::is_floating_point_v<TValue>) {
-        // Values are real => register their magnitude
-        static_assert(std::is_same_v<TValue,TPixel>);
-        if constexpr (TAggregation == Aggregation::Sum) {
-            rPixel += std::abs(value);
-        } else if constexpr (TAggregation == Aggregation::Max) {
-            rPixel = std::max(rPixel, std::abs(value));
-        } else {
-            // Error on unhandled aggregation
-            static_assert(TAggregation == Aggregation::Sum);
-        }
-    } else if constexpr (is_complex_v<TValue>) {
-        // Values are complex => register their magnitude
-        static_assert(std::is_same_v<typename TValue::value_type,TPixel>);
+        rPixel += static_cast<TPixel>(rPixel != std::numeric_limits<TPixel>::max());
+    } else if constexpr (std::is_arithmetic_v<TValue> || is_complex_v<TValue>) {
+        // Values are real or complex => register their magnitude
+        static_assert(std::is_floating_point_v<TPixel>);
+        const TPixel magnitude = static_cast<TPixel>(std::abs(value));
         if constexpr (TAggregation == Aggregation::Sum) {
-            rPixel += std::abs(value);
+            rPixel += magnitude;
         } else if constexpr (TAggregation == Aggregation::Max) {
-            rPixel = std::max(rPixel, std::abs(value));
+            rPixel = std::max(rPixel, magnitude);
         } else {
             // Error on unhandled aggregation
             static_assert(TAggregation == Aggregation::Sum);
@@ -653,197 +943,3655 @@ void registerEntry([[maybe_unused]] const TValue value,
 }
 
 
-template <Aggregation TAggregation>
-void fill(Parser& rParser,
-          std::span<unsigned char> image,
-          std::pair<std::size_t,std::size_t> imageSize,
-          const std::string& rColormapName,
-          std::optional<format::Structure> maybeStructure)
+/// @brief Thread safe version of @ref registerEntry for pixel buffers shared between threads.
+template <Aggregation TAggregation, class TValue, class TPixel>
+void registerSharedEntry([[maybe_unused]] const TValue value,
+                         TPixel& rPixel)
 {
-    format::Properties properties = rParser.getProperties();
+    std::atomic_ref<TPixel> pixel(rPixel);
+    if constexpr (TAggregation == Aggregation::Count) {
+        TPixel count = pixel.load(std::memory_order_relaxed);
+        while (count != std::numeric_limits<TPixel>::max()
+               && !pixel.compare_exchange_weak(count, count + 1, std::memory_order_relaxed)) {}
+    } else if constexpr (TAggregation == Aggregation::Sum) {
+        pixel.fetch_add(static_cast<TPixel>(std::abs(value)), std::memory_order_relaxed);
+    } else if constexpr (TAggregation == Aggregation::Max) {
+        const TPixel magnitude = static_cast<TPixel>(std::abs(value));
+        TPixel current = pixel.load(std::memory_order_relaxed);
+        while (current < magnitude
+               && !pixel.compare_exchange_weak(current, magnitude, std::memory_order_relaxed)) {}
+    } else {
+        // Error on unhandled aggregation
+        static_assert(TAggregation == Aggregation::Sum);
+    }
+}
 
-    // Nothing to do if the input size is null.
-    if (properties.rows.value() == 0ul || properties.columns.value() == 0ul) {
-        #ifndef NDEBUG
-            std::cout << "mtx2img: nothing to do (degenerate input matrix).\n";
-        #endif
-        if (properties.nonzeros.value() == 0ul) {
-            return;
+
+/// @brief Register an entry in a row of a pixel buffer.
+/// @details Entries mark their pixel in bit-packed images, unless their value
+///          is zero (which doesn't color the pixel with the other pixel types either).
+/// @tparam TShared Register the entry atomically, for pixel buffers filled by several threads.
+template <Aggregation TAggregation, bool TShared, class TValue, class TPixel>
+void registerPixel([[maybe_unused]] const TValue value,
+                   TPixel* pRow,
+                   std::size_t column)
+{
+    if constexpr (std::is_same_v<TPixel,Occupancy>) {
+        if constexpr (TAggregation != Aggregation::Count) {
+            if (value == TValue(0)) return;
+        }
+        std::uint8_t& rBits = reinterpret_cast<std::uint8_t&>(pRow[column / 8]);
+        const std::uint8_t mask = static_cast<std::uint8_t>(0x80u >> (column % 8));
+        if constexpr (TShared) {
+            std::atomic_ref<std::uint8_t>(rBits).fetch_or(mask, std::memory_order_relaxed);
         } else {
-            throw ParsingException(std::format(
-                "Error: degenerate input matrix ({}x{}) claims to contain {} nonzeros",
-                properties.rows.value(),
-                properties.columns.value(),
-                properties.nonzeros.value()
-            ));
+            rBits |= mask;
         }
+    } else if constexpr (TShared) {
+        registerSharedEntry<TAggregation>(value, pRow[column]);
+    } else {
+        registerEntry<TAggregation>(value, pRow[column]);
     }
+}
 
-    // Nothing to do if the output size is null
+
+/// @brief Type of the values parsed from the input for an aggregation method.
+/// @details Counting ignores values, so they don't even have to be parsed.
+template <Aggregation TAggregation>
+using ParsedValue = std::conditional_t<
+    TAggregation == Aggregation::Count,
+    std::monostate,
+    double
+>;
+
+
+/// @brief Upper bound on the number of matrix entries that can map to a single pixel.
+/// @details Each pixel covers at most ceil(rows / height) x ceil(columns / width)
+///          positions of the matrix, and no pixel can reference more entries than
+///          there are in the whole input.
+std::size_t getMaxEntriesPerPixel(const format::Properties& rProperties,
+                                  std::pair<std::size_t,std::size_t> imageSize)
+{
     if (imageSize.first == 0ul || imageSize.second == 0ul) {
-        #ifndef NDEBUG
-            std::cout << "mtx2img: nothing to do (degenerate output image).\n";
-        #endif
-        return;
+        return 0ul;
     }
 
-    // Choose colormap
-    const auto colormap = makeColormap(rColormapName);
+    const std::size_t rowsPerPixel = (rProperties.rows.value() + imageSize.second - 1) / imageSize.second;
+    const std::size_t columnsPerPixel = (rProperties.columns.value() + imageSize.first - 1) / imageSize.first;
+    const std::size_t cellsPerPixel = (columnsPerPixel && std::numeric_limits<std::size_t>::max() / columnsPerPixel < rowsPerPixel)
+                                    ? std::numeric_limits<std::size_t>::max()
+                                    : rowsPerPixel * columnsPerPixel;
+    return std::min(cellsPerPixel, rProperties.nonzeros.value());
+}
 
-    // Check image buffer size
-    const std::size_t pixelCount = imageSize.first * imageSize.second;
-    assert(image.size() == pixelCount * CHANNELS);
 
-    // A buffer for mapping regions in the matrix to each pixel.
-    std::vector<std::conditional_t<
-        TAggregation == Aggregation::Count,
-        unsigned,
-        std::conditional_t<
-            TAggregation == Aggregation::Sum || TAggregation == Aggregation::Max,
-            double,
-            std::monostate // <== dummy invalid type
-        >
-    >> values(pixelCount, 0);
+/// @brief Registers entries directly in the pixel buffer.
+/// @tparam TShared Register entries atomically, for pixel buffers filled by several threads.
+template <Aggregation TAggregation, class TPixel, bool TShared = false>
+class DirectScatter
+{
+public:
+    DirectScatter(std::span<TPixel> values,
+                  std::pair<std::size_t,std::size_t> imageSize) noexcept
+        : _values(values),
+          _rowElements(getRowElements<TPixel>(imageSize.first))
+    {}
 
-    // Track how many entries were read from the input stream.
-    // This will be compared against the expected number of nonzeros.
-    std::size_t entryCount = 0ul;
+    void insert(std::size_t imageRow,
+                std::size_t imageColumn,
+                ParsedValue<TAggregation> value) noexcept
+    {
+        assert(imageRow * _rowElements + getRowElements<TPixel>(imageColumn + 1) <= _values.size());
+        registerPixel<TAggregation,TShared>(value, _values.data() + imageRow * _rowElements, imageColumn);
+    }
 
-    // Parse the input file and map entries to pixels in the image.
-    while (true) {
-        const auto maybeEntry = rParser.parseLine<typename decltype(values)::value_type>();
-        if (maybeEntry.has_value()) [[likely]] {
-            ++entryCount;
-            const std::size_t row = std::get<0>(*maybeEntry);
-            const std::size_t column = std::get<1>(*maybeEntry);
-            const auto value = std::get<2>(*maybeEntry);
+    void flush() noexcept {}
 
-            #ifndef NDEBUG
-                if (properties.rows.value() <= row) {
-                    std::cerr << std::format("mtx2img: row index {} is out of bound {} at entry {}\n",
-                                             row, properties.rows.value(), entryCount);
-                }
-                if (properties.columns.value() <= column) {
-                    std::cerr << std::format("mtx2img: column index {} is out of bound {} at entry {}\n",
-                                             column, properties.columns.value(), entryCount);
-                }
-            #endif
+private:
+    std::span<TPixel> _values;
 
-            const std::size_t imageRow = row * imageSize.second / properties.rows.value();
-            const std::size_t imageColumn = column * imageSize.first / properties.columns.value();
-            const std::size_t iFlat = imageRow * imageSize.first + imageColumn;
-            assert(iFlat < values.size());
-            registerEntry<TAggregation>(value, values[iFlat]);
-        } else {
-            break;
-        }
-    } // while (true)
+    std::size_t _rowElements;
+}; // class DirectScatter
 
-    const auto itMinMax = std::minmax_element(values.begin(), values.end());
-    const auto minValue = itMinMax.first != values.end() ? *itMinMax.first : 0;
-    const auto maxValue = itMinMax.second != values.end() ? *itMinMax.second : 0;
 
-    // Check the read number of entries
-    if (entryCount != properties.nonzeros.value()) {
-        throw ParsingException(std::format(
-            "Expecting {} entries, but read {}\n",
-            properties.nonzeros.value(),
-            entryCount
-        ));
-    }
+/// @brief Buckets entries by image tiles before registering them in the pixel buffer.
+/// @details Matrix market files are usually sorted by columns or not sorted at all,
+///          so registering entries directly in a pixel buffer that doesn't fit in the
+///          cache results in a cache (and often TLB) miss for every entry. This class
+///          partitions the image into tiles that fit in L2, and collects entries in a
+///          fixed size bin for each tile. Full bins are flushed into their tiles at once,
+///          while the tile is cache resident.
+/// @tparam TShared Register entries atomically, for pixel buffers filled by several threads.
+template <Aggregation TAggregation, class TPixel, bool TShared = false>
+class BinnedScatter
+{
+public:
+    /// @brief Number of bytes a single tile of the pixel buffer should occupy at most.
+    static constexpr std::size_t tileBytes = 0x20000ul;
 
-    #ifndef NDEBUG
-        std::cout << std::format("mtx2img: highest aggregate value per pixel is {}\n", maxValue);
-    #endif
+    /// @brief Number of entries buffered in the bin of each tile before flushing it.
+    static constexpr std::size_t binCapacity = 0x100ul;
 
-    // No need to pass through the image again if no
-    // entries were read.
-    if (minValue == maxValue) {
-        return;
+    BinnedScatter(std::span<TPixel> values,
+                  std::pair<std::size_t,std::size_t> imageSize)
+        : _values(values),
+          _rowElements(getRowElements<TPixel>(imageSize.first)),
+          _tileWidthLog2(0),
+          _tileHeightLog2(0),
+          _tilesPerRow(0),
+          _bins(),
+          _binSizes()
+    {
+        // Tiles are at most 256 pixels wide, and as high as the tile size allows.
+        // Note: tiles of bit-packed images start on byte boundaries, since they're
+        //       either a multiple of 8 pixels wide, or span the whole image.
+        constexpr std::size_t tilePixels = std::is_same_v<TPixel,Occupancy> ? 8 * tileBytes : tileBytes / sizeof(TPixel);
+        while (_tileWidthLog2 < 8 && (1ul << _tileWidthLog2) < imageSize.first) ++_tileWidthLog2;
+        while ((1ul << (_tileWidthLog2 + _tileHeightLog2 + 1)) <= tilePixels
+               && (1ul << _tileHeightLog2) < imageSize.second) ++_tileHeightLog2;
+
+        _tilesPerRow = ((imageSize.first - 1) >> _tileWidthLog2) + 1;
+        const std::size_t tileCount = _tilesPerRow * (((imageSize.second - 1) >> _tileHeightLog2) + 1);
+        _bins.resize(tileCount * binCapacity);
+        _binSizes.resize(tileCount, 0u);
     }
 
-    // If the input was provided in symmetric format, the entries
-    // read so far were limited to the main diagonal and the lower
-    // triangle, so the upper triangle must be filled in separately.
-    // Note: currently, all options are handled in the same manner,
-    //       but once value-based intensity is enabled, skewness and
-    //       negative values will have to be considered.
-    if (maybeStructure.has_value()) {
-        std::span<typename decltype(values)::value_type> valueRange(values);
-        switch (maybeStructure.value()) {
-            case format::Structure::General: break; // <== nothing to do
-            case format::Structure::Symmetric:
-                fillSymmetricPart(valueRange,
-                                  imageSize,
-                                  [](auto v){return v;});
-                break;
-            case format::Structure::SkewSymmetric:
-                fillSymmetricPart(valueRange,
-                                  imageSize,
-                                  [](auto v){return -v;});
-                break;
-            case format::Structure::Hermitian:
-                fillSymmetricPart(valueRange,
-                                  imageSize,
-                                  [](auto v){return v;});
-                break;
-            default: throw std::runtime_error("Error: missing fill strategy implementation for input matrix structure.");
+    void insert(std::size_t imageRow,
+                std::size_t imageColumn,
+                ParsedValue<TAggregation> value)
+    {
+        const std::size_t tileMask = (1ul << _tileWidthLog2) - 1;
+        const std::size_t iTile = (imageRow >> _tileHeightLog2) * _tilesPerRow + (imageColumn >> _tileWidthLog2);
+        const std::uint32_t localRow = static_cast<std::uint32_t>(imageRow & ((1ul << _tileHeightLog2) - 1));
+        const std::uint32_t localColumn = static_cast<std::uint32_t>(imageColumn & tileMask);
+        assert(iTile < _binSizes.size());
+
+        Item& rItem = _bins[iTile * binCapacity + _binSizes[iTile]];
+        rItem.offset = (localRow << _tileWidthLog2) | localColumn;
+        rItem.value = value;
+
+        if (++_binSizes[iTile] == binCapacity) [[unlikely]] {
+            this->flushBin(iTile);
         }
     }
 
-    // Apply the colormap and fill the image buffer
-    const std::size_t maxColor = colormap.empty() ? 0 : colormap.size() - 1;
-    for (std::size_t iPixel=0ul; iPixel<pixelCount; ++iPixel) {
-        const std::size_t intensity = std::min<std::size_t>(
-            maxColor,
-            maxColor - (maxColor * (std::max(values[iPixel] - minValue, typename decltype(values)::value_type(0))) / (maxValue - minValue))
-        );
-
-        const auto& rColor = colormap[intensity];
-        const std::size_t iImageBegin = CHANNELS * iPixel;
-        for (std::size_t iComponent=0; iComponent<CHANNELS; ++iComponent) {
-            image[iImageBegin + iComponent] = rColor[iComponent];
+    void flush()
+    {
+        for (std::size_t iTile=0ul; iTile<_binSizes.size(); ++iTile) {
+            this->flushBin(iTile);
         }
     }
-}
 
+private:
+    struct Item
+    {
+        std::uint32_t offset; // <== (row << tileWidthLog2) | column within the tile
+        [[no_unique_address]] ParsedValue<TAggregation> value;
+    }; // struct Item
 
-std::vector<unsigned char> convert(std::istream& rStream,
-                                   std::size_t& rImageWidth,
-                                   std::size_t& rImageHeight,
-                                   const Aggregation aggregation,
-                                   const std::string& rColormapName)
-{
-    std::vector<unsigned char> image;
-    Parser parser(rStream);
-    const format::Properties inputProperties = parser.getProperties();
+    void flushBin(std::size_t iTile)
+    {
+        const std::size_t tileRow = iTile / _tilesPerRow;
+        const std::size_t tileColumn = iTile % _tilesPerRow;
+        TPixel* pTile = _values.data()
+                      + (tileRow << _tileHeightLog2) * _rowElements
+                      + getRowElements<TPixel>(tileColumn << _tileWidthLog2);
+        const std::uint32_t columnMask = (1u << _tileWidthLog2) - 1u;
 
-    // Validate object type
-    if (inputProperties.object.has_value()) {
-        switch (inputProperties.object.value()) {
-            case format::Object::Matrix: break; // <== ok
-            case format::Object::Vector: throw UnsupportedFormat("Error: vector input is not supported yet\n"); // <== @todo
-            default: throw UnsupportedFormat("Error: unsupported input object type\n");
+        const Item* pItem = _bins.data() + iTile * binCapacity;
+        const Item* pItemEnd = pItem + _binSizes[iTile];
+        for (; pItem!=pItemEnd; ++pItem) {
+            TPixel* pRow = pTile + (pItem->offset >> _tileWidthLog2) * _rowElements;
+            assert(static_cast<std::size_t>(pRow - _values.data()) < _values.size());
+            registerPixel<TAggregation,TShared>(pItem->value, pRow, pItem->offset & columnMask);
         }
-    } else {
-        throw ParsingException("Error: missing input object type specifier\n");
-    }
 
-    // Validate format type
-    if (inputProperties.format.has_value()) {
-        switch (inputProperties.format.value()) {
-            case format::Format::Coordinate: break; // <== ok
-            case format::Format::Array: break; // <== ok
-            default: throw UnsupportedFormat("Error: unsupported input format type\n");
-        }
-    } else {
-        throw ParsingException("Error: missing input format type specifier\n");
+        _binSizes[iTile] = 0u;
     }
 
-    // Validate data type (optional qualifier - no error if missing)
-    if (inputProperties.data.has_value()) {
-        switch (inputProperties.data.value()) {
-            case format::Data::Real: break;     // <== ok
+    std::span<TPixel> _values;
+
+    std::size_t _rowElements;
+
+    unsigned _tileWidthLog2;
+
+    unsigned _tileHeightLog2;
+
+    std::size_t _tilesPerRow;
+
+    std::vector<Item> _bins;
+
+    std::vector<std::uint32_t> _binSizes;
+}; // class BinnedScatter
+
+
+/// @brief Thrown by @ref BandScatter if an entry maps to a band that was finished already.
+struct UnsortedRows {};
+
+
+/// @brief Aggregates a single band of consecutive image rows at a time, for inputs sorted by rows.
+/// @details Entries of a row sorted input only ever move down the image, so the pixel buffer
+///          only has to hold the band the current entries map to. Once an entry maps below the
+///          band, its rows (and the empty bands skipped on the way) are final and handed to
+///          @p rFinish as @p rFinish(band,rowCount). Rows may be out of order within a band.
+/// @throws UnsortedRows if an entry maps above the current band.
+template <Aggregation TAggregation, class TPixel, class TFinish>
+class BandScatter
+{
+public:
+    BandScatter(std::pair<std::size_t,std::size_t> imageSize,
+                std::size_t bandHeight,
+                TFinish& rFinish)
+        : _values(getRowElements<TPixel>(imageSize.first) * bandHeight, TPixel(0)),
+          _rowElements(getRowElements<TPixel>(imageSize.first)),
+          _imageHeight(imageSize.second),
+          _bandHeight(bandHeight),
+          _bandBegin(0ul),
+          _pFinish(&rFinish)
+    {}
+
+    void insert(std::size_t imageRow,
+                std::size_t imageColumn,
+                ParsedValue<TAggregation> value)
+    {
+        // Rows above the band wrap around to large offsets.
+        if (_bandHeight <= imageRow - _bandBegin) [[unlikely]] {
+            if (imageRow < _bandBegin) {
+                throw UnsortedRows();
+            }
+            while (_bandBegin + _bandHeight <= imageRow) {
+                this->finishBand();
+            }
+        }
+        registerPixel<TAggregation,false>(value, _values.data() + (imageRow - _bandBegin) * _rowElements, imageColumn);
+    }
+
+    /// @brief Finish the rest of the image.
+    void flush()
+    {
+        while (_bandBegin < _imageHeight) {
+            this->finishBand();
+        }
+    }
+
+private:
+    void finishBand()
+    {
+        const std::size_t rowCount = std::min(_bandHeight, _imageHeight - _bandBegin);
+        (*_pFinish)(std::span<const TPixel>(_values.data(), rowCount * _rowElements), rowCount);
+        std::fill(_values.begin(), _values.end(), TPixel(0));
+        _bandBegin += _bandHeight;
+    }
+
+    std::vector<TPixel> _values;
+
+    std::size_t _rowElements;
+
+    std::size_t _imageHeight;
+
+    std::size_t _bandHeight;
+
+    /// First image row of the band in @ref _values.
+    std::size_t _bandBegin;
+
+    TFinish* _pFinish;
+}; // class BandScatter
+
+
+/// @brief Maps matrix indices to pixel indices along one dimension.
+/// @details Computes floor(index * pixelCount / indexCount) without integer divisions,
+///          using a 32.32 fixed point reciprocal and a single correction step.
+///          Dimensions that don't fit in 32 bits fall back to divisions.
+class IndexMap
+{
+public:
+    IndexMap(std::size_t indexCount, std::size_t pixelCount) noexcept
+        : _indexCount(indexCount),
+          _pixelCount(pixelCount),
+          _reciprocal(0u),
+          _isFixedPoint(pixelCount < indexCount && indexCount <= std::numeric_limits<std::uint32_t>::max())
+    {
+        if (_isFixedPoint) {
+            // floor(pixelCount * 2^32 / indexCount) < 2^32 because pixelCount < indexCount
+            _reciprocal = static_cast<std::uint32_t>((static_cast<std::uint64_t>(pixelCount) << 32) / indexCount);
+        }
+    }
+
+    std::size_t operator()(std::size_t index) const noexcept
+    {
+        if (_isFixedPoint) {
+            return mapFixedPoint(index,
+                                 static_cast<std::uint32_t>(_indexCount),
+                                 static_cast<std::uint32_t>(_pixelCount),
+                                 _reciprocal);
+        } else {
+            return index * _pixelCount / _indexCount;
+        }
+    }
+
+    /// @brief Map a range of indices in place.
+    MTX2IMG_MULTIVERSION
+    void operator()(std::span<std::size_t> indices) const noexcept
+    {
+        if (_isFixedPoint) {
+            // Kept free of branches and member accesses so that it gets vectorized.
+            // Note: passing the operands as 32 bit integers lets the compiler use
+            //       32x32->64 bit vector multiplications.
+            const std::uint32_t indexCount = static_cast<std::uint32_t>(_indexCount);
+            const std::uint32_t pixelCount = static_cast<std::uint32_t>(_pixelCount);
+            const std::uint32_t reciprocal = _reciprocal;
+            for (std::size_t& rIndex : indices) {
+                rIndex = mapFixedPoint(rIndex, indexCount, pixelCount, reciprocal);
+            }
+        } else if (_pixelCount != _indexCount) {
+            for (std::size_t& rIndex : indices) rIndex = rIndex * _pixelCount / _indexCount;
+        }
+    }
+
+private:
+    static std::size_t mapFixedPoint(std::size_t index,
+                                     std::uint32_t indexCount,
+                                     std::uint32_t pixelCount,
+                                     std::uint32_t reciprocal) noexcept
+    {
+        // The estimate is either exact or one less than the exact result.
+        // Note: all operands fit in 32 bits, so every product fits in 64 bits.
+        const std::uint64_t narrowIndex = static_cast<std::uint32_t>(index);
+        const std::uint64_t estimate = (narrowIndex * reciprocal) >> 32;
+        const std::uint64_t next = static_cast<std::uint32_t>(estimate + 1);
+        return estimate + static_cast<std::uint64_t>(next * indexCount <= narrowIndex * pixelCount);
+    }
+
+    std::uint64_t _indexCount;
+
+    std::uint64_t _pixelCount;
+
+    std::uint32_t _reciprocal;
+
+    bool _isFixedPoint;
+}; // class IndexMap
+
+
+/// @brief Clamp a window to the dimensions of a matrix.
+Window resolveWindow(const format::Properties& rProperties,
+                     const Window& rWindow)
+{
+    Window window = rWindow;
+    window.rowEnd = std::min(window.rowEnd, rProperties.rows.value());
+    window.columnEnd = std::min(window.columnEnd, rProperties.columns.value());
+    if ((window.rowEnd <= window.rowBegin || window.columnEnd <= window.columnBegin)
+        && rProperties.rows.value() && rProperties.columns.value()) {
+        throw std::invalid_argument(std::format(
+            "Error: window {}:{},{}:{} is empty for a {}x{} matrix\n",
+            rWindow.rowBegin,
+            window.rowEnd,
+            rWindow.columnBegin,
+            window.columnEnd,
+            rProperties.rows.value(),
+            rProperties.columns.value()
+        ));
+    }
+    return window;
+}
+
+
+/// @brief Check whether a (resolved) window covers the entire matrix.
+bool isFullWindow(const format::Properties& rProperties,
+                  const Window& rWindow) noexcept
+{
+    return rWindow.rowBegin == 0ul && rWindow.rowEnd == rProperties.rows.value()
+           && rWindow.columnBegin == 0ul && rWindow.columnEnd == rProperties.columns.value();
+}
+
+
+/// @brief Check whether entries of a symmetric input must be mirrored while reading them.
+/// @details The missing triangle of symmetric inputs is usually mirrored in the image after
+///          reading all entries, which only works if the window is symmetric as well.
+bool mirrorsEntries(const format::Properties& rProperties,
+                    const Window& rWindow) noexcept
+{
+    return rProperties.structure.value_or(format::Structure::General) != format::Structure::General
+           && (rWindow.rowBegin != rWindow.columnBegin || rWindow.rowEnd != rWindow.columnEnd);
+}
+
+
+/// @brief Factor that turns the value of an entry into the value of its mirrored counterpart.
+/// @details Skew-symmetric inputs negate mirrored values. Complex values are reduced to their
+///          magnitude while parsing, so conjugating mirrored entries of Hermitian inputs is a no-op.
+double getMirrorSign(const format::Properties& rProperties) noexcept
+{
+    return rProperties.structure.value_or(format::Structure::General) == format::Structure::SkewSymmetric ? -1.0 : 1.0;
+}
+
+
+/// @brief Properties of the submatrix in a window.
+/// @details The number of nonzeros is kept, since all entries of the input are read.
+format::Properties getWindowProperties(const format::Properties& rProperties,
+                                       const Window& rWindow)
+{
+    format::Properties properties = rProperties;
+    properties.rows = rWindow.rowEnd - rWindow.rowBegin;
+    properties.columns = rWindow.columnEnd - rWindow.columnBegin;
+    if (mirrorsEntries(rProperties, rWindow)) {
+        properties.structure = format::Structure::General;
+    }
+    return properties;
+}
+
+
+/// @brief Copy the entries of a batch that lie in a window, relative to the window's origin.
+/// @details Every entry is written to the output, but the output cursor only advances past
+///          entries inside the window, so the loop has no branches. Both bounds of both
+///          indices are checked in one go by a wrapping unsigned comparison.
+/// @param transpose Swap rows and columns, and skip entries on the main diagonal
+///                  (used for mirroring symmetric inputs).
+/// @return Number of entries copied to the output.
+template <class TValue>
+MTX2IMG_MULTIVERSION
+std::size_t cropBatch(const EntryBatch<TValue>& rInput,
+                      std::size_t size,
+                      const Window& rWindow,
+                      bool transpose,
+                      EntryBatch<TValue>& rOutput) noexcept
+{
+    const std::size_t height = rWindow.rowEnd - rWindow.rowBegin;
+    const std::size_t width = rWindow.columnEnd - rWindow.columnBegin;
+    const std::size_t* pRows = transpose ? rInput.columns.data() : rInput.rows.data();
+    const std::size_t* pColumns = transpose ? rInput.rows.data() : rInput.columns.data();
+
+    std::size_t outputSize = 0ul;
+    for (std::size_t iEntry=0ul; iEntry<size; ++iEntry) {
+        const std::size_t row = pRows[iEntry] - rWindow.rowBegin;
+        const std::size_t column = pColumns[iEntry] - rWindow.columnBegin;
+        rOutput.rows[outputSize] = row;
+        rOutput.columns[outputSize] = column;
+        if constexpr (!std::is_same_v<TValue,std::monostate>) {
+            rOutput.values[outputSize] = rInput.values[iEntry];
+        }
+        outputSize += static_cast<std::size_t>((row < height) & (column < width) & (!transpose | (pRows[iEntry] != pColumns[iEntry])));
+    }
+
+    return outputSize;
+}
+
+
+/// @brief Positions of the rows and columns of the input in a permuted matrix.
+/// @details Both maps are empty if the input keeps its order (see @ref loadReordering).
+struct Reordering
+{
+    std::vector<std::size_t> rows;
+    std::vector<std::size_t> columns;
+
+    bool empty() const noexcept
+    {
+        return rows.empty() && columns.empty();
+    }
+}; // struct Reordering
+
+
+/// @brief Move the entries of a batch to their positions in the permuted matrix.
+/// @param transpose Swap rows and columns before permuting them, and skip entries
+///                  on the main diagonal (used for mirroring symmetric inputs).
+/// @return Number of entries written to the output.
+template <class TValue>
+std::size_t permuteBatch(const EntryBatch<TValue>& rInput,
+                         std::size_t size,
+                         const Reordering& rReordering,
+                         bool transpose,
+                         EntryBatch<TValue>& rOutput) noexcept
+{
+    const std::size_t* pRows = transpose ? rInput.columns.data() : rInput.rows.data();
+    const std::size_t* pColumns = transpose ? rInput.rows.data() : rInput.columns.data();
+
+    std::size_t outputSize = 0ul;
+    for (std::size_t iEntry=0ul; iEntry<size; ++iEntry) {
+        rOutput.rows[outputSize] = rReordering.rows[pRows[iEntry]];
+        rOutput.columns[outputSize] = rReordering.columns[pColumns[iEntry]];
+        if constexpr (!std::is_same_v<TValue,std::monostate>) {
+            rOutput.values[outputSize] = rInput.values[iEntry];
+        }
+        outputSize += static_cast<std::size_t>(!transpose | (pRows[iEntry] != pColumns[iEntry]));
+    }
+
+    return outputSize;
+}
+
+
+/// @brief Properties of the input as seen through a reordering.
+/// @details Permuting a symmetric input moves entries across the diagonal, so they
+///          are mirrored while reading them (see @ref scatterEntries) and the image
+///          is filled like the one of a general matrix.
+format::Properties getPermutedProperties(const format::Properties& rProperties,
+                                         const Reordering& rReordering)
+{
+    format::Properties properties = rProperties;
+    if (!rReordering.empty()) {
+        properties.structure = format::Structure::General;
+    }
+    return properties;
+}
+
+
+/// @brief Gathers the structure of the entries in a window while they're scattered.
+/// @details Counts and bandwidths are kept per row and column of the window, and
+///          updated with atomics if several threads insert entries. Everything else
+///          is accumulated in thread local counters (see @ref Local) and merged once.
+///          Symmetry is estimated with a count sketch: each off-diagonal entry adds
+///          its orientation (+1 below, -1 above the diagonal), times a random sign,
+///          to a bucket picked by hashing its unordered position. Transposed pairs
+///          cancel out, and the sum of squared buckets is an unbiased estimate of
+///          the number of unpaired entries (and of the squared value residual).
+class StructureCollector
+{
+public:
+    /// @brief Per-thread counters.
+    class Local
+    {
+    public:
+        explicit Local(StructureCollector& rCollector)
+            : _rCollector(rCollector),
+              _diagonalCount(0ul),
+              _offDiagonalCount(0ul),
+              _squaredNorm(0.0),
+              _structureSketch(sketchSize, 0.0),
+              _valueSketch(rCollector._hasValues ? sketchSize : 0ul, 0.0)
+        {}
+
+        ~Local()
+        {
+            _rCollector.merge(*this);
+        }
+
+        /// @brief Register a batch of entries with indices relative to the window.
+        /// @param sign Factor applied to the values of the entries (see @ref getMirrorSign).
+        template <class TValue>
+        void insert(const EntryBatch<TValue>& rBatch, std::size_t size, double sign = 1.0) noexcept
+        {
+            for (std::size_t iEntry=0ul; iEntry<size; ++iEntry) {
+                double value = 1.0;
+                if constexpr (!std::is_same_v<TValue,std::monostate>) {
+                    value = sign * static_cast<double>(rBatch.values[iEntry]);
+                }
+                this->insert(rBatch.rows[iEntry], rBatch.columns[iEntry], value);
+            }
+        }
+
+        /// @brief Register an entry with indices relative to the window.
+        void insert(std::size_t row, std::size_t column, double value) noexcept
+        {
+            const StructureCollector& rCollector = _rCollector;
+            this->insertOriented(row, column, value);
+            if (rCollector._mirrors && row + rCollector._window.rowBegin != column + rCollector._window.columnBegin) {
+                this->insertOriented(column, row, rCollector._mirrorSign * value);
+            }
+        }
+
+    private:
+        void insertOriented(std::size_t row, std::size_t column, double value) noexcept
+        {
+            StructureCollector& rCollector = _rCollector;
+            const std::size_t globalRow = row + rCollector._window.rowBegin;
+            const std::size_t globalColumn = column + rCollector._window.columnBegin;
+            rCollector.increment(rCollector._rowCounts[row]);
+
+            if (globalRow == globalColumn) {
+                ++_diagonalCount;
+            } else {
+                ++_offDiagonalCount;
+                if (globalColumn < globalRow) {
+                    rCollector.maximize(rCollector._rowBandwidths[row], static_cast<std::uint32_t>(globalRow - globalColumn));
+                } else {
+                    rCollector.maximize(rCollector._columnBandwidths[column], static_cast<std::uint32_t>(globalColumn - globalRow));
+                }
+
+                // Both orientations of a position hash to the same bucket and sign.
+                const std::uint64_t hash = mix((std::min(globalRow, globalColumn) << 32) | std::max(globalRow, globalColumn));
+                const std::size_t iBucket = static_cast<std::size_t>(hash >> (64 - sketchBits));
+                const double orientation = ((hash & 1ul) == (globalColumn < globalRow)) ? 1.0 : -1.0;
+                _structureSketch[iBucket] += orientation;
+                if (!_valueSketch.empty()) _valueSketch[iBucket] += orientation * value;
+            }
+            _squaredNorm += value * value;
+        }
+
+        /// @brief 64-bit finalizer of splitmix64.
+        static std::uint64_t mix(std::uint64_t key) noexcept
+        {
+            key = (key ^ (key >> 30)) * 0xbf58476d1ce4e5b9ull;
+            key = (key ^ (key >> 27)) * 0x94d049bb133111ebull;
+            return key ^ (key >> 31);
+        }
+
+        friend class StructureCollector;
+
+        StructureCollector& _rCollector;
+
+        std::size_t _diagonalCount;
+
+        std::size_t _offDiagonalCount;
+
+        double _squaredNorm;
+
+        std::vector<double> _structureSketch;
+
+        std::vector<double> _valueSketch;
+    }; // class Local
+
+    /// @param rProperties Properties of the input (not of the window).
+    /// @param rWindow Window resolved against the input.
+    /// @param hasValues Whether inserted entries carry their magnitudes.
+    /// @param isShared Whether several threads insert entries concurrently.
+    StructureCollector(const format::Properties& rProperties,
+                       const Window& rWindow,
+                       bool hasValues,
+                       bool isShared)
+        : _window(rWindow),
+          _mirrors(rProperties.structure.value_or(format::Structure::General) != format::Structure::General
+                   && !mirrorsEntries(rProperties, rWindow)),
+          _mirrorSign(getMirrorSign(rProperties)),
+          _hasValues(hasValues),
+          _isShared(isShared),
+          _diagonalCount(0ul),
+          _offDiagonalCount(0ul),
+          _squaredNorm(0.0),
+          _structureSketch(sketchSize, 0.0),
+          _valueSketch(hasValues ? sketchSize : 0ul, 0.0)
+    {
+        if (std::numeric_limits<std::uint32_t>::max() < std::max(rProperties.rows.value(), rProperties.columns.value())) {
+            throw UnsupportedFormat("Error: statistics are not supported for matrices with more than 2^32 rows or columns\n");
+        }
+        _rowCounts.resize(rWindow.rowEnd - rWindow.rowBegin, 0u);
+        _rowBandwidths.resize(rWindow.rowEnd - rWindow.rowBegin, 0u);
+        _columnBandwidths.resize(rWindow.columnEnd - rWindow.columnBegin, 0u);
+    }
+
+    Statistics finish() const
+    {
+        Statistics statistics;
+        statistics.rows = _rowCounts.size();
+        statistics.columns = _columnBandwidths.size();
+        statistics.diagonalNonzeros = _diagonalCount;
+        statistics.diagonalLength = std::min(_window.rowEnd, _window.columnEnd)
+                                    - std::min(std::max(_window.rowBegin, _window.columnBegin),
+                                               std::min(_window.rowEnd, _window.columnEnd));
+
+        // Distribution of entries per row.
+        double squaredRowCounts = 0.0;
+        statistics.minRowNonzeros = _rowCounts.empty() ? 0ul : std::numeric_limits<std::size_t>::max();
+        for (const std::uint32_t rowCount : _rowCounts) {
+            statistics.nonzeros += rowCount;
+            statistics.emptyRows += static_cast<std::size_t>(!rowCount);
+            statistics.minRowNonzeros = std::min<std::size_t>(statistics.minRowNonzeros, rowCount);
+            statistics.maxRowNonzeros = std::max<std::size_t>(statistics.maxRowNonzeros, rowCount);
+            squaredRowCounts += static_cast<double>(rowCount) * rowCount;
+
+            const std::size_t iBin = static_cast<std::size_t>(std::bit_width(rowCount));
+            if (statistics.rowNonzeroHistogram.size() <= iBin) statistics.rowNonzeroHistogram.resize(iBin + 1, 0ul);
+            ++statistics.rowNonzeroHistogram[iBin];
+        }
+        if (statistics.rows) {
+            statistics.meanRowNonzeros = static_cast<double>(statistics.nonzeros) / statistics.rows;
+            statistics.stddevRowNonzeros = std::sqrt(std::max(
+                squaredRowCounts / statistics.rows - statistics.meanRowNonzeros * statistics.meanRowNonzeros,
+                0.0
+            ));
+        }
+
+        // Bandwidths and profiles.
+        for (const std::uint32_t bandwidth : _rowBandwidths) {
+            statistics.lowerBandwidth = std::max<std::size_t>(statistics.lowerBandwidth, bandwidth);
+            statistics.lowerProfile += bandwidth;
+        }
+        for (const std::uint32_t bandwidth : _columnBandwidths) {
+            statistics.upperBandwidth = std::max<std::size_t>(statistics.upperBandwidth, bandwidth);
+            statistics.upperProfile += bandwidth;
+        }
+
+        // Symmetry residuals.
+        double unpairedEstimate = 0.0, residualEstimate = 0.0;
+        for (const double bucket : _structureSketch) unpairedEstimate += bucket * bucket;
+        for (const double bucket : _valueSketch) residualEstimate += bucket * bucket;
+        if (_offDiagonalCount) {
+            statistics.structuralAsymmetry = std::min(unpairedEstimate / _offDiagonalCount, 1.0);
+        }
+        if (_hasValues) {
+            // Each residual a_ij - a_ji appears twice in ||A - A^T||.
+            statistics.valueAsymmetry = _squaredNorm ? std::sqrt(2 * residualEstimate / _squaredNorm) : 0.0;
+        }
+
+        return statistics;
+    }
+
+private:
+    static constexpr unsigned sketchBits = 16;
+
+    static constexpr std::size_t sketchSize = std::size_t(1) << sketchBits;
+
+    void increment(std::uint32_t& rCount) noexcept
+    {
+        if (_isShared) {
+            std::atomic_ref<std::uint32_t>(rCount).fetch_add(1u, std::memory_order_relaxed);
+        } else {
+            ++rCount;
+        }
+    }
+
+    void maximize(std::uint32_t& rBandwidth, std::uint32_t bandwidth) noexcept
+    {
+        if (_isShared) {
+            std::atomic_ref<std::uint32_t> atomic(rBandwidth);
+            std::uint32_t current = atomic.load(std::memory_order_relaxed);
+            while (current < bandwidth && !atomic.compare_exchange_weak(current, bandwidth, std::memory_order_relaxed)) {}
+        } else {
+            rBandwidth = std::max(rBandwidth, bandwidth);
+        }
+    }
+
+    void merge(const Local& rLocal)
+    {
+        std::scoped_lock<std::mutex> lock(_mutex);
+        _diagonalCount += rLocal._diagonalCount;
+        _offDiagonalCount += rLocal._offDiagonalCount;
+        _squaredNorm += rLocal._squaredNorm;
+        for (std::size_t iBucket=0ul; iBucket<_structureSketch.size(); ++iBucket) {
+            _structureSketch[iBucket] += rLocal._structureSketch[iBucket];
+        }
+        for (std::size_t iBucket=0ul; iBucket<_valueSketch.size(); ++iBucket) {
+            _valueSketch[iBucket] += rLocal._valueSketch[iBucket];
+        }
+    }
+
+    Window _window;
+
+    /// Whether entries of a symmetric input must be mirrored here (because the scatter doesn't).
+    bool _mirrors;
+
+    /// Factor applied to the values mirrored here (see @ref getMirrorSign).
+    double _mirrorSign;
+
+    bool _hasValues;
+
+    bool _isShared;
+
+    std::vector<std::uint32_t> _rowCounts;
+
+    /// Largest distance between the diagonal and an entry left of it, in each row.
+    std::vector<std::uint32_t> _rowBandwidths;
+
+    /// Largest distance between the diagonal and an entry above it, in each column.
+    std::vector<std::uint32_t> _columnBandwidths;
+
+    std::mutex _mutex;
+
+    std::size_t _diagonalCount;
+
+    std::size_t _offDiagonalCount;
+
+    double _squaredNorm;
+
+    std::vector<double> _structureSketch;
+
+    std::vector<double> _valueSketch;
+}; // class StructureCollector
+
+
+/// @brief Parse all entries from the input and map the ones in the window to pixels.
+/// @param pCollector Gathers the structure of the entries in the window if not null.
+/// @param pReordering Moves entries to their positions in a permuted matrix before
+///                    they're cropped to the window, if not null.
+/// @return Number of entries read from the input.
+template <Aggregation TAggregation, class TScatter>
+std::size_t scatterEntries(Parser& rParser,
+                           std::pair<std::size_t,std::size_t> imageSize,
+                           const Window& rWindow,
+                           TScatter&& rScatter,
+                           StructureCollector* pCollector = nullptr,
+                           const Reordering* pReordering = nullptr)
+{
+    const format::Properties properties = rParser.getProperties();
+    const bool isPermuted = pReordering && !pReordering->empty();
+    const bool isCropped = !isFullWindow(properties, rWindow);
+    const bool isMirrored = mirrorsEntries(properties, rWindow)
+                            || (isPermuted && properties.structure.value_or(format::Structure::General) != format::Structure::General);
+    const IndexMap rowMap(rWindow.rowEnd - rWindow.rowBegin, imageSize.second);
+    const IndexMap columnMap(rWindow.columnEnd - rWindow.columnBegin, imageSize.first);
+
+    // Track how many entries were read from the input stream.
+    // This will be compared against the expected number of nonzeros.
+    std::size_t entryCount = 0ul;
+
+    using Batch = EntryBatch<ParsedValue<TAggregation>>;
+    const auto scatter = [&rowMap, &columnMap, &rScatter](Batch& rBatch, std::size_t batchSize) {
+        // Convert matrix indices to pixel indices in place.
+        rowMap(std::span<std::size_t>(rBatch.rows.data(), batchSize));
+        columnMap(std::span<std::size_t>(rBatch.columns.data(), batchSize));
+
+        for (std::size_t iEntry=0ul; iEntry<batchSize; ++iEntry) {
+            if constexpr (std::is_same_v<ParsedValue<TAggregation>,std::monostate>) {
+                rScatter.insert(rBatch.rows[iEntry], rBatch.columns[iEntry], std::monostate());
+            } else {
+                rScatter.insert(rBatch.rows[iEntry], rBatch.columns[iEntry], rBatch.values[iEntry]);
+            }
+        }
+    };
+
+    // Parse the input file in batches and map entries to pixels in the image.
+    // Note: statistics are gathered before the scatter maps indices to pixels.
+    std::optional<StructureCollector::Local> maybeStatistics;
+    if (pCollector) maybeStatistics.emplace(*pCollector);
+    const double mirrorSign = getMirrorSign(properties);
+    const auto collect = [&maybeStatistics](const Batch& rBatch, std::size_t batchSize, double sign) {
+        if (maybeStatistics.has_value()) maybeStatistics->insert(rBatch, batchSize, sign);
+    };
+
+    // Note: a full window on a symmetric input is symmetric, so
+    //       unpermuted entries are only mirrored into a cropped batch.
+    assert(isCropped || isPermuted || !isMirrored);
+    auto pBatch = std::make_unique<Batch>();
+    auto pPermuted = isPermuted ? std::make_unique<Batch>() : nullptr;
+    auto pCropped = isCropped ? std::make_unique<Batch>() : nullptr;
+    while (const std::size_t batchSize = rParser.parseBatch(*pBatch)) {
+        entryCount += batchSize;
+        // Mirrored entries are transposed in input indices, before they're permuted.
+        for (bool transpose : {false, true}) {
+            if (transpose && !isMirrored) break;
+            Batch* pEntries = pBatch.get();
+            std::size_t entriesSize = batchSize;
+            if (isPermuted) {
+                entriesSize = permuteBatch(*pEntries, entriesSize, *pReordering, transpose, *pPermuted);
+                pEntries = pPermuted.get();
+            }
+            if (isCropped) {
+                entriesSize = cropBatch(*pEntries, entriesSize, rWindow, transpose && !isPermuted, *pCropped);
+                pEntries = pCropped.get();
+            }
+            collect(*pEntries, entriesSize, transpose ? mirrorSign : 1.0);
+            scatter(*pEntries, entriesSize);
+        }
+    } // while (batchSize)
+
+    rScatter.flush();
+    return entryCount;
+}
+
+
+/// @brief Run a task on each of @p threadCount threads and wait for all of them.
+/// @details The task is invoked with the index of the thread it runs on. The calling
+///          thread runs the first task. Exceptions thrown by the tasks are rethrown
+///          on the calling thread after all tasks finished.
+template <class TTask>
+void parallelFor(std::size_t threadCount, TTask&& rTask)
+{
+    threadCount = std::max(threadCount, 1ul);
+    std::vector<std::exception_ptr> exceptions(threadCount);
+
+    {
+        std::vector<std::jthread> threads;
+        threads.reserve(threadCount - 1);
+        for (std::size_t iThread=1ul; iThread<threadCount; ++iThread) {
+            threads.emplace_back([&rTask, &exceptions, iThread](){
+                try {
+                    rTask(iThread);
+                } catch (...) {
+                    exceptions[iThread] = std::current_exception();
+                }
+            });
+        }
+
+        try {
+            rTask(0ul);
+        } catch (...) {
+            exceptions.front() = std::current_exception();
+        }
+    } // <== join threads
+
+    for (const auto& rException : exceptions) {
+        if (rException) std::rethrow_exception(rException);
+    }
+}
+
+
+/// @brief Buffers of @ref allocateBuffer are mapped from the kernel from this size on.
+/// @details Matches the size of huge pages on x86-64 and most aarch64 kernels.
+constexpr std::size_t largeBufferBytes = 0x200000ul;
+
+
+void* allocateBuffer(std::size_t byteCount)
+{
+    #ifdef MTX2IMG_HAS_MMAP
+        if (largeBufferBytes <= byteCount) {
+            const std::size_t mappedBytes = (byteCount + largeBufferBytes - 1) / largeBufferBytes * largeBufferBytes;
+
+            // Transparent huge pages can only back aligned ranges, so map a huge page more
+            // than necessary and cut the misaligned ends off.
+            void* pMapped = ::mmap(nullptr, mappedBytes + largeBufferBytes, PROT_READ | PROT_WRITE, MAP_PRIVATE | MAP_ANONYMOUS, -1, 0);
+            if (pMapped == MAP_FAILED) throw std::bad_alloc();
+            const std::uintptr_t address = reinterpret_cast<std::uintptr_t>(pMapped);
+            const std::size_t headBytes = (largeBufferBytes - address % largeBufferBytes) % largeBufferBytes;
+            unsigned char* pBuffer = static_cast<unsigned char*>(pMapped) + headBytes;
+            if (headBytes) ::munmap(pMapped, headBytes);
+            ::munmap(pBuffer + mappedBytes, largeBufferBytes - headBytes);
+
+            #ifdef MADV_HUGEPAGE
+                ::madvise(pBuffer, mappedBytes, MADV_HUGEPAGE);
+            #endif
+            return pBuffer;
+        }
+    #endif
+
+    // Note: calloc gets fresh pages from the kernel for large blocks too, but not
+    //       if a freed block can be reused, which then gets zeroed on this thread.
+    void* pBuffer = std::calloc(std::max(byteCount, 1ul), 1ul);
+    if (!pBuffer) throw std::bad_alloc();
+    return pBuffer;
+}
+
+
+void deallocateBuffer(void* pBuffer, std::size_t byteCount) noexcept
+{
+    #ifdef MTX2IMG_HAS_MMAP
+        if (largeBufferBytes <= byteCount) {
+            ::munmap(pBuffer, (byteCount + largeBufferBytes - 1) / largeBufferBytes * largeBufferBytes);
+            return;
+        }
+    #endif
+    std::free(pBuffer);
+}
+
+
+/// @brief Zero-filled buffer of pixel values (see @ref BufferAllocator).
+template <class T>
+using Buffer = std::vector<T,BufferAllocator<T>>;
+
+
+/// @brief Fill a buffer on up to @p threadCount threads, each writing a contiguous range.
+/// @details Pages are placed on the memory node of the thread that first writes them, so the
+///          first pass over a fresh buffer is split between the threads that work on it later.
+///          The ranges match the ones of other passes splitting a buffer evenly between threads.
+template <class T>
+void parallelFill(std::span<T> buffer, T value, std::size_t threadCount)
+{
+    // Small buffers aren't worth waking threads up for.
+    threadCount = std::clamp<std::size_t>(buffer.size_bytes() / largeBufferBytes, 1ul, std::max(threadCount, 1ul));
+    parallelFor(threadCount, [&](std::size_t iThread){
+        const std::size_t iBegin = iThread * buffer.size() / threadCount;
+        const std::size_t iEnd = (iThread + 1) * buffer.size() / threadCount;
+        std::fill(buffer.begin() + iBegin, buffer.begin() + iEnd, value);
+    });
+}
+
+
+/// @brief Resize a buffer to @p size zeros.
+/// @details Buffers that have to grow are reallocated, and keep the untouched zero pages of the fresh
+///          allocation. Buffers that are large enough already are zeroed in parallel instead.
+template <class T>
+void assignZeros(Buffer<T>& rBuffer, std::size_t size, std::size_t threadCount)
+{
+    if (rBuffer.capacity() < size) {
+        // Release the old buffer first, so both don't have to fit at once.
+        Buffer<T>().swap(rBuffer);
+        rBuffer.resize(size);
+    } else {
+        rBuffer.resize(size);
+        parallelFill(std::span<T>(rBuffer), T(0), threadCount);
+    }
+}
+
+
+/// @brief Combine a partial aggregate into a pixel.
+template <Aggregation TAggregation, class TPixel, class TPartial>
+void mergePixel(TPixel& rPixel, TPartial partial) noexcept
+{
+    if constexpr (std::is_same_v<TPixel,Occupancy>) {
+        // Bit-packed pixels are marked by any of the partials.
+        rPixel = static_cast<Occupancy>(static_cast<std::uint8_t>(rPixel) | static_cast<std::uint8_t>(partial));
+    } else if constexpr (TAggregation == Aggregation::Count) {
+        // Narrow counters saturate instead of wrapping around.
+        static_assert(std::is_integral_v<TPixel> && std::is_integral_v<TPartial>);
+        constexpr std::uint64_t maxCount = std::numeric_limits<TPixel>::max();
+        rPixel = static_cast<TPixel>(std::min<std::uint64_t>(
+            maxCount,
+            static_cast<std::uint64_t>(rPixel) + static_cast<std::uint64_t>(partial)
+        ));
+    } else if constexpr (TAggregation == Aggregation::Sum) {
+        rPixel += static_cast<TPixel>(partial);
+    } else if constexpr (TAggregation == Aggregation::Max) {
+        rPixel = std::max(rPixel, static_cast<TPixel>(partial));
+    } else {
+        // Error on unhandled aggregation
+        static_assert(TAggregation == Aggregation::Sum);
+    }
+}
+
+
+/// @brief Number of entries deterministic reductions aggregate in a private buffer before merging it.
+constexpr std::size_t deterministicChunkEntries = 0x400000ul;
+
+
+/// @brief Number of splits deterministic reductions divide blocks of dense inputs into.
+constexpr std::size_t deterministicSplitCount = 0x10ul;
+
+
+/// @brief Aggregate chunks of the input in private buffers, and merge them into the image in chunk order.
+/// @details Floating point sums depend on the order of their terms, so sums scattered into
+///          a shared buffer by several threads vary from run to run. Here, the input is split
+///          into chunks that don't depend on the number of threads. Each chunk is scattered
+///          serially into a private buffer of the thread that picked it up, and threads merge
+///          their buffers into the image strictly in chunk order, so the sums are bit-identical
+///          for any number of threads. Costs a private pixel buffer per thread.
+/// @param rScatterChunk Functor scattering the chunk with the given index into the given buffer.
+template <Aggregation TAggregation, class TPixel, class TScatterChunk>
+void reduceChunksInOrder(std::span<TPixel> values,
+                         std::size_t chunkCount,
+                         std::size_t threadCount,
+                         TScatterChunk&& rScatterChunk)
+{
+    if (!chunkCount) return;
+
+    std::atomic<std::size_t> nextChunk = 0ul;
+    std::size_t mergedChunks = 0ul;
+    bool isAborted = false;
+    std::mutex mutex;
+    std::condition_variable mergeCondition;
+
+    parallelFor(std::clamp<std::size_t>(threadCount, 1ul, chunkCount), [&](std::size_t){
+        // Note: the fresh buffer is zero already, and its pages are faulted in by this thread.
+        Buffer<TPixel> partials(values.size());
+        bool isDirty = false;
+        for (std::size_t iChunk=nextChunk++; iChunk<chunkCount; iChunk=nextChunk++) {
+            if (isDirty) std::fill(partials.begin(), partials.end(), TPixel(0));
+            isDirty = true;
+            try {
+                rScatterChunk(iChunk, std::span<TPixel>(partials));
+            } catch (...) {
+                // Release threads waiting for this chunk.
+                {
+                    std::scoped_lock lock(mutex);
+                    isAborted = true;
+                }
+                mergeCondition.notify_all();
+                throw;
+            }
+
+            std::unique_lock lock(mutex);
+            mergeCondition.wait(lock, [&](){return mergedChunks == iChunk || isAborted;});
+            if (isAborted) return;
+            for (std::size_t iPixel=0ul; iPixel<values.size(); ++iPixel) {
+                mergePixel<TAggregation>(values[iPixel], partials[iPixel]);
+            }
+            ++mergedChunks;
+            lock.unlock();
+            mergeCondition.notify_all();
+        }
+    });
+}
+
+
+/// @brief Parse a list of CPUs like "0-3,8,10-11" (as in the cpulist files of sysfs).
+/// @return Empty if the list is malformed.
+std::vector<std::size_t> parseCPUList(std::string_view list)
+{
+    std::vector<std::size_t> cpus;
+    while (!list.empty() && std::isspace(static_cast<unsigned char>(list.back()))) list.remove_suffix(1);
+    while (!list.empty()) {
+        const std::string_view range = list.substr(0, list.find(','));
+        list.remove_prefix(std::min(range.size() + 1, list.size()));
+
+        std::size_t first = 0ul, last = 0ul;
+        const char* pEnd = range.data() + range.size();
+        auto [pFirstEnd, firstError] = std::from_chars(range.data(), pEnd, first);
+        last = first;
+        if (firstError == std::errc() && pFirstEnd != pEnd && *pFirstEnd == '-') {
+            const auto [pLastEnd, lastError] = std::from_chars(pFirstEnd + 1, pEnd, last);
+            pFirstEnd = lastError == std::errc() ? pLastEnd : nullptr;
+        }
+        if (firstError != std::errc() || pFirstEnd != pEnd || last < first) return {};
+        for (std::size_t cpu=first; cpu<=last; ++cpu) cpus.push_back(cpu);
+    }
+    return cpus;
+}
+
+
+/// @brief CPUs of each NUMA node of the host, detected from sysfs.
+/// @details Only CPUs the process may run on count, and nodes without any
+///          of them are left out. Hosts (or processes) confined to a single
+///          node, and systems without sysfs, report a single node.
+class NumaTopology
+{
+public:
+    /// @brief Topology of the host, detected on first use.
+    static const NumaTopology& get()
+    {
+        static const NumaTopology topology = detect();
+        return topology;
+    }
+
+    std::size_t getNodeCount() const noexcept
+    {
+        return std::max(_nodeCPUs.size(), 1ul);
+    }
+
+    /// @brief CPUs of a node (empty on single node hosts).
+    std::span<const std::size_t> getCPUs(std::size_t iNode) const noexcept
+    {
+        return iNode < _nodeCPUs.size() ? std::span<const std::size_t>(_nodeCPUs[iNode]) : std::span<const std::size_t>();
+    }
+
+private:
+    static NumaTopology detect()
+    {
+        NumaTopology topology;
+        #ifdef MTX2IMG_HAS_AFFINITY
+            cpu_set_t allowed;
+            if (::sched_getaffinity(0, sizeof(allowed), &allowed) != 0) return topology;
+
+            // Nodes are ordered by their IDs, which aren't necessarily contiguous.
+            std::map<std::size_t,std::vector<std::size_t>> nodes;
+            std::error_code error;
+            const std::filesystem::directory_iterator itEnd;
+            for (std::filesystem::directory_iterator it("/sys/devices/system/node", error); !error && it!=itEnd; it.increment(error)) {
+                const std::string name = it->path().filename().string();
+                std::size_t iNode = 0ul;
+                if (!name.starts_with("node")
+                    || std::from_chars(name.data() + 4, name.data() + name.size(), iNode).ptr != name.data() + name.size()) {
+                    continue;
+                }
+
+                std::ifstream file(it->path() / "cpulist");
+                std::string list;
+                std::getline(file, list);
+                std::vector<std::size_t> cpus;
+                for (std::size_t cpu : parseCPUList(list)) {
+                    if (cpu < CPU_SETSIZE && CPU_ISSET(cpu, &allowed)) cpus.push_back(cpu);
+                }
+                if (!cpus.empty()) nodes.emplace(iNode, std::move(cpus));
+            }
+
+            if (1ul < nodes.size()) {
+                for (auto& [iNode, rCPUs] : nodes) topology._nodeCPUs.push_back(std::move(rCPUs));
+            }
+        #endif
+        return topology;
+    }
+
+    std::vector<std::vector<std::size_t>> _nodeCPUs;
+}; // class NumaTopology
+
+
+/// @brief Restricts the calling thread to a set of CPUs until it goes out of scope.
+/// @details Does nothing for an empty set, or where affinities aren't supported.
+class ThreadPin
+{
+public:
+    explicit ThreadPin([[maybe_unused]] std::span<const std::size_t> cpus) noexcept
+        : _isPinned(false)
+    {
+        #ifdef MTX2IMG_HAS_AFFINITY
+            if (cpus.empty() || ::sched_getaffinity(0, sizeof(_previous), &_previous) != 0) return;
+            cpu_set_t set;
+            CPU_ZERO(&set);
+            for (std::size_t cpu : cpus) CPU_SET(cpu, &set);
+            _isPinned = ::sched_setaffinity(0, sizeof(set), &set) == 0;
+        #endif
+    }
+
+    ~ThreadPin()
+    {
+        #ifdef MTX2IMG_HAS_AFFINITY
+            if (_isPinned) ::sched_setaffinity(0, sizeof(_previous), &_previous);
+        #endif
+    }
+
+    ThreadPin(const ThreadPin&) = delete;
+
+    ThreadPin& operator=(const ThreadPin&) = delete;
+
+private:
+    bool _isPinned;
+
+    #ifdef MTX2IMG_HAS_AFFINITY
+        cpu_set_t _previous;
+    #endif
+}; // class ThreadPin
+
+
+/// @brief Hands entries over to the NUMA node owning their image rows.
+/// @details The image is split into bands of consecutive rows, one for each node, and
+///          only the threads of a node write to the pixels of its band. Entries of other
+///          bands are collected into batches and posted to the mailbox of their node,
+///          where its threads pick them up. Pages of a fresh pixel buffer are placed on
+///          the node that first writes them, so each band ends up in the local memory
+///          of the threads filling it, and no pixel is ever written from a remote node.
+template <Aggregation TAggregation>
+class NodeRouting
+{
+public:
+    struct Entry
+    {
+        std::size_t row;
+        std::size_t column;
+        [[no_unique_address]] ParsedValue<TAggregation> value;
+    }; // struct Entry
+
+    using Batch = std::vector<Entry>;
+
+    /// @brief Number of entries posted to another node at once.
+    static constexpr std::size_t batchCapacity = 0x1000ul;
+
+    NodeRouting(std::size_t imageHeight,
+                std::size_t nodeCount,
+                std::size_t threadCount)
+        : _imageHeight(imageHeight),
+          _mailboxes(nodeCount),
+          _runningThreads(threadCount)
+    {}
+
+    std::size_t getNodeCount() const noexcept
+    {
+        return _mailboxes.size();
+    }
+
+    /// @brief Get the node owning an image row.
+    /// @details Node i owns the rows from ceil(i * height / nodes) on.
+    std::size_t getOwner(std::size_t imageRow) const noexcept
+    {
+        return imageRow * _mailboxes.size() / _imageHeight;
+    }
+
+    void post(std::size_t iNode, Batch&& rBatch)
+    {
+        Mailbox& rMailbox = _mailboxes[iNode];
+        {
+            std::scoped_lock lock(rMailbox.mutex);
+            rMailbox.batches.push_back(std::move(rBatch));
+        }
+        rMailbox.condition.notify_one();
+    }
+
+    /// @brief Take a batch posted to a node, if there is one.
+    bool tryReceive(std::size_t iNode, Batch& rBatch)
+    {
+        Mailbox& rMailbox = _mailboxes[iNode];
+        std::scoped_lock lock(rMailbox.mutex);
+        return pop(rMailbox, rBatch);
+    }
+
+    /// @brief Wait for a batch posted to a node.
+    /// @return False once every thread finished posting, and no batch is left.
+    bool receive(std::size_t iNode, Batch& rBatch)
+    {
+        Mailbox& rMailbox = _mailboxes[iNode];
+        std::unique_lock lock(rMailbox.mutex);
+        rMailbox.condition.wait(lock, [&rMailbox, this](){return !rMailbox.batches.empty() || !_runningThreads;});
+        return pop(rMailbox, rBatch);
+    }
+
+    /// @brief Tell the other threads that the calling thread won't post batches anymore.
+    void finish()
+    {
+        if (--_runningThreads) return;
+        for (Mailbox& rMailbox : _mailboxes) {
+            std::scoped_lock lock(rMailbox.mutex);
+            rMailbox.condition.notify_all();
+        }
+    }
+
+private:
+    struct Mailbox
+    {
+        std::mutex mutex;
+        std::condition_variable condition;
+        std::vector<Batch> batches;
+    }; // struct Mailbox
+
+    static bool pop(Mailbox& rMailbox, Batch& rBatch)
+    {
+        if (rMailbox.batches.empty()) return false;
+        rBatch = std::move(rMailbox.batches.back());
+        rMailbox.batches.pop_back();
+        return true;
+    }
+
+    std::size_t _imageHeight;
+
+    std::vector<Mailbox> _mailboxes;
+
+    std::atomic<std::size_t> _runningThreads;
+}; // class NodeRouting
+
+
+/// @brief Scatters the entries of its node's band, and routes the rest to their nodes (see @ref NodeRouting).
+template <Aggregation TAggregation, class TScatter>
+class RoutedScatter
+{
+public:
+    using Routing = NodeRouting<TAggregation>;
+
+    RoutedScatter(Routing& rRouting, std::size_t iNode, TScatter& rLocal)
+        : _pRouting(&rRouting),
+          _iNode(iNode),
+          _pLocal(&rLocal),
+          _outgoing(rRouting.getNodeCount())
+    {}
+
+    void insert(std::size_t imageRow,
+                std::size_t imageColumn,
+                ParsedValue<TAggregation> value)
+    {
+        const std::size_t iOwner = _pRouting->getOwner(imageRow);
+        if (iOwner == _iNode) {
+            _pLocal->insert(imageRow, imageColumn, value);
+            return;
+        }
+
+        typename Routing::Batch& rBatch = _outgoing[iOwner];
+        rBatch.push_back({imageRow, imageColumn, value});
+        if (rBatch.size() == Routing::batchCapacity) [[unlikely]] {
+            _pRouting->post(iOwner, std::move(rBatch));
+            rBatch = typename Routing::Batch();
+
+            // Pick up the batches of other nodes along the way, so they don't pile up.
+            while (_pRouting->tryReceive(_iNode, _received)) this->insertReceived();
+        }
+    }
+
+    void flush()
+    {
+        for (std::size_t iNode=0ul; iNode<_outgoing.size(); ++iNode) {
+            if (!_outgoing[iNode].empty()) {
+                _pRouting->post(iNode, std::move(_outgoing[iNode]));
+                _outgoing[iNode] = typename Routing::Batch();
+            }
+        }
+        _pLocal->flush();
+    }
+
+    /// @brief Scatter batches posted to this node until every thread finished posting.
+    void drain()
+    {
+        while (_pRouting->receive(_iNode, _received)) this->insertReceived();
+        _pLocal->flush();
+    }
+
+private:
+    void insertReceived()
+    {
+        for (const auto& rEntry : _received) {
+            _pLocal->insert(rEntry.row, rEntry.column, rEntry.value);
+        }
+    }
+
+    Routing* _pRouting;
+
+    std::size_t _iNode;
+
+    TScatter* _pLocal;
+
+    std::vector<typename Routing::Batch> _outgoing;
+
+    typename Routing::Batch _received;
+}; // class RoutedScatter
+
+
+/// @brief Scatter an input into a pixel buffer shared by several threads.
+/// @details On hosts with several NUMA nodes, threads are pinned to the nodes in contiguous
+///          groups, and entries are routed to the node owning their rows (see @ref NodeRouting).
+///          Pixel buffers that fit in the cache are scattered directly, since they don't
+///          gain anything from it.
+/// @param rScatterInput Scatters the share of the input of a thread, invoked on each thread
+///                      as @p rScatterInput(iThread,rScatter).
+template <Aggregation TAggregation, class TPixel, class TScatterInput>
+void scatterShared(std::span<TPixel> values,
+                   std::pair<std::size_t,std::size_t> imageSize,
+                   std::size_t threadCount,
+                   TScatterInput&& rScatterInput)
+{
+    threadCount = std::max(threadCount, 1ul);
+    const NumaTopology& rTopology = NumaTopology::get();
+    const std::size_t nodeCount = std::min({rTopology.getNodeCount(), threadCount, imageSize.second});
+    const bool isBinned = binnedScatterThreshold < values.size() * sizeof(TPixel);
+
+    if (nodeCount < 2 || !isBinned) {
+        parallelFor(threadCount, [&](std::size_t iThread){
+            #define MTX2IMG_SCATTER_SHARED(SHARED)                                                              \
+                if (isBinned) {                                                                             \
+                    rScatterInput(iThread, BinnedScatter<TAggregation,TPixel,SHARED>(values, imageSize));   \
+                } else {                                                                                    \
+                    rScatterInput(iThread, DirectScatter<TAggregation,TPixel,SHARED>(values, imageSize));   \
+                }
+            if (1ul < threadCount) {
+                MTX2IMG_SCATTER_SHARED(true)
+            } else {
+                MTX2IMG_SCATTER_SHARED(false)
+            }
+            #undef MTX2IMG_SCATTER_SHARED
+        });
+        return;
+    }
+
+    #ifndef NDEBUG
+        std::cout << std::format("mtx2img: scattering on {} NUMA nodes\n", nodeCount);
+    #endif
+
+    NodeRouting<TAggregation> routing(imageSize.second, nodeCount, threadCount);
+    parallelFor(threadCount, [&](std::size_t iThread){
+        // Thread i runs on node floor(i * nodes / threads).
+        const std::size_t iNode = iThread * nodeCount / threadCount;
+        const ThreadPin pin(rTopology.getCPUs(iNode));
+
+        const auto route = [&]<class TScatter>(TScatter&& rLocal) {
+            RoutedScatter<TAggregation,std::remove_reference_t<TScatter>> scatter(routing, iNode, rLocal);
+            try {
+                rScatterInput(iThread, scatter);
+            } catch (...) {
+                routing.finish();
+                throw;
+            }
+            routing.finish();
+            scatter.drain();
+        };
+
+        // Only threads sharing a node write to the same pixels.
+        const std::size_t nodeThreads = ((iNode + 1) * threadCount + nodeCount - 1) / nodeCount
+                                      - (iNode * threadCount + nodeCount - 1) / nodeCount;
+        if (1ul < nodeThreads) {
+            route(BinnedScatter<TAggregation,TPixel,true>(values, imageSize));
+        } else {
+            route(BinnedScatter<TAggregation,TPixel,false>(values, imageSize));
+        }
+    });
+}
+
+
+/// @brief Get the first matrix row mapping to each pixel row.
+/// @details The last item is the number of rows.
+std::vector<std::size_t> getRowBegins(std::size_t rows, std::size_t imageHeight)
+{
+    std::vector<std::size_t> rowBegins(imageHeight + 1);
+    for (std::size_t iImageRow=0ul; iImageRow<rowBegins.size(); ++iImageRow) {
+        rowBegins[iImageRow] = (iImageRow * rows + imageHeight - 1) / imageHeight;
+    }
+    return rowBegins;
+}
+
+
+/// @brief Implicit positions of values in the data section of a dense matrix.
+/// @details Values are stored in column-major order. Symmetric and hermitian
+///          matrices only store their lower triangle, skew-symmetric ones
+///          only their strict lower triangle.
+class DenseLayout
+{
+public:
+    DenseLayout(const format::Properties& rProperties) noexcept
+        : _rows(rProperties.rows.value()),
+          _columns(rProperties.columns.value()),
+          _isTriangular(rProperties.structure.value_or(format::Structure::General) != format::Structure::General),
+          _diagonalOffset(rProperties.structure.value_or(format::Structure::General) == format::Structure::SkewSymmetric)
+    {}
+
+    /// @brief Number of values in the data section.
+    std::size_t size() const noexcept
+    {
+        return this->getColumnBegin(_columns);
+    }
+
+    /// @brief Row index of the first value stored in a column.
+    std::size_t getFirstRow(std::size_t iColumn) const noexcept
+    {
+        return _isTriangular ? std::min(iColumn + _diagonalOffset, _rows) : 0ul;
+    }
+
+    /// @brief Index of the first value stored in a column.
+    std::size_t getColumnBegin(std::size_t iColumn) const noexcept
+    {
+        if (_isTriangular) {
+            // Sum of (rows - c - offset) for all c < iColumn.
+            iColumn = std::min(iColumn, _rows - std::min(_rows, _diagonalOffset));
+            return iColumn * (_rows - _diagonalOffset) - iColumn * (iColumn - 1) / 2;
+        } else {
+            return iColumn * _rows;
+        }
+    }
+
+    /// @brief Get the (row, column) position of a value from its index in the data section.
+    std::pair<std::size_t,std::size_t> getPosition(std::size_t iValue) const noexcept
+    {
+        if (!_isTriangular) {
+            return std::make_pair(iValue % _rows, iValue / _rows);
+        }
+
+        // Find the last column that begins at or before the value.
+        std::size_t iBegin = 0ul, iEnd = _columns;
+        while (1 < iEnd - iBegin) {
+            const std::size_t iMiddle = iBegin + (iEnd - iBegin) / 2;
+            if (this->getColumnBegin(iMiddle) <= iValue) iBegin = iMiddle;
+            else iEnd = iMiddle;
+        }
+        return std::make_pair(this->getFirstRow(iBegin) + iValue - this->getColumnBegin(iBegin), iBegin);
+    }
+
+private:
+    std::size_t _rows;
+
+    std::size_t _columns;
+
+    bool _isTriangular;
+
+    std::size_t _diagonalOffset;
+}; // class DenseLayout
+
+
+/// @brief Map the values of a dense matrix to pixels.
+/// @details The position of every value is implicit in the (column-major) array format,
+///          so no coordinates are materialized. Values of a column that map to the same pixel
+///          are reduced locally, and only their aggregate updates the pixel buffer.
+///          The data section is read in large blocks of complete lines that are split
+///          between threads by byte offsets. A first pass counts the values in each split
+///          to find their positions, then a second pass parses and aggregates them.
+///          Threads write the image columns in the interior of their split directly, and
+///          stage the boundary columns that they might share with others.
+///          Values outside the window are tokenized but not parsed.
+/// @param deterministic Split blocks into a fixed number of splits instead of one per thread.
+///                      Partial sums are then grouped the same way for any number of threads.
+/// @return Number of values read from the input.
+template <Aggregation TAggregation, class TPixel>
+std::size_t fillDense(Parser& rParser,
+                      std::span<TPixel> values,
+                      std::pair<std::size_t,std::size_t> imageSize,
+                      const Window& rWindow,
+                      std::size_t threadCount,
+                      bool deterministic = false)
+{
+    const format::Properties properties = rParser.getProperties();
+    [[maybe_unused]] const format::Data data = properties.data.value();
+    const DenseLayout layout(properties);
+    const std::size_t rows = properties.rows.value();
+    const std::size_t columns = properties.columns.value();
+    const std::size_t windowColumns = rWindow.columnEnd - rWindow.columnBegin;
+    const std::size_t valueCount = layout.size();
+    threadCount = std::max(threadCount, 1ul);
+    const std::size_t splitCount = deterministic ? deterministicSplitCount : threadCount;
+
+    // First matrix row of each pixel row, relative to the window.
+    const std::vector<std::size_t> rowBegins = getRowBegins(rWindow.rowEnd - rWindow.rowBegin, imageSize.second);
+    const IndexMap rowMap(rWindow.rowEnd - rWindow.rowBegin, imageSize.second);
+    const IndexMap columnMap(windowColumns, imageSize.first);
+
+    // Image column of a matrix column, clamped to the window.
+    const auto getImageColumn = [&rWindow, &columnMap](std::size_t column) {
+        return columnMap(std::clamp(column, rWindow.columnBegin, rWindow.columnEnd - 1) - rWindow.columnBegin);
+    };
+
+    // Partial aggregate of consecutive values mapping to the same pixel.
+    using Partial = std::conditional_t<TAggregation == Aggregation::Count,std::size_t,double>;
+
+    // Buffers for the first and last image column each split touches.
+    std::vector<std::vector<TPixel>> boundaryColumns(2 * splitCount);
+
+    std::vector<std::span<const char>> splits(splitCount);
+    std::vector<std::size_t> splitOffsets(splitCount + 1);
+
+    // Run a task on each split, distributed between the threads.
+    const auto forEachSplit = [threadCount](std::size_t currentSplitCount, auto&& rTask) {
+        const std::size_t taskCount = std::min(threadCount, currentSplitCount);
+        parallelFor(taskCount, [&rTask, taskCount, currentSplitCount](std::size_t iTask){
+            for (std::size_t iSplit=iTask; iSplit<currentSplitCount; iSplit+=taskCount) {
+                rTask(iSplit);
+            }
+        });
+    };
+    std::size_t entryCount = 0ul;
+
+    // Blocks are bounded by the bytes the remaining values are expected to take, so that small
+    // inputs don't allocate a full block per split. Lines are estimated from the ones read so far,
+    // which only depends on the input, so deterministic splits stay independent of the thread count.
+    constexpr std::size_t splitSize = 0x800000ul;
+    constexpr std::size_t minBlockSize = 0x10000ul;
+    std::size_t byteCount = 0ul;
+    const auto getBlockSize = [&](){
+        const std::size_t lineSize = entryCount ? (byteCount + entryCount - 1) / entryCount
+                                                : (properties.data.value() == format::Data::Complex ? 64ul : 32ul);
+        const std::size_t remainingValues = valueCount - std::min(entryCount, valueCount);
+        return std::clamp(remainingValues * lineSize, minBlockSize, splitCount * splitSize);
+    };
+
+    for (auto block=rParser.readLines(getBlockSize()); !block.empty(); block=rParser.readLines(getBlockSize())) {
+        byteCount += block.size();
+        // Split the block at line boundaries.
+        const std::size_t currentSplitCount = std::clamp<std::size_t>(block.size() / splitSize, 1ul, splitCount);
+        const char* itSplit = block.data();
+        for (std::size_t iSplit=0ul; iSplit<currentSplitCount; ++iSplit) {
+            const char* itSplitEnd = block.data() + block.size();
+            if (iSplit + 1 < currentSplitCount) {
+                itSplitEnd = std::max(itSplit, block.data() + (iSplit + 1) * block.size() / currentSplitCount);
+                itSplitEnd = std::find(itSplitEnd, block.data() + block.size(), '\n');
+                if (itSplitEnd != block.data() + block.size()) ++itSplitEnd;
+            }
+            splits[iSplit] = std::span<const char>(itSplit, itSplitEnd);
+            itSplit = itSplitEnd;
+        }
+
+        // Count the values in each split to find their positions.
+        forEachSplit(currentSplitCount, [&splits, &splitOffsets](std::size_t iSplit){
+            std::size_t count = 0ul;
+            const char* itEnd = splits[iSplit].data() + splits[iSplit].size();
+            for (const char* it=splits[iSplit].data(); it!=itEnd; it=std::find(it, itEnd, '\n') + 1) {
+                count += static_cast<std::size_t>(*skipBlanks(it) != '\n');
+            }
+            splitOffsets[iSplit + 1] = count;
+        });
+
+        splitOffsets.front() = entryCount;
+        for (std::size_t iSplit=0ul; iSplit<currentSplitCount; ++iSplit) {
+            splitOffsets[iSplit + 1] += splitOffsets[iSplit];
+        }
+        if (valueCount < splitOffsets[currentSplitCount]) {
+            throw ParsingException(std::format(
+                "Error: input contains more entries than the {} declared in its header\n",
+                valueCount
+            ));
+        }
+
+        // Parse and aggregate values.
+        forEachSplit(currentSplitCount, [&](std::size_t iSplit){
+            const std::size_t iValueBegin = splitOffsets[iSplit];
+            const std::size_t iValueEnd = splitOffsets[iSplit + 1];
+            if (iValueBegin == iValueEnd) return;
+
+            auto [row, column] = layout.getPosition(iValueBegin);
+
+            // Image columns this split might share with other splits.
+            const std::size_t firstImageColumn = getImageColumn(column);
+            const std::size_t lastImageColumn = getImageColumn(layout.getPosition(iValueEnd - 1).second);
+            std::vector<TPixel>& rFirstColumn = boundaryColumns[2 * iSplit];
+            std::vector<TPixel>& rLastColumn = boundaryColumns[2 * iSplit + 1];
+            rFirstColumn.assign(imageSize.second, TPixel(0));
+            rLastColumn.assign(imageSize.second, TPixel(0));
+
+            // Pixel of the current position, and the next row it changes at.
+            std::size_t imageColumn = 0ul, imageRow = 0ul, nextRowBegin = 0ul;
+            bool isColumnInWindow = false, isInWindow = false;
+
+            Partial partial = Partial(0);
+            auto commit = [&](){
+                if (partial == Partial(0)) return;
+                TPixel* pPixel = nullptr;
+                if (imageColumn == firstImageColumn) {
+                    pPixel = &rFirstColumn[imageRow];
+                } else if (imageColumn == lastImageColumn) {
+                    pPixel = &rLastColumn[imageRow];
+                } else {
+                    pPixel = &values[imageRow * imageSize.first + imageColumn];
+                }
+                mergePixel<TAggregation>(*pPixel, partial);
+                partial = Partial(0);
+            };
+
+            const auto enterRow = [&](){
+                if (row < rWindow.rowBegin) {
+                    isInWindow = false;
+                    nextRowBegin = rWindow.rowBegin;
+                } else if (row < rWindow.rowEnd) {
+                    imageRow = rowMap(row - rWindow.rowBegin);
+                    isInWindow = isColumnInWindow;
+                    nextRowBegin = rWindow.rowBegin + rowBegins[imageRow + 1];
+                } else {
+                    isInWindow = false;
+                    nextRowBegin = rows; // <== never reached before the end of the column
+                }
+            };
+
+            const auto enterColumn = [&](){
+                isColumnInWindow = column - rWindow.columnBegin < windowColumns;
+                imageColumn = getImageColumn(column);
+                enterRow();
+            };
+
+            enterColumn();
+            const char* itEnd = splits[iSplit].data() + splits[iSplit].size();
+            for (const char* it=splits[iSplit].data(); it!=itEnd; ++it) {
+                const char* itLine = skipBlanks(it);
+                it = itLine;
+                if (*itLine == '\n') continue;
+
+                // Reduce the value into the current pixel.
+                if constexpr (TAggregation == Aggregation::Count) {
+                    partial += static_cast<Partial>(isInWindow);
+                } else if (isInWindow) {
+                    double value;
+                    it = parseMagnitude(itLine, itEnd, data, value);
+                    if (!it) [[unlikely]] {
+                        throw ParsingException(std::format(
+                            "Error: failed to parse entry {}:\n{}\n",
+                            layout.getColumnBegin(column) + row - layout.getFirstRow(column) + 1,
+                            std::string_view(itLine, std::find(itLine, itEnd, '\n'))
+                        ));
+                    }
+                    if constexpr (TAggregation == Aggregation::Sum) {
+                        partial += std::abs(value);
+                    } else {
+                        partial = std::max(partial, std::abs(value));
+                    }
+                }
+                it = std::find(it, itEnd, '\n');
+
+                // Advance to the next position and flush the
+                // partial aggregate if it maps to a new pixel.
+                if (++row == rows) {
+                    commit();
+                    do {
+                        ++column;
+                    } while (column < columns && layout.getFirstRow(column) == rows);
+                    if (column == columns) break;
+                    row = layout.getFirstRow(column);
+                    enterColumn();
+                } else if (row == nextRowBegin) {
+                    commit();
+                    enterRow();
+                }
+            } // for it in split
+
+            commit();
+        });
+
+        // Merge boundary columns in a fixed order.
+        for (std::size_t iSplit=0ul; iSplit<currentSplitCount; ++iSplit) {
+            if (splitOffsets[iSplit] == splitOffsets[iSplit + 1]) continue;
+            const std::size_t firstImageColumn = getImageColumn(layout.getPosition(splitOffsets[iSplit]).second);
+            const std::size_t lastImageColumn = getImageColumn(layout.getPosition(splitOffsets[iSplit + 1] - 1).second);
+            for (std::size_t iImageRow=0ul; iImageRow<imageSize.second; ++iImageRow) {
+                TPixel* pRow = values.data() + iImageRow * imageSize.first;
+                mergePixel<TAggregation>(pRow[firstImageColumn], boundaryColumns[2 * iSplit][iImageRow]);
+                if (lastImageColumn != firstImageColumn) {
+                    mergePixel<TAggregation>(pRow[lastImageColumn], boundaryColumns[2 * iSplit + 1][iImageRow]);
+                }
+            }
+        }
+
+        entryCount = splitOffsets[currentSplitCount];
+    } // for block in input
+
+    return entryCount;
+}
+
+
+/// @brief Read-only view of an entire file.
+/// @details The file is memory mapped on POSIX systems, and read into memory elsewhere.
+class MappedFile
+{
+public:
+    explicit MappedFile(const std::filesystem::path& rPath)
+        : _data()
+    {
+        #ifdef MTX2IMG_HAS_MMAP
+            const int fileDescriptor = ::open(rPath.c_str(), O_RDONLY);
+            if (fileDescriptor < 0) {
+                throw IOError(std::format("Error: failed to open input file: {}\n", rPath.string()));
+            }
+
+            struct stat status;
+            if (::fstat(fileDescriptor, &status) != 0) {
+                ::close(fileDescriptor);
+                throw IOError(std::format("Error: failed to query input file: {}\n", rPath.string()));
+            }
+
+            const std::size_t size = static_cast<std::size_t>(status.st_size);
+            if (size) {
+                void* pMapped = ::mmap(nullptr, size, PROT_READ, MAP_PRIVATE, fileDescriptor, 0);
+                ::close(fileDescriptor);
+                if (pMapped == MAP_FAILED) {
+                    throw IOError(std::format("Error: failed to map input file: {}\n", rPath.string()));
+                }
+
+                // Threads read disjoint regions of the file in parallel, so start reading all of it.
+                ::madvise(pMapped, size, MADV_WILLNEED);
+                _data = std::span<const std::byte>(static_cast<const std::byte*>(pMapped), size);
+            } else {
+                ::close(fileDescriptor);
+            }
+        #else
+            std::ifstream file(rPath, std::ios::binary | std::ios::ate);
+            if (!file.good()) {
+                throw IOError(std::format("Error: failed to open input file: {}\n", rPath.string()));
+            }
+            _buffer.resize(static_cast<std::size_t>(file.tellg()));
+            file.seekg(0);
+            file.read(reinterpret_cast<char*>(_buffer.data()), static_cast<std::streamsize>(_buffer.size()));
+            if (file.fail()) {
+                throw IOError(std::format("Error: failed to read input file: {}\n", rPath.string()));
+            }
+            _data = _buffer;
+        #endif
+    }
+
+    ~MappedFile()
+    {
+        #ifdef MTX2IMG_HAS_MMAP
+            if (!_data.empty()) {
+                ::munmap(const_cast<std::byte*>(_data.data()), _data.size());
+            }
+        #endif
+    }
+
+    MappedFile(const MappedFile&) = delete;
+
+    MappedFile& operator=(const MappedFile&) = delete;
+
+    std::span<const std::byte> data() const noexcept
+    {
+        return _data;
+    }
+
+private:
+    std::span<const std::byte> _data;
+
+    #ifndef MTX2IMG_HAS_MMAP
+        std::vector<std::byte> _buffer;
+    #endif
+}; // class MappedFile
+
+
+/// @brief Load a permutation vector and invert it into the positions of the input's indices.
+/// @details See @ref Permutation for the formats. Binary vectors are told apart from text
+///          by the null bytes in the upper halves of their indices.
+/// @param name Name of the permuted dimension ("rows" or "columns").
+std::vector<std::size_t> loadPermutation(const std::filesystem::path& rPath,
+                                         std::size_t dimension,
+                                         std::string_view name)
+{
+    const MappedFile file(rPath);
+    const std::span<const std::byte> data = file.data();
+    std::vector<std::size_t> indices;
+    indices.reserve(dimension);
+
+    const std::span<const std::byte> head = data.first(std::min<std::size_t>(data.size(), 0x1000));
+    if (std::find(head.begin(), head.end(), std::byte(0)) != head.end()) {
+        const auto loadNative = [&data, &indices]<class TIndex>() {
+            for (std::size_t iByte=0ul; iByte<data.size(); iByte+=sizeof(TIndex)) {
+                TIndex index;
+                std::memcpy(&index, data.data() + iByte, sizeof(TIndex));
+                indices.push_back(static_cast<std::size_t>(index));
+            }
+        };
+        if (data.size() == dimension * sizeof(std::uint32_t)) {
+            loadNative.template operator()<std::uint32_t>();
+        } else if (data.size() == dimension * sizeof(std::uint64_t)) {
+            loadNative.template operator()<std::uint64_t>();
+        } else {
+            throw InvalidFormat(std::format(
+                "Error: binary permutation {} holds {} bytes, but {} {} take {} (32 bit) or {} (64 bit) bytes\n",
+                rPath.string(),
+                data.size(),
+                dimension,
+                name,
+                dimension * sizeof(std::uint32_t),
+                dimension * sizeof(std::uint64_t)
+            ));
+        }
+    } else {
+        const auto isSeparator = [](char c) {return c == ' ' || c == '\t' || c == '\n' || c == '\r';};
+        const char* it = reinterpret_cast<const char*>(data.data());
+        const char* itEnd = it + data.size();
+        while (true) {
+            it = std::find_if_not(it, itEnd, isSeparator);
+            if (it == itEnd) break;
+
+            std::size_t index;
+            const auto [itNext, error] = std::from_chars(it, itEnd, index);
+            if (error != std::errc() || (itNext != itEnd && !isSeparator(*itNext))) {
+                throw InvalidFormat(std::format(
+                    "Error: invalid index in permutation {}: {}\n",
+                    rPath.string(),
+                    std::string_view(it, std::find_if(it, itEnd, isSeparator))
+                ));
+            }
+            indices.push_back(index);
+            it = itNext;
+        }
+    }
+
+    if (indices.size() != dimension) {
+        throw InvalidFormat(std::format(
+            "Error: permutation {} holds {} indices, but the matrix has {} {}\n",
+            rPath.string(),
+            indices.size(),
+            dimension,
+            name
+        ));
+    }
+
+    // Indices are 1-based unless one of them is 0.
+    const std::size_t base = std::find(indices.begin(), indices.end(), 0ul) == indices.end() ? 1ul : 0ul;
+    std::vector<std::size_t> positions(dimension, std::numeric_limits<std::size_t>::max());
+    for (std::size_t iPosition=0ul; iPosition<dimension; ++iPosition) {
+        const std::size_t index = indices[iPosition] - base;
+        if (dimension <= index || positions[index] != std::numeric_limits<std::size_t>::max()) {
+            throw InvalidFormat(std::format(
+                "Error: permutation {} is not a permutation of the {}: index {} at position {} is out of range or repeated\n",
+                rPath.string(),
+                name,
+                indices[iPosition],
+                iPosition
+            ));
+        }
+        positions[index] = iPosition;
+    }
+
+    return positions;
+}
+
+
+/// @brief Load the permutations of the rows and columns of an input.
+/// @details The reordering is empty if neither dimension is permuted, and the
+///          other dimension keeps its order if only one of them is.
+Reordering loadReordering(const Permutation& rPermutation,
+                          const format::Properties& rProperties)
+{
+    Reordering reordering;
+    if (rPermutation.rowPath.empty() && rPermutation.columnPath.empty()) {
+        return reordering;
+    } else if (rProperties.format == format::Format::Array) {
+        throw UnsupportedFormat("Error: permutations are not supported for dense inputs\n");
+    }
+
+    const auto load = [](const std::filesystem::path& rPath, std::size_t dimension, std::string_view name) {
+        if (rPath.empty()) {
+            std::vector<std::size_t> identity(dimension);
+            std::ranges::copy(std::ranges::views::iota(0ul, dimension), identity.begin());
+            return identity;
+        }
+        return loadPermutation(rPath, dimension, name);
+    };
+
+    reordering.rows = load(rPermutation.rowPath, rProperties.rows.value(), "rows");
+    if (rPermutation.columnPath == rPermutation.rowPath && rProperties.columns == rProperties.rows) {
+        // Symmetric reorderings usually pass the same file for both.
+        reordering.columns = reordering.rows;
+    } else {
+        reordering.columns = load(rPermutation.columnPath, rProperties.columns.value(), "columns");
+    }
+
+    return reordering;
+}
+
+
+/// @brief Load a big-endian value from unaligned memory.
+template <class T>
+T loadBigEndian(const std::byte* pBegin) noexcept
+{
+    static_assert(sizeof(T) == 4 || sizeof(T) == 8);
+    using Bits = std::conditional_t<sizeof(T) == 4,std::uint32_t,std::uint64_t>;
+    Bits bits = 0;
+    for (std::size_t iByte=0ul; iByte<sizeof(T); ++iByte) {
+        bits = (bits << 8) | std::to_integer<Bits>(pBegin[iByte]);
+    }
+    return std::bit_cast<T>(bits);
+}
+
+
+/// @brief Sparse matrix in PETSc's binary format, as written by @p MatView for AIJ matrices.
+/// @details The layout is entirely big-endian:
+///          - header: class ID (1211216), rows, columns, nonzeros
+///          - number of entries in each row
+///          - column index of each entry
+///          - value of each entry
+///          Indices are 32 bit integers, or 64 bit integers if PETSc was configured with
+///          64 bit indices. Values are double precision reals unless their size implies
+///          otherwise (single precision reals or double precision complex numbers).
+class PETScBinaryMatrix
+{
+public:
+    static constexpr std::int32_t classID = 1211216;
+
+    enum class Scalar
+    {
+        Float,
+        Double,
+        ComplexDouble
+    }; // enum class Scalar
+
+    explicit PETScBinaryMatrix(const std::filesystem::path& rPath)
+        : _file(rPath),
+          _indexSize(0ul),
+          _scalar(Scalar::Double),
+          _rowOffsets(),
+          _properties()
+    {
+        const std::span<const std::byte> data = _file.data();
+
+        // Identify the index width from the class ID.
+        if (16 <= data.size() && loadBigEndian<std::int32_t>(data.data()) == classID) {
+            _indexSize = sizeof(std::int32_t);
+        } else if (32 <= data.size() && loadBigEndian<std::int64_t>(data.data()) == classID) {
+            _indexSize = sizeof(std::int64_t);
+        } else {
+            throw InvalidFormat(std::format(
+                "Error: {} is not a PETSc binary matrix\n",
+                rPath.string()
+            ));
+        }
+
+        const long long rows = this->loadIndex(1);
+        const long long columns = this->loadIndex(2);
+        const long long nonzeros = this->loadIndex(3);
+        if (nonzeros < 0ll) {
+            throw UnsupportedFormat("Error: dense PETSc binary matrices are not supported\n");
+        } else if (rows < 0ll || columns < 0ll) {
+            throw InvalidFormat(std::format(
+                "Error: invalid PETSc binary matrix dimensions {}x{}\n",
+                rows,
+                columns
+            ));
+        }
+
+        _properties.object = format::Object::Matrix;
+        _properties.format = format::Format::Coordinate;
+        _properties.data = format::Data::Real;
+        _properties.structure = format::Structure::General;
+        _properties.rows = static_cast<std::size_t>(rows);
+        _properties.columns = static_cast<std::size_t>(columns);
+        _properties.nonzeros = static_cast<std::size_t>(nonzeros);
+
+        // Check the declared sizes against the number of indices the file can hold
+        // before computing any byte count from them (64 bit headers could overflow it).
+        const std::size_t indexCapacity = data.size() / _indexSize - 4ul;
+        if (indexCapacity < _properties.rows.value()
+            || indexCapacity - _properties.rows.value() < _properties.nonzeros.value()) {
+            throw InvalidFormat("Error: truncated PETSc binary matrix\n");
+        }
+
+        // Identify the value type from the remaining size of the file.
+        const std::size_t indexBytes = (4ul + _properties.rows.value() + _properties.nonzeros.value()) * _indexSize;
+        const std::size_t valueBytes = data.size() - indexBytes;
+        const std::size_t valueCount = _properties.nonzeros.value();
+        const std::size_t valueSize = valueCount ? valueBytes / valueCount : 0ul;
+        if (valueSize == sizeof(float) && valueBytes % valueCount == 0ul) {
+            _scalar = Scalar::Float;
+        } else if (valueSize == 2 * sizeof(double) && valueBytes % valueCount == 0ul) {
+            _scalar = Scalar::ComplexDouble;
+            _properties.data = format::Data::Complex;
+        } else if (valueCount <= valueBytes / sizeof(double)) {
+            _scalar = Scalar::Double; // <== anything after the values is ignored
+        } else {
+            throw InvalidFormat("Error: truncated PETSc binary matrix\n");
+        }
+
+        // Compute the offset of each row from the row lengths.
+        _rowOffsets.resize(_properties.rows.value() + 1);
+        _rowOffsets.front() = 0ul;
+        for (std::size_t iRow=0ul; iRow<_properties.rows.value(); ++iRow) {
+            const long long rowLength = this->loadIndex(4ul + iRow);
+            if (rowLength < 0ll) {
+                throw InvalidFormat(std::format(
+                    "Error: negative length of row {} in PETSc binary matrix\n",
+                    iRow
+                ));
+            }
+            _rowOffsets[iRow + 1] = _rowOffsets[iRow] + static_cast<std::size_t>(rowLength);
+        }
+
+        if (_rowOffsets.back() != _properties.nonzeros.value()) {
+            throw InvalidFormat(std::format(
+                "Error: PETSc binary matrix declares {} nonzeros but its rows hold {}\n",
+                _properties.nonzeros.value(),
+                _rowOffsets.back()
+            ));
+        }
+
+        #ifndef NDEBUG
+            std::cout << "mtx2img: input PETSc binary matrix properties:\n"
+                      << "mtx2img:     " << _properties.rows.value() << " rows\n"
+                      << "mtx2img:     " << _properties.columns.value() << " columns\n"
+                      << "mtx2img:     " << _properties.nonzeros.value() << " entries\n"
+                      << "mtx2img:     " << 8 * _indexSize << " bit indices\n";
+        #endif
+    }
+
+    format::Properties getProperties() const
+    {
+        return _properties;
+    }
+
+    std::size_t getIndexSize() const noexcept
+    {
+        return _indexSize;
+    }
+
+    Scalar getScalar() const noexcept
+    {
+        return _scalar;
+    }
+
+    /// @brief Offset of the first entry of each row, and the number of entries at the end.
+    std::span<const std::size_t> getRowOffsets() const noexcept
+    {
+        return _rowOffsets;
+    }
+
+    /// @brief Raw big-endian column indices of all entries.
+    const std::byte* getColumnIndices() const noexcept
+    {
+        return _file.data().data() + (4ul + _properties.rows.value()) * _indexSize;
+    }
+
+    /// @brief Raw big-endian values of all entries.
+    const std::byte* getValues() const noexcept
+    {
+        return this->getColumnIndices() + _properties.nonzeros.value() * _indexSize;
+    }
+
+private:
+    long long loadIndex(std::size_t iIndex) const noexcept
+    {
+        const std::byte* pIndex = _file.data().data() + iIndex * _indexSize;
+        return _indexSize == sizeof(std::int32_t) ? loadBigEndian<std::int32_t>(pIndex)
+                                                  : loadBigEndian<std::int64_t>(pIndex);
+    }
+
+    MappedFile _file;
+
+    std::size_t _indexSize;
+
+    Scalar _scalar;
+
+    std::vector<std::size_t> _rowOffsets;
+
+    format::Properties _properties;
+}; // class PETScBinaryMatrix
+
+
+/// @brief Map the entries of a PETSc binary matrix to pixels.
+/// @details The matrix is already in compressed row format, so threads get
+///          disjoint bands of pixel rows (balanced by their number of entries)
+///          and aggregate them straight from the mapped file without any
+///          synchronization. Rows outside the window are not even read.
+/// @param pCollector Gathers the structure of the entries in the window if not null.
+/// @return Number of entries in the input.
+template <Aggregation TAggregation, class TIndex, class TScalar, class TPixel>
+std::size_t fillPETSc(const PETScBinaryMatrix& rMatrix,
+                      std::span<TPixel> values,
+                      std::pair<std::size_t,std::size_t> imageSize,
+                      const Window& rWindow,
+                      std::size_t threadCount,
+                      StructureCollector* pCollector = nullptr)
+{
+    const format::Properties properties = rMatrix.getProperties();
+    const std::span<const std::size_t> rowOffsets = rMatrix.getRowOffsets().subspan(rWindow.rowBegin,
+                                                                                    rWindow.rowEnd - rWindow.rowBegin + 1);
+    const std::byte* pColumns = rMatrix.getColumnIndices();
+    [[maybe_unused]] const std::byte* pValues = rMatrix.getValues();
+    const std::vector<std::size_t> rowBegins = getRowBegins(rowOffsets.size() - 1, imageSize.second);
+    const std::size_t windowColumns = rWindow.columnEnd - rWindow.columnBegin;
+    const IndexMap columnMap(windowColumns, imageSize.first);
+    threadCount = std::clamp<std::size_t>(threadCount, 1ul, imageSize.second);
+
+    // Split pixel rows between threads so that each gets roughly the same number of entries.
+    std::vector<std::size_t> threadBegins(threadCount + 1, imageSize.second);
+    threadBegins.front() = 0ul;
+    for (std::size_t iThread=1ul, iImageRow=0ul; iThread<threadCount; ++iThread) {
+        const std::size_t target = rowOffsets.front() + iThread * (rowOffsets.back() - rowOffsets.front()) / threadCount;
+        while (iImageRow < imageSize.second && rowOffsets[rowBegins[iImageRow]] < target) ++iImageRow;
+        threadBegins[iThread] = iImageRow;
+    }
+
+    parallelFor(threadCount, [&](std::size_t iThread){
+        std::array<std::size_t,EntryBatch<std::monostate>::capacity> imageColumns;
+        std::array<std::size_t,EntryBatch<std::monostate>::capacity> batchPositions;
+        for (std::size_t iImageRow=threadBegins[iThread]; iImageRow<threadBegins[iThread + 1]; ++iImageRow) {
+            TPixel* pImageRow = values.data() + iImageRow * getRowElements<TPixel>(imageSize.first);
+            const std::size_t iEntryEnd = rowOffsets[rowBegins[iImageRow + 1]];
+            for (std::size_t iEntry=rowOffsets[rowBegins[iImageRow]]; iEntry<iEntryEnd; iEntry+=imageColumns.size()) {
+                // Decode column indices in batches, and keep the ones in the window.
+                const std::size_t batchSize = std::min(imageColumns.size(), iEntryEnd - iEntry);
+                std::size_t croppedSize = 0ul;
+                for (std::size_t iBatch=0ul; iBatch<batchSize; ++iBatch) {
+                    const TIndex column = loadBigEndian<TIndex>(pColumns + (iEntry + iBatch) * sizeof(TIndex));
+                    if (column < 0 || properties.columns.value() <= static_cast<std::size_t>(column)) [[unlikely]] {
+                        throw ParsingException(std::format(
+                            "Error: entry {} references column {}, but the matrix has {} columns\n",
+                            iEntry + iBatch + 1,
+                            column,
+                            properties.columns.value()
+                        ));
+                    }
+                    imageColumns[croppedSize] = static_cast<std::size_t>(column) - rWindow.columnBegin;
+                    batchPositions[croppedSize] = iBatch;
+                    croppedSize += static_cast<std::size_t>(imageColumns[croppedSize] < windowColumns);
+                }
+                columnMap(std::span<std::size_t>(imageColumns.data(), croppedSize));
+
+                for (std::size_t iCropped=0ul; iCropped<croppedSize; ++iCropped) {
+                    [[maybe_unused]] const std::size_t iValue = iEntry + batchPositions[iCropped];
+                    if constexpr (TAggregation == Aggregation::Count) {
+                        registerPixel<TAggregation,false>(std::monostate(), pImageRow, imageColumns[iCropped]);
+                    } else if constexpr (is_complex_v<TScalar>) {
+                        using Real = typename TScalar::value_type;
+                        const std::byte* pValue = pValues + iValue * sizeof(TScalar);
+                        const TScalar value(loadBigEndian<Real>(pValue), loadBigEndian<Real>(pValue + sizeof(Real)));
+                        registerPixel<TAggregation,false>(value, pImageRow, imageColumns[iCropped]);
+                    } else {
+                        const TScalar value = loadBigEndian<TScalar>(pValues + iValue * sizeof(TScalar));
+                        registerPixel<TAggregation,false>(value, pImageRow, imageColumns[iCropped]);
+                    }
+                }
+            } // for iEntry in image row
+        } // for iImageRow in thread
+
+        // Statistics need the row of each entry, which the loop above doesn't track.
+        if (pCollector) {
+            StructureCollector::Local statistics(*pCollector);
+            const std::size_t rowEnd = rowBegins[threadBegins[iThread + 1]];
+            for (std::size_t iRow=rowBegins[threadBegins[iThread]]; iRow<rowEnd; ++iRow) {
+                for (std::size_t iEntry=rowOffsets[iRow]; iEntry<rowOffsets[iRow + 1]; ++iEntry) {
+                    const std::size_t column = static_cast<std::size_t>(loadBigEndian<TIndex>(pColumns + iEntry * sizeof(TIndex)))
+                                             - rWindow.columnBegin;
+                    if (windowColumns <= column) continue;
+
+                    // Complex values are reduced to their magnitude, like in MatrixMarket inputs.
+                    double value = 1.0;
+                    if constexpr (TAggregation != Aggregation::Count && is_complex_v<TScalar>) {
+                        using Real = typename TScalar::value_type;
+                        const std::byte* pValue = pValues + iEntry * sizeof(TScalar);
+                        value = std::abs(TScalar(loadBigEndian<Real>(pValue), loadBigEndian<Real>(pValue + sizeof(Real))));
+                    } else if constexpr (TAggregation != Aggregation::Count) {
+                        value = static_cast<double>(loadBigEndian<TScalar>(pValues + iEntry * sizeof(TScalar)));
+                    }
+                    statistics.insert(iRow, column, value);
+                }
+            }
+        }
+    });
+
+    return rMatrix.getRowOffsets().back();
+}
+
+
+/// @brief Parse a real number written by a Fortran E, D, F or G edit descriptor.
+/// @details Fortran may write exponents with a D (or without any letter if they take
+///          three digits), and reads blanks as nothing (so blank fields are zero).
+/// @return False if the field is not a number.
+inline bool parseFortranReal(std::string_view field, double& rValue) noexcept
+{
+    // Most fields are plain numbers padded from the left.
+    field.remove_prefix(std::min(field.find_first_not_of(' '), field.size()));
+    if (field.starts_with('+')) field.remove_prefix(1);
+    {
+        const auto [itParsed, error] = std::from_chars(field.data(), field.data() + field.size(), rValue);
+        if (error == std::errc() && itParsed == field.data() + field.size() && !field.empty()) return true;
+    }
+
+    std::array<char,64> buffer;
+    std::size_t size = 0ul;
+    for (char character : field) {
+        if (character == ' ') continue;
+        if (buffer.size() < size + 2) return false;
+
+        if (character == 'D' || character == 'd' || character == 'Q' || character == 'q') {
+            character = 'E';
+        } else if ((character == '+' || character == '-') && size && buffer[size - 1] != 'E' && buffer[size - 1] != 'e') {
+            buffer[size++] = 'E';
+        }
+
+        // Leading plus signs are not accepted by from_chars.
+        if (character != '+' || size) buffer[size++] = character;
+    }
+
+    if (!size) {
+        rValue = 0.0;
+        return true;
+    }
+    const auto [itParsed, error] = std::from_chars(buffer.data(), buffer.data() + size, rValue);
+    return error == std::errc() && itParsed == buffer.data() + size;
+}
+
+
+/// @brief Sparse matrix in Harwell-Boeing or Rutherford-Boeing format (assembled matrices only).
+/// @details Both are column compressed, and written in fixed width Fortran fields:
+///          - title line and header lines with the number of lines (cards) of each section,
+///            the type code (e.g. RUA: real unsymmetric assembled), the dimensions, and the
+///            Fortran formats of the sections
+///          - 1-based offset of the first entry of each column, and one past the last entry
+///          - 1-based row index of each entry
+///          - value of each entry (missing for pattern matrices)
+///          Harwell-Boeing files may carry right hand sides after the values, which are ignored.
+///          Every line of a section but the last holds the same number of fields, so fields
+///          are read straight from the mapped file at offsets computed from their positions.
+///          Symmetric, skew-symmetric and hermitian matrices store their lower triangle.
+class HarwellBoeingMatrix
+{
+public:
+    explicit HarwellBoeingMatrix(const std::filesystem::path& rPath)
+        : _file(rPath),
+          _indices(),
+          _values(),
+          _columnOffsets(),
+          _properties()
+    {
+        const std::span<const std::byte> data = _file.data();
+        const std::string_view text(reinterpret_cast<const char*>(data.data()), data.size());
+
+        // Header lines: title, section sizes, type and dimensions, formats.
+        std::size_t offset = 0ul;
+        std::array<std::string_view,4> header;
+        for (std::string_view& rLine : header) {
+            rLine = getLine(text, offset);
+        }
+
+        const std::optional<long long> pointerLines = parseField(header[1], 14, 14);
+        const std::optional<long long> indexLines = parseField(header[1], 28, 14);
+        const std::optional<long long> valueLines = parseField(header[1], 42, 14);
+        const std::optional<long long> rightHandSideLines = parseField(header[1], 56, 14);
+        const std::optional<long long> rows = parseField(header[2], 14, 14);
+        const std::optional<long long> columns = parseField(header[2], 28, 14);
+        const std::optional<long long> nonzeros = parseField(header[2], 42, 14);
+        if (!pointerLines || !indexLines || !valueLines || !rows || !columns || !nonzeros
+            || *pointerLines < 0ll || *indexLines < 0ll || *valueLines < 0ll
+            || *rows < 0ll || *columns < 0ll || *nonzeros < 0ll) {
+            throw InvalidFormat(std::format(
+                "Error: {} is not a Harwell-Boeing matrix\n",
+                rPath.string()
+            ));
+        }
+
+        // Harwell-Boeing files with right hand sides describe them on an extra header line.
+        // Note: Rutherford-Boeing files don't have the field at all.
+        if (rightHandSideLines.value_or(0ll) > 0ll) {
+            getLine(text, offset);
+        }
+
+        // Type code: value type, structure, assembled or elemental.
+        std::string type(header[2].substr(0, 3));
+        std::transform(type.begin(), type.end(), type.begin(), [](char c){return static_cast<char>(std::toupper(static_cast<unsigned char>(c)));});
+        if (!isTypeCode(type)) {
+            throw InvalidFormat(std::format(
+                "Error: invalid Harwell-Boeing matrix type: {}\n",
+                type
+            ));
+        } else if (type[2] == 'E') {
+            throw UnsupportedFormat("Error: elemental Harwell-Boeing matrices are not supported\n");
+        }
+
+        _properties.object = format::Object::Matrix;
+        _properties.format = format::Format::Coordinate;
+        switch (type[0]) {
+            case 'R': _properties.data = format::Data::Real; break;
+            case 'C': _properties.data = format::Data::Complex; break;
+            case 'I': _properties.data = format::Data::Integer; break;
+            default:  _properties.data = format::Data::Pattern; break;
+        }
+        switch (type[1]) {
+            case 'S': _properties.structure = format::Structure::Symmetric; break;
+            case 'Z': _properties.structure = format::Structure::SkewSymmetric; break;
+            case 'H': _properties.structure = format::Structure::Hermitian; break;
+            default:  _properties.structure = format::Structure::General; break;
+        }
+        _properties.rows = static_cast<std::size_t>(*rows);
+        _properties.columns = static_cast<std::size_t>(*columns);
+        _properties.nonzeros = static_cast<std::size_t>(*nonzeros);
+        if (_properties.structure != format::Structure::General && _properties.rows != _properties.columns) {
+            throw InvalidFormat("Error: symmetric Harwell-Boeing matrices must be square\n");
+        }
+
+        // Locate the sections from the number of their lines.
+        const std::size_t valueCount = _properties.data == format::Data::Pattern ? 0ul
+                                     : _properties.nonzeros.value() * (_properties.data == format::Data::Complex ? 2ul : 1ul);
+        Section pointers = Section::make(text, offset, static_cast<std::size_t>(*pointerLines), _properties.columns.value() + 1, header[3].substr(0, 16), "pointer");
+        _indices = Section::make(text, offset, static_cast<std::size_t>(*indexLines), _properties.nonzeros.value(), header[3].substr(16, 16), "row index");
+        if (valueCount) {
+            _values = Section::make(text, offset, static_cast<std::size_t>(*valueLines), valueCount, header[3].substr(32, 20), "value");
+        }
+
+        // Decode the column pointers.
+        _columnOffsets.resize(_properties.columns.value() + 1);
+        for (std::size_t iPointer=0ul; iPointer<_columnOffsets.size(); ++iPointer) {
+            const std::optional<long long> pointer = parseField(pointers.getField(iPointer), 0ul, std::string_view::npos);
+            if (!pointer || *pointer < 1ll
+                || static_cast<std::size_t>(*pointer - 1) < (iPointer ? _columnOffsets[iPointer - 1] : 0ul)) {
+                throw InvalidFormat(std::format(
+                    "Error: invalid pointer to column {} in Harwell-Boeing matrix\n",
+                    iPointer + 1
+                ));
+            }
+            _columnOffsets[iPointer] = static_cast<std::size_t>(*pointer - 1);
+        }
+
+        if (_columnOffsets.front() != 0ul || _columnOffsets.back() != _properties.nonzeros.value()) {
+            throw InvalidFormat(std::format(
+                "Error: Harwell-Boeing matrix declares {} nonzeros but its columns hold {}\n",
+                _properties.nonzeros.value(),
+                _columnOffsets.back() - _columnOffsets.front()
+            ));
+        }
+
+        #ifndef NDEBUG
+            std::cout << "mtx2img: input Harwell-Boeing matrix properties:\n"
+                      << "mtx2img:     type " << type << '\n'
+                      << "mtx2img:     " << _properties.rows.value() << " rows\n"
+                      << "mtx2img:     " << _properties.columns.value() << " columns\n"
+                      << "mtx2img:     " << _properties.nonzeros.value() << " entries\n";
+        #endif
+    }
+
+    /// @brief Check whether the first lines of a file look like a Harwell-Boeing header.
+    static bool isHeader(std::string_view text) noexcept
+    {
+        std::size_t offset = 0ul;
+        getLine(text, offset);
+        const std::string_view sizes = getLine(text, offset);
+        const std::string_view dimensions = getLine(text, offset);
+        const std::string_view formats = getLine(text, offset);
+
+        std::string type(dimensions.substr(0, 3));
+        std::transform(type.begin(), type.end(), type.begin(), [](char c){return static_cast<char>(std::toupper(static_cast<unsigned char>(c)));});
+        const std::size_t formatBegin = formats.find_first_not_of(' ');
+        return parseField(sizes, 0, 14) && parseField(sizes, 14, 14) && parseField(sizes, 28, 14)
+               && isTypeCode(type) && parseField(dimensions, 14, 14) && parseField(dimensions, 28, 14)
+               && formatBegin != std::string_view::npos && formats[formatBegin] == '(';
+    }
+
+    format::Properties getProperties() const
+    {
+        return _properties;
+    }
+
+    /// @brief Offset of the first entry of each column, and the number of entries at the end.
+    std::span<const std::size_t> getColumnOffsets() const noexcept
+    {
+        return _columnOffsets;
+    }
+
+    /// @brief 0-based row index of an entry.
+    /// @throws ParsingException if the field is not a row of the matrix.
+    std::size_t getRow(std::size_t iEntry) const
+    {
+        const std::optional<long long> row = parseField(_indices.getField(iEntry), 0ul, std::string_view::npos);
+        if (!row || *row < 1ll || _properties.rows.value() < static_cast<std::size_t>(*row)) [[unlikely]] {
+            throw ParsingException(std::format(
+                "Error: entry {} references row {}, but the matrix has {} rows\n",
+                iEntry + 1,
+                _indices.getField(iEntry),
+                _properties.rows.value()
+            ));
+        }
+        return static_cast<std::size_t>(*row - 1);
+    }
+
+    /// @brief Value of an entry (the magnitude of complex values, 1 for pattern matrices).
+    /// @throws ParsingException if the value is not a number.
+    double getValue(std::size_t iEntry) const
+    {
+        double value = 1.0;
+        double imaginary = 0.0;
+        bool isValid = true;
+        switch (_properties.data.value()) {
+            case format::Data::Pattern:
+                return value;
+            case format::Data::Complex:
+                isValid = parseFortranReal(_values.getField(2 * iEntry), value)
+                          && parseFortranReal(_values.getField(2 * iEntry + 1), imaginary);
+                value = std::hypot(value, imaginary);
+                break;
+            default:
+                isValid = parseFortranReal(_values.getField(iEntry), value);
+        }
+
+        if (!isValid) [[unlikely]] {
+            throw ParsingException(std::format(
+                "Error: invalid value of entry {} in Harwell-Boeing matrix\n",
+                iEntry + 1
+            ));
+        }
+        return value;
+    }
+
+private:
+    /// @brief Fixed width fields of a section, laid out by a Fortran format such as (16I5) or (1P,4E20.12).
+    class Section
+    {
+    public:
+        /// @brief Locate a section starting at @p rOffset, and move the offset past it.
+        /// @throws InvalidFormat if the format can't be parsed or the lines of the section differ in length.
+        static Section make(std::string_view text,
+                            std::size_t& rOffset,
+                            std::size_t lineCount,
+                            std::size_t fieldCount,
+                            std::string_view fortranFormat,
+                            std::string_view name)
+        {
+            // Repeat count, edit descriptor and field width, after an optional scale factor.
+            std::string normalized;
+            for (char character : fortranFormat.substr(0, fortranFormat.find(')') + 1)) {
+                if (character != ' ') normalized.push_back(static_cast<char>(std::toupper(static_cast<unsigned char>(character))));
+            }
+            const std::regex formatPattern(R"(\((?:\d*P,?)?(\d*)(?:I|E|D|F|G|ES|EN)(\d+)(?:\.\d+)?(?:E\d+)?\))");
+            std::smatch match;
+            if (!std::regex_match(normalized, match, formatPattern)) {
+                throw UnsupportedFormat(std::format(
+                    "Error: unsupported Fortran format of the {} section of a Harwell-Boeing matrix: {}\n",
+                    name,
+                    fortranFormat
+                ));
+            }
+
+            Section section;
+            section._text = text;
+            section._fieldsPerLine = match[1].length() ? std::stoul(match[1].str()) : 1ul;
+            section._fieldWidth = std::stoul(match[2].str());
+            if (!section._fieldsPerLine || !section._fieldWidth
+                || lineCount < (fieldCount + section._fieldsPerLine - 1) / section._fieldsPerLine) {
+                throw InvalidFormat(std::format(
+                    "Error: the {} section of a Harwell-Boeing matrix is too short\n",
+                    name
+                ));
+            }
+
+            // The first line tells the length of every line but the last.
+            section._begin = rOffset;
+            std::size_t lineEnd = rOffset;
+            getLine(text, lineEnd);
+            section._lineBytes = lineEnd - rOffset;
+            if (1ul < lineCount) {
+                const std::size_t lastLine = rOffset + (lineCount - 1) * section._lineBytes;
+                if (text.size() < lastLine || text[lastLine - 1] != '\n') {
+                    throw InvalidFormat(std::format(
+                        "Error: lines of the {} section of a Harwell-Boeing matrix differ in length\n",
+                        name
+                    ));
+                }
+                rOffset = lastLine;
+            }
+            if (lineCount) getLine(text, rOffset);
+
+            return section;
+        }
+
+        /// @brief Characters of a field, up to the end of its line.
+        std::string_view getField(std::size_t iField) const noexcept
+        {
+            const std::size_t iLine = iField / _fieldsPerLine;
+            const std::size_t fieldBegin = _begin + iLine * _lineBytes + (iField - iLine * _fieldsPerLine) * _fieldWidth;
+            std::string_view field = _text.substr(std::min(fieldBegin, _text.size()), _fieldWidth);
+            field = field.substr(0, field.find('\n'));
+            if (field.ends_with('\r')) field.remove_suffix(1);
+            return field;
+        }
+
+    private:
+        std::string_view _text;
+
+        std::size_t _begin = 0ul;
+
+        std::size_t _lineBytes = 0ul;
+
+        std::size_t _fieldsPerLine = 1ul;
+
+        std::size_t _fieldWidth = 0ul;
+    }; // class Section
+
+    /// @brief Get the line starting at @p rOffset (without its line break), and move the offset to the next one.
+    static std::string_view getLine(std::string_view text, std::size_t& rOffset) noexcept
+    {
+        const std::size_t begin = std::min(rOffset, text.size());
+        const std::size_t end = std::min(text.find('\n', begin), text.size());
+        rOffset = std::min(end + 1, text.size());
+        std::string_view line = text.substr(begin, end - begin);
+        if (line.ends_with('\r')) line.remove_suffix(1);
+        return line;
+    }
+
+    /// @brief Parse an integer from a fixed width field of a line.
+    /// @return The integer, or nothing if the field is blank or not an integer.
+    static std::optional<long long> parseField(std::string_view line, std::size_t begin, std::size_t width) noexcept
+    {
+        std::string_view field = line.substr(std::min(begin, line.size()), width);
+        field.remove_prefix(std::min(field.find_first_not_of(' '), field.size()));
+        field = field.substr(0, field.find_last_not_of(' ') + 1);
+        if (field.starts_with('+')) field.remove_prefix(1);
+
+        long long value = 0ll;
+        const auto [itParsed, error] = std::from_chars(field.data(), field.data() + field.size(), value);
+        if (field.empty() || error != std::errc() || itParsed != field.data() + field.size()) {
+            return {};
+        }
+        return value;
+    }
+
+    /// @brief Check a type code: value type (real, complex, integer, pattern), structure, and assembled or elemental.
+    static bool isTypeCode(std::string_view type) noexcept
+    {
+        return type.size() == 3
+               && std::string_view("RCIP").find(type[0]) != std::string_view::npos
+               && std::string_view("SUHZR").find(type[1]) != std::string_view::npos
+               && std::string_view("AE").find(type[2]) != std::string_view::npos;
+    }
+
+    MappedFile _file;
+
+    Section _indices;
+
+    Section _values;
+
+    std::vector<std::size_t> _columnOffsets;
+
+    format::Properties _properties;
+}; // class HarwellBoeingMatrix
+
+
+/// @brief Map the entries of a Harwell-Boeing matrix to pixels.
+/// @details The matrix is in compressed column format, so threads get disjoint bands
+///          of pixel columns (balanced by their number of entries, and starting on byte
+///          boundaries of bit-packed images), and decode their columns straight from the
+///          mapped file without any synchronization. Columns outside the window are not
+///          even read. Mirrored entries of symmetric matrices in windows off the diagonal
+///          go to the pixel rows of their stored columns instead, so they're mapped in a
+///          second pass that splits the image by rows.
+/// @param pCollector Gathers the structure of the entries in the window if not null.
+/// @return Number of entries in the input.
+template <Aggregation TAggregation, class TPixel>
+std::size_t fillHarwellBoeing(const HarwellBoeingMatrix& rMatrix,
+                              std::span<TPixel> values,
+                              std::pair<std::size_t,std::size_t> imageSize,
+                              const Window& rWindow,
+                              std::size_t threadCount,
+                              StructureCollector* pCollector = nullptr)
+{
+    const format::Properties properties = rMatrix.getProperties();
+    const std::size_t rowElements = getRowElements<TPixel>(imageSize.first);
+
+    for (bool transpose : {false, true}) {
+        if (transpose && !mirrorsEntries(properties, rWindow)) break;
+
+        // Stored columns either map to pixel columns, or (mirrored) to pixel rows.
+        const std::size_t bandBegin = transpose ? rWindow.rowBegin : rWindow.columnBegin;
+        const std::size_t bandEnd = transpose ? rWindow.rowEnd : rWindow.columnEnd;
+        const std::size_t bandPixels = transpose ? imageSize.second : imageSize.first;
+        const std::size_t crossBegin = transpose ? rWindow.columnBegin : rWindow.rowBegin;
+        const std::size_t crossCount = (transpose ? rWindow.columnEnd : rWindow.rowEnd) - crossBegin;
+        const IndexMap crossMap(crossCount, transpose ? imageSize.first : imageSize.second);
+        const std::span<const std::size_t> columnOffsets = rMatrix.getColumnOffsets().subspan(bandBegin, bandEnd - bandBegin + 1);
+        const std::vector<std::size_t> columnBegins = getRowBegins(columnOffsets.size() - 1, bandPixels);
+
+        // Split pixel columns (or rows) between threads so that each gets roughly the same number of entries.
+        const std::size_t alignment = (std::is_same_v<TPixel,Occupancy> && !transpose) ? 8ul : 1ul;
+        const std::size_t bandThreads = std::clamp<std::size_t>(threadCount, 1ul, (bandPixels + alignment - 1) / alignment);
+        std::vector<std::size_t> threadBegins(bandThreads + 1, bandPixels);
+        threadBegins.front() = 0ul;
+        for (std::size_t iThread=1ul, iPixel=0ul; iThread<bandThreads; ++iThread) {
+            const std::size_t target = columnOffsets.front() + iThread * (columnOffsets.back() - columnOffsets.front()) / bandThreads;
+            while (iPixel < bandPixels && columnOffsets[columnBegins[iPixel]] < target) iPixel += alignment;
+            threadBegins[iThread] = std::min(iPixel, bandPixels);
+        }
+
+        parallelFor(bandThreads, [&](std::size_t iThread){
+            std::optional<StructureCollector::Local> maybeStatistics;
+            if (pCollector) maybeStatistics.emplace(*pCollector);
+
+            for (std::size_t iPixel=threadBegins[iThread]; iPixel<threadBegins[iThread + 1]; ++iPixel) {
+                for (std::size_t iColumn=columnBegins[iPixel]; iColumn<columnBegins[iPixel + 1]; ++iColumn) {
+                    for (std::size_t iEntry=columnOffsets[iColumn]; iEntry<columnOffsets[iColumn + 1]; ++iEntry) {
+                        // Keep entries in the window, and don't mirror the main diagonal.
+                        const std::size_t row = rMatrix.getRow(iEntry);
+                        const std::size_t crossIndex = row - crossBegin;
+                        if (crossCount <= crossIndex || (transpose && row == iColumn + bandBegin)) continue;
+
+                        const std::size_t crossPixel = crossMap(crossIndex);
+                        TPixel* pImageRow = values.data() + (transpose ? iPixel : crossPixel) * rowElements;
+                        const std::size_t imageColumn = transpose ? crossPixel : iPixel;
+                        if constexpr (TAggregation == Aggregation::Count) {
+                            registerPixel<TAggregation,false>(std::monostate(), pImageRow, imageColumn);
+                        } else {
+                            registerPixel<TAggregation,false>(rMatrix.getValue(iEntry), pImageRow, imageColumn);
+                        }
+
+                        if (maybeStatistics.has_value()) {
+                            const double value = TAggregation == Aggregation::Count ? 1.0 : rMatrix.getValue(iEntry);
+                            if (transpose) {
+                                maybeStatistics->insert(iColumn, crossIndex, getMirrorSign(properties) * value);
+                            } else {
+                                maybeStatistics->insert(crossIndex, iColumn, value);
+                            }
+                        }
+                    }
+                } // for iColumn in pixel
+            } // for iPixel in thread
+        });
+    } // for transpose
+
+    return rMatrix.getColumnOffsets().back();
+}
+
+
+/// @brief Sidecar index of a MatrixMarket file sorted by rows.
+/// @details Stores the byte offset of the first entry in every @p rowStride -th
+///          row, and the number of entries before it. Any range of rows can then
+///          be read by seeking to the offsets bounding it, and the number of
+///          entries outside the range is still known for validating the input.
+///          The index is a local cache, so it's stored in native byte order along
+///          with the size and modification time of the file it was built from.
+class RowIndex
+{
+public:
+    struct Checkpoint
+    {
+        std::uint64_t offset;   // <== byte offset of the first entry at or past the row
+        std::uint64_t entry;    // <== number of entries before the row
+    }; // struct Checkpoint
+
+    /// @brief Scan a row-sorted input and index it.
+    static RowIndex build(const std::filesystem::path& rInputPath)
+    {
+        std::ifstream stream(rInputPath, std::ios::binary);
+        if (!stream.good()) {
+            throw IOError(std::format("Error: failed to open input file: {}\n", rInputPath.string()));
+        }
+
+        RowIndex index;
+        Parser parser(stream);
+        const format::Properties properties = parser.getProperties();
+        if (properties.format != format::Format::Coordinate) {
+            throw UnsupportedFormat("Error: only inputs in coordinate format can be indexed\n");
+        }
+
+        index._fileStamp = getFileStamp(rInputPath);
+        index._dataOffset = static_cast<std::uint64_t>(stream.tellg());
+        index._rows = properties.rows.value();
+        index._columns = properties.columns.value();
+        index._nonzeros = properties.nonzeros.value();
+
+        // Aim for at most ~16k checkpoints (256 KiB).
+        index._rowStride = std::max<std::uint64_t>((index._rows + 0x3fff) / 0x4000, 1);
+        const std::size_t checkpointCount = (index._rows + index._rowStride - 1) / index._rowStride + 1;
+        index._checkpoints.reserve(checkpointCount);
+
+        std::uint64_t offset = index._dataOffset;
+        std::uint64_t entryCount = 0;
+        std::size_t lastRow = 0ul;
+        for (auto block=parser.readLines(0x100000); !block.empty(); block=parser.readLines(0x100000)) {
+            const char* itEnd = block.data() + block.size();
+            for (const char* itLine=block.data(); itLine!=itEnd;) {
+                const char* itLineEnd = std::find(itLine, itEnd, '\n') + 1;
+                const char* it = skipBlanks(itLine);
+                if (*it != '\n') {
+                    std::size_t row;
+                    if (!parseIndex(it, itLineEnd, row) || index._rows <= row) {
+                        throw ParsingException(std::format(
+                            "Error: failed to parse entry {}:\n{}\n",
+                            entryCount + 1,
+                            std::string_view(itLine, itLineEnd - 1)
+                        ));
+                    } else if (row < lastRow) {
+                        throw InvalidFormat(std::format(
+                            "Error: entry {} is in row {} after an entry in row {}, but indexed inputs must be sorted by rows\n",
+                            entryCount + 1,
+                            row + 1,
+                            lastRow + 1
+                        ));
+                    }
+
+                    // The entry begins every row range up to its row that hasn't begun yet.
+                    while (index._checkpoints.size() * index._rowStride <= row) {
+                        index._checkpoints.push_back(Checkpoint {offset, entryCount});
+                    }
+                    lastRow = row;
+                    ++entryCount;
+                }
+                offset += static_cast<std::uint64_t>(itLineEnd - itLine);
+                itLine = itLineEnd;
+            }
+        } // for block in input
+
+        if (entryCount != index._nonzeros) {
+            throw ParsingException(std::format(
+                "Expecting {} entries, but read {}\n",
+                index._nonzeros,
+                entryCount
+            ));
+        }
+
+        // Rows past the last entry begin at the end of the file.
+        offset = std::min<std::uint64_t>(offset, index._fileStamp.first);
+        index._checkpoints.resize(checkpointCount, Checkpoint {offset, entryCount});
+        return index;
+    }
+
+    /// @brief Load the index of an input, and check that it's up to date.
+    static RowIndex load(const std::filesystem::path& rIndexPath,
+                         const std::filesystem::path& rInputPath)
+    {
+        std::ifstream file(rIndexPath, std::ios::binary);
+        if (!file.good()) {
+            throw IOError(std::format("Error: failed to open row index: {}\n", rIndexPath.string()));
+        }
+
+        RowIndex index;
+        std::array<char,magic.size()> fileMagic {};
+        std::uint64_t checkpointCount = 0;
+        file.read(fileMagic.data(), fileMagic.size());
+        for (std::uint64_t* pField : {&index._fileStamp.first, &index._fileStamp.second, &index._dataOffset,
+                                      &index._rows, &index._columns, &index._nonzeros,
+                                      &index._rowStride, &checkpointCount}) {
+            file.read(reinterpret_cast<char*>(pField), sizeof(*pField));
+        }
+        if (file.fail() || fileMagic != magic || !index._rowStride
+            || checkpointCount != (index._rows + index._rowStride - 1) / index._rowStride + 1) {
+            throw InvalidFormat(std::format("Error: invalid row index: {}\n", rIndexPath.string()));
+        }
+
+        index._checkpoints.resize(checkpointCount);
+        file.read(reinterpret_cast<char*>(index._checkpoints.data()),
+                  static_cast<std::streamsize>(checkpointCount * sizeof(Checkpoint)));
+        if (file.fail()) {
+            throw InvalidFormat(std::format("Error: truncated row index: {}\n", rIndexPath.string()));
+        }
+
+        if (index._fileStamp != getFileStamp(rInputPath)) {
+            throw InvalidFormat(std::format(
+                "Error: row index {} is out of date; rebuild it with 'mtx2img index {}'\n",
+                rIndexPath.string(),
+                rInputPath.string()
+            ));
+        }
+
+        return index;
+    }
+
+    void write(const std::filesystem::path& rIndexPath) const
+    {
+        std::ofstream file(rIndexPath, std::ios::binary);
+        const std::uint64_t checkpointCount = _checkpoints.size();
+        file.write(magic.data(), magic.size());
+        for (const std::uint64_t* pField : {&_fileStamp.first, &_fileStamp.second, &_dataOffset,
+                                            &_rows, &_columns, &_nonzeros,
+                                            &_rowStride, &checkpointCount}) {
+            file.write(reinterpret_cast<const char*>(pField), sizeof(*pField));
+        }
+        file.write(reinterpret_cast<const char*>(_checkpoints.data()),
+                   static_cast<std::streamsize>(_checkpoints.size() * sizeof(Checkpoint)));
+        if (!file.good()) {
+            throw IOError(std::format("Error: failed to write row index: {}\n", rIndexPath.string()));
+        }
+    }
+
+    /// @brief Indices of the checkpoints bounding a range of rows.
+    std::pair<std::size_t,std::size_t> getCheckpointRange(std::size_t rowBegin, std::size_t rowEnd) const noexcept
+    {
+        return std::make_pair(rowBegin / _rowStride,
+                              std::min<std::size_t>((rowEnd + _rowStride - 1) / _rowStride, _checkpoints.size() - 1));
+    }
+
+    std::span<const Checkpoint> getCheckpoints() const noexcept
+    {
+        return _checkpoints;
+    }
+
+    /// @brief Check whether the index was built from an input with the provided properties.
+    bool matches(const format::Properties& rProperties) const noexcept
+    {
+        return _rows == rProperties.rows.value()
+               && _columns == rProperties.columns.value()
+               && _nonzeros == rProperties.nonzeros.value();
+    }
+
+private:
+    static constexpr std::array<char,8> magic {'M','T','X','2','I','D','X','1'};
+
+    /// @brief Size and modification time of a file.
+    static std::pair<std::uint64_t,std::uint64_t> getFileStamp(const std::filesystem::path& rPath)
+    {
+        return std::make_pair(
+            static_cast<std::uint64_t>(std::filesystem::file_size(rPath)),
+            static_cast<std::uint64_t>(std::filesystem::last_write_time(rPath).time_since_epoch().count())
+        );
+    }
+
+    RowIndex() = default;
+
+    std::pair<std::uint64_t,std::uint64_t> _fileStamp;
+
+    std::uint64_t _dataOffset;
+
+    std::uint64_t _rows;
+
+    std::uint64_t _columns;
+
+    std::uint64_t _nonzeros;
+
+    std::uint64_t _rowStride;
+
+    std::vector<Checkpoint> _checkpoints;
+}; // class RowIndex
+
+
+/// @brief Pixel buffer reused by consecutive conversions on the same thread.
+/// @details Long running processes (such as the render daemon of the executable)
+///          convert lots of matrices, so keeping the largest buffer around saves
+///          allocating it and faulting its pages in for each of them.
+template <class TPixel>
+Buffer<TPixel>& getPixelBuffer()
+{
+    thread_local Buffer<TPixel> buffer;
+    return buffer;
+}
+
+
+/// @brief Distribution of pixel values, gathered in a single pass over the pixel buffer.
+/// @details Nonempty pixels are optionally counted in bins indexed by the exponent and
+///          the leading mantissa bits of their value in single precision. The bins are
+///          therefore spaced logarithmically (with a relative width of 2^-5), and cover
+///          every representable value without having to know their range in advance.
+class PixelDistribution
+{
+public:
+    explicit PixelDistribution(bool withHistogram)
+        : _minValue(std::numeric_limits<double>::max()),
+          _maxValue(std::numeric_limits<double>::lowest()),
+          _minPositive(std::numeric_limits<double>::max()),
+          _nonemptyCount(0ul),
+          _histogram(withHistogram ? binCount : 0ul, 0ul)
+    {}
+
+    /// @brief Gather the distribution of a pixel buffer on @p threadCount threads.
+    template <class TPixel>
+    static PixelDistribution make(std::span<const TPixel> values,
+                                  bool withHistogram,
+                                  std::size_t threadCount)
+    {
+        // Small buffers aren't worth waking threads up for.
+        threadCount = std::clamp<std::size_t>(values.size() / 0x100000, 1ul, std::max(threadCount, 1ul));
+        std::vector<PixelDistribution> distributions(threadCount, PixelDistribution(withHistogram));
+        parallelFor(threadCount, [&](std::size_t iThread){
+            const std::size_t iBegin = iThread * values.size() / threadCount;
+            const std::size_t iEnd = (iThread + 1) * values.size() / threadCount;
+            distributions[iThread].add(values.subspan(iBegin, iEnd - iBegin));
+        });
+
+        for (std::size_t iThread=1ul; iThread<threadCount; ++iThread) {
+            distributions.front().merge(distributions[iThread]);
+        }
+        return std::move(distributions.front());
+    }
+
+    template <class TPixel>
+    MTX2IMG_MULTIVERSION
+    void add(std::span<const TPixel> values) noexcept
+    {
+        if (values.empty()) return;
+
+        if (_histogram.empty()) {
+            const auto [itMin, itMax] = std::minmax_element(values.begin(), values.end());
+            _minValue = std::min<double>(_minValue, *itMin);
+            _maxValue = std::max<double>(_maxValue, *itMax);
+        } else {
+            // Fused min/max reduction and histogram.
+            TPixel minValue = values.front(), maxValue = values.front();
+            TPixel minPositive = std::numeric_limits<TPixel>::max();
+            std::size_t nonemptyCount = 0ul;
+            for (const TPixel value : values) {
+                minValue = std::min(minValue, value);
+                maxValue = std::max(maxValue, value);
+                if (0 < value) {
+                    minPositive = std::min(minPositive, value);
+                    ++_histogram[getBin(static_cast<float>(value))];
+                    ++nonemptyCount;
+                }
+            }
+
+            _minValue = std::min<double>(_minValue, minValue);
+            _maxValue = std::max<double>(_maxValue, maxValue);
+            if (nonemptyCount) _minPositive = std::min<double>(_minPositive, minPositive);
+            _nonemptyCount += nonemptyCount;
+        }
+    }
+
+    void merge(const PixelDistribution& rOther) noexcept
+    {
+        _minValue = std::min(_minValue, rOther._minValue);
+        _maxValue = std::max(_maxValue, rOther._maxValue);
+        _minPositive = std::min(_minPositive, rOther._minPositive);
+        _nonemptyCount += rOther._nonemptyCount;
+        for (std::size_t iBin=0ul; iBin<_histogram.size(); ++iBin) {
+            _histogram[iBin] += rOther._histogram[iBin];
+        }
+    }
+
+    /// @brief Approximate a percentile of the nonempty pixels.
+    /// @details The value is interpolated linearly within the bin it falls in.
+    ///          Requires the histogram.
+    double getPercentile(double percentile) const noexcept
+    {
+        assert(!_histogram.empty());
+        if (!_nonemptyCount || percentile <= 0) {
+            return this->getMinPositive();
+        } else if (100 <= percentile) {
+            return _maxValue;
+        }
+
+        const double rank = percentile / 100 * static_cast<double>(_nonemptyCount);
+        double cumulativeCount = 0;
+        for (std::size_t iBin=0ul; iBin<_histogram.size(); ++iBin) {
+            const double binCount = static_cast<double>(_histogram[iBin]);
+            if (binCount && rank <= cumulativeCount + binCount) {
+                const double lower = std::bit_cast<float>(static_cast<std::uint32_t>(iBin << (23 - mantissaBits)));
+                const double upper = std::bit_cast<float>(static_cast<std::uint32_t>((iBin + 1) << (23 - mantissaBits)));
+                const double value = lower + (rank - cumulativeCount) / binCount * (upper - lower);
+                return std::clamp(value, _minPositive, _maxValue);
+            }
+            cumulativeCount += binCount;
+        }
+        return _maxValue;
+    }
+
+    double getMin() const noexcept {return _minValue;}
+
+    double getMax() const noexcept {return _maxValue;}
+
+    /// @brief Smallest nonempty pixel value (or 0 if there are none). Requires the histogram.
+    double getMinPositive() const noexcept {return _nonemptyCount ? _minPositive : 0.0;}
+
+private:
+    static constexpr unsigned mantissaBits = 5;
+
+    /// @brief Number of bins covering positive finite floats.
+    static constexpr std::size_t binCount = std::size_t(0xff) << mantissaBits;
+
+    static std::size_t getBin(float value) noexcept
+    {
+        // Overflowing sums end up in the last bin.
+        return std::min<std::size_t>(std::bit_cast<std::uint32_t>(value) >> (23 - mantissaBits), binCount - 1);
+    }
+
+    double _minValue;
+
+    double _maxValue;
+
+    double _minPositive;
+
+    std::size_t _nonemptyCount;
+
+    std::vector<std::size_t> _histogram;
+}; // class PixelDistribution
+
+
+/// @brief Check whether there is nothing to render.
+/// @throws ParsingException if a degenerate input claims to have entries.
+bool isEmptyImage(const format::Properties& rProperties,
+                  std::pair<std::size_t,std::size_t> imageSize)
+{
+    // Nothing to do if the input size is null.
+    if (rProperties.rows.value() == 0ul || rProperties.columns.value() == 0ul) {
+        #ifndef NDEBUG
+            std::cout << "mtx2img: nothing to do (degenerate input matrix).\n";
+        #endif
+        if (rProperties.nonzeros.value() == 0ul) {
+            return true;
+        } else {
+            throw ParsingException(std::format(
+                "Error: degenerate input matrix ({}x{}) claims to contain {} nonzeros",
+                rProperties.rows.value(),
+                rProperties.columns.value(),
+                rProperties.nonzeros.value()
+            ));
+        }
+    }
+
+    // Nothing to do if the output size is null
+    if (imageSize.first == 0ul || imageSize.second == 0ul) {
+        #ifndef NDEBUG
+            std::cout << "mtx2img: nothing to do (degenerate output image).\n";
+        #endif
+        return true;
+    }
+
+    return false;
+}
+
+
+/// @brief Check whether a normalization maps pixel values linearly between their extremes.
+bool isDefaultNormalization(const Normalization& rNormalization) noexcept
+{
+    return rNormalization.scale == Scale::Linear
+           && rNormalization.lowPercentile <= 0
+           && 100 <= rNormalization.highPercentile;
+}
+
+
+/// @brief Maps aggregated pixel values to the colors of a colormap.
+/// @details The mapping only depends on the distribution of all pixels of the image,
+///          so any range of the pixel buffer can be painted on its own.
+template <class TPixel>
+class PixelPainter
+{
+public:
+    /// @param rDistribution Distribution of every pixel of the image, with the
+    ///                      histogram unless the normalization is the default one.
+    PixelPainter(const PixelDistribution& rDistribution,
+                 const std::string& rColormapName,
+                 const Normalization& rNormalization)
+        : _colormap(getColormap(rColormapName)),
+          _maxColor(_colormap.empty() ? 0 : _colormap.size() - 1),
+          _minValue(static_cast<TPixel>(rDistribution.getMin())),
+          _maxValue(static_cast<TPixel>(rDistribution.getMax())),
+          _isLinear(isDefaultNormalization(rNormalization)),
+          _isLogarithmic(rNormalization.scale == Scale::Logarithmic),
+          _lowValue(0),
+          _highValue(0),
+          _logLow(0),
+          _logRange(0),
+          _firstColor(_maxColor ? 1.0 / _maxColor : 1.0)
+    {
+        if (!_isLinear) {
+            // Clip values to the requested percentiles, then map them
+            // to a relative intensity in [0, 1].
+            // Note: the logarithmic scale maps the lowest nonempty value to the
+            //       first color after the background, so that it stays visible.
+            _lowValue = 0 < rNormalization.lowPercentile
+                        ? rDistribution.getPercentile(rNormalization.lowPercentile)
+                        : (_isLogarithmic ? rDistribution.getMinPositive() : rDistribution.getMin());
+            _highValue = rNormalization.highPercentile < 100
+                         ? rDistribution.getPercentile(rNormalization.highPercentile)
+                         : rDistribution.getMax();
+            _logLow = std::log(_lowValue);
+            _logRange = std::log(_highValue) - _logLow;
+        }
+    }
+
+    /// @brief Check whether all pixels hold the same value, which leaves the image blank.
+    bool isBlank() const noexcept
+    {
+        return _minValue == _maxValue;
+    }
+
+    /// @brief Paint a range of pixels into the corresponding range of an RGB image.
+    MTX2IMG_MULTIVERSION
+    void operator()(std::span<const TPixel> values, std::span<unsigned char> image) const
+    {
+        assert(image.size() == CHANNELS * values.size());
+
+        // Note: narrow pixel types are promoted before normalization
+        //       to avoid overflows in the intermediate products.
+        using Intensity = std::conditional_t<std::is_integral_v<TPixel>,std::size_t,double>;
+        const std::size_t maxColor = _maxColor;
+        const auto paint = [this, &image](std::size_t iPixel, std::size_t intensity) {
+            const auto& rColor = _colormap[intensity];
+            const std::size_t iImageBegin = CHANNELS * iPixel;
+            for (std::size_t iComponent=0; iComponent<CHANNELS; ++iComponent) {
+                image[iImageBegin + iComponent] = rColor[iComponent];
+            }
+        };
+
+        if (_isLinear) {
+            const Intensity range = static_cast<Intensity>(_maxValue) - static_cast<Intensity>(_minValue);
+            for (std::size_t iPixel=0ul; iPixel<values.size(); ++iPixel) {
+                const Intensity shifted = static_cast<Intensity>(std::max(values[iPixel], _minValue)) - static_cast<Intensity>(_minValue);
+                paint(iPixel, std::min<std::size_t>(
+                    maxColor,
+                    static_cast<std::size_t>(static_cast<Intensity>(maxColor) - maxColor * shifted / range)
+                ));
+            }
+        } else {
+            for (std::size_t iPixel=0ul; iPixel<values.size(); ++iPixel) {
+                const double relativeIntensity = this->getRelativeIntensity(static_cast<double>(values[iPixel]));
+                paint(iPixel, std::min<std::size_t>(
+                    maxColor,
+                    static_cast<std::size_t>(maxColor - maxColor * relativeIntensity)
+                ));
+            }
+        }
+    }
+
+private:
+    double getRelativeIntensity(double value) const noexcept
+    {
+        if (_isLogarithmic) {
+            if (value <= 0) return 0;
+            if (_highValue <= _lowValue) return 1;
+            const double clipped = std::clamp(value, _lowValue, _highValue);
+            return _firstColor + (1 - _firstColor) * (std::log(clipped) - _logLow) / _logRange;
+        } else {
+            if (_highValue <= _lowValue) return _lowValue < value ? 1 : 0;
+            return (std::clamp(value, _lowValue, _highValue) - _lowValue) / (_highValue - _lowValue);
+        }
+    }
+
+    const std::vector<std::array<unsigned char, CHANNELS>>& _colormap;
+
+    std::size_t _maxColor;
+
+    TPixel _minValue;
+
+    TPixel _maxValue;
+
+    bool _isLinear;
+
+    bool _isLogarithmic;
+
+    double _lowValue;
+
+    double _highValue;
+
+    double _logLow;
+
+    double _logRange;
+
+    double _firstColor;
+}; // class PixelPainter
+
+
+/// @brief Type of the pixel values stored in a partial render.
+enum class PartialPixel : std::uint64_t
+{
+    UInt8,
+    UInt16,
+    UInt32,
+    Float
+}; // enum class PartialPixel
+
+
+template <class TPixel>
+constexpr PartialPixel getPartialPixel() noexcept
+{
+    if constexpr (std::is_same_v<TPixel,std::uint8_t>) {
+        return PartialPixel::UInt8;
+    } else if constexpr (std::is_same_v<TPixel,std::uint16_t>) {
+        return PartialPixel::UInt16;
+    } else if constexpr (std::is_same_v<TPixel,std::uint32_t>) {
+        return PartialPixel::UInt32;
+    } else {
+        static_assert(std::is_same_v<TPixel,float>, "Error: unsupported pixel type");
+        return PartialPixel::Float;
+    }
+}
+
+
+/// @brief Header of a partial render: the pixel buffer of a render before it's colored (see @ref mergePartials).
+/// @details Partial files hold a magic, the fields of the header as native 64 bit integers,
+///          and the pixel values row by row, in the native layout of their type.
+struct PartialHeader
+{
+    std::uint64_t rows;         // <== of the (permuted) matrix
+    std::uint64_t columns;
+    std::uint64_t rowBegin;     // <== resolved window
+    std::uint64_t rowEnd;
+    std::uint64_t columnBegin;
+    std::uint64_t columnEnd;
+    std::uint64_t width;        // <== image size
+    std::uint64_t height;
+    std::uint64_t aggregation;
+    std::uint64_t pixel;        // <== PartialPixel
+
+    static constexpr std::array<char,8> magic {'M','T','X','2','A','C','C','1'};
+
+    static PartialHeader read(std::istream& rStream, const std::filesystem::path& rPath)
+    {
+        PartialHeader header;
+        std::array<char,magic.size()> fileMagic {};
+        rStream.read(fileMagic.data(), fileMagic.size());
+        for (std::uint64_t* pField : getFields(header)) {
+            rStream.read(reinterpret_cast<char*>(pField), sizeof(*pField));
+        }
+        if (rStream.fail() || fileMagic != magic
+            || static_cast<std::uint64_t>(Aggregation::Max) < header.aggregation
+            || static_cast<std::uint64_t>(PartialPixel::Float) < header.pixel
+            || (header.aggregation == static_cast<std::uint64_t>(Aggregation::Count))
+               == (header.pixel == static_cast<std::uint64_t>(PartialPixel::Float))) {
+            throw InvalidFormat(std::format("Error: invalid partial render: {}\n", rPath.string()));
+        }
+        return header;
+    }
+
+    void write(std::ostream& rStream) const
+    {
+        rStream.write(magic.data(), magic.size());
+        for (const std::uint64_t* pField : getFields(*this)) {
+            rStream.write(reinterpret_cast<const char*>(pField), sizeof(*pField));
+        }
+    }
+
+    /// @brief Check whether two partials render the same window of the same matrix into the same pixels.
+    bool isCompatible(const PartialHeader& rOther) const noexcept
+    {
+        return rows == rOther.rows && columns == rOther.columns
+               && rowBegin == rOther.rowBegin && rowEnd == rOther.rowEnd
+               && columnBegin == rOther.columnBegin && columnEnd == rOther.columnEnd
+               && width == rOther.width && height == rOther.height
+               && aggregation == rOther.aggregation;
+    }
+
+private:
+    template <class THeader>
+    using Field = std::conditional_t<std::is_const_v<THeader>,const std::uint64_t,std::uint64_t>;
+
+    template <class THeader>
+    static std::array<Field<THeader>*,10> getFields(THeader& rHeader) noexcept
+    {
+        return {&rHeader.rows, &rHeader.columns,
+                &rHeader.rowBegin, &rHeader.rowEnd,
+                &rHeader.columnBegin, &rHeader.columnEnd,
+                &rHeader.width, &rHeader.height,
+                &rHeader.aggregation, &rHeader.pixel};
+    }
+}; // struct PartialHeader
+
+
+/// @brief Write the pixel buffer of a render to a stream before it's colored (see @ref PartialHeader).
+class PartialWriter
+{
+public:
+    PartialWriter(std::ostream& rStream,
+                  const format::Properties& rProperties,
+                  const Window& rWindow,
+                  std::pair<std::size_t,std::size_t> imageSize,
+                  Aggregation aggregation)
+        : _rStream(rStream),
+          _header {rProperties.rows.value(), rProperties.columns.value(),
+                   rWindow.rowBegin, rWindow.rowEnd, rWindow.columnBegin, rWindow.columnEnd,
+                   imageSize.first, imageSize.second,
+                   static_cast<std::uint64_t>(aggregation), 0}
+    {}
+
+    template <class TPixel>
+    void write(std::span<const TPixel> values) const
+    {
+        PartialHeader header = _header;
+        header.pixel = static_cast<std::uint64_t>(getPartialPixel<TPixel>());
+        header.write(_rStream);
+        _rStream.write(reinterpret_cast<const char*>(values.data()),
+                       static_cast<std::streamsize>(values.size() * sizeof(TPixel)));
+        if (!_rStream.good()) {
+            throw IOError("Error: failed to write partial render\n");
+        }
+    }
+
+private:
+    std::ostream& _rStream;
+
+    PartialHeader _header;
+}; // class PartialWriter
+
+
+/// @brief Map the entries of an input to a zeroed pixel buffer, and mirror the missing triangle of symmetric inputs.
+/// @param rAccumulate Functor that maps the entries of the input to pixels (see @ref fill).
+/// @throws ParsingException if the number of entries read doesn't match the header.
+template <Aggregation TAggregation, class TPixel, class TAccumulate>
+void accumulate(const format::Properties& rProperties,
+                std::span<TPixel> values,
+                std::pair<std::size_t,std::size_t> imageSize,
+                StructureCollector* pCollector,
+                TAccumulate&& rAccumulate)
+{
+    const std::optional<format::Structure> maybeStructure = rProperties.structure;
+
+    // Read the input and map its entries to pixels.
+    const std::size_t entryCount = rAccumulate.template operator()<TAggregation>(values,
+                                                                                 imageSize,
+                                                                                 pCollector);
+
+    // Check the read number of entries
+    if (entryCount != rProperties.nonzeros.value()) {
+        throw ParsingException(std::format(
+            "Expecting {} entries, but read {}\n",
+            rProperties.nonzeros.value(),
+            entryCount
+        ));
+    }
+
+    // If the input was provided in symmetric format, the entries
+    // read so far were limited to the main diagonal and the lower
+    // triangle, so the upper triangle must be filled in separately.
+    // Note: pixels hold counts or magnitudes, so skewness doesn't
+    //       change the mirrored values.
+    if (maybeStructure.has_value()) {
+        std::span<TPixel> valueRange(values);
+        switch (maybeStructure.value()) {
+            case format::Structure::General: break; // <== nothing to do
+            case format::Structure::Symmetric:
+                fillSymmetricPart(valueRange,
+                                  imageSize,
+                                  [](auto v){return v;});
+                break;
+            case format::Structure::SkewSymmetric:
+                fillSymmetricPart(valueRange,
+                                  imageSize,
+                                  [](auto v){return v;});
+                break;
+            case format::Structure::Hermitian:
+                fillSymmetricPart(valueRange,
+                                  imageSize,
+                                  [](auto v){return v;});
+                break;
+            default: throw std::runtime_error("Error: missing fill strategy implementation for input matrix structure.");
+        }
+    }
+}
+
+
+/// @brief Apply a colormap to a buffer of aggregated pixel values.
+template <class TPixel>
+void paint(std::span<const TPixel> values,
+           std::span<unsigned char> image,
+           const std::string& rColormapName,
+           const Normalization& rNormalization,
+           std::size_t threadCount)
+{
+    const std::size_t pixelCount = values.size();
+    assert(image.size() == pixelCount * CHANNELS);
+
+    // Gather the range of pixel values, along with their distribution if the
+    // normalization needs more than the extreme values.
+    const bool isLinear = isDefaultNormalization(rNormalization);
+    const PixelDistribution distribution = PixelDistribution::make(values,
+                                                                   !isLinear,
+                                                                   threadCount);
+    const PixelPainter<TPixel> painter(distribution, rColormapName, rNormalization);
+
+    #ifndef NDEBUG
+        std::cout << std::format("mtx2img: highest aggregate value per pixel is {}\n", distribution.getMax());
+    #endif
+
+    // No need to map pixels to colors if no entries were read.
+    if (painter.isBlank()) {
+        parallelFill(image, static_cast<unsigned char>(0xff), threadCount);
+        return;
+    }
+
+    // Apply the colormap and fill the image buffer
+    // Note: this is the first pass over the image, so splitting it between
+    //       threads spreads its page faults (see @ref parallelFill) on top
+    //       of the logarithms of non-linear normalizations.
+    const std::size_t colorThreads = std::clamp<std::size_t>(pixelCount / 0x100000, 1ul, std::max(threadCount, 1ul));
+    parallelFor(colorThreads, [&](std::size_t iThread){
+        const std::size_t iBegin = iThread * pixelCount / colorThreads;
+        const std::size_t iEnd = (iThread + 1) * pixelCount / colorThreads;
+        painter(values.subspan(iBegin, iEnd - iBegin),
+                image.subspan(CHANNELS * iBegin, CHANNELS * (iEnd - iBegin)));
+    });
+}
+
+
+/// @brief Mark the pixels with a nonzero aggregate in a bit-packed image (see @ref isBitPacked).
+/// @details Pixels aggregate counts or magnitudes, so these are exactly the pixels holding
+///          nonzero entries, whatever their values and the normalization. Whole bytes are
+///          assigned, so @p bits doesn't need to be cleared.
+/// @param values Aggregated pixel values of whole image rows.
+template <class TPixel>
+void markNonzeros(std::span<const TPixel> values,
+                  std::span<unsigned char> bits,
+                  std::size_t imageWidth,
+                  std::size_t threadCount)
+{
+    const std::size_t rowBytes = getRowElements<Occupancy>(imageWidth);
+    const std::size_t rowCount = values.size() / imageWidth;
+    assert(values.size() == rowCount * imageWidth);
+    assert(bits.size() == rowCount * rowBytes);
+
+    const std::size_t markThreads = std::clamp<std::size_t>(values.size() / 0x100000, 1ul, std::max(threadCount, 1ul));
+    parallelFor(markThreads, [&](std::size_t iThread){
+        const std::size_t iRowEnd = (iThread + 1) * rowCount / markThreads;
+        for (std::size_t iRow=iThread * rowCount / markThreads; iRow<iRowEnd; ++iRow) {
+            const TPixel* pRow = values.data() + iRow * imageWidth;
+            for (std::size_t iByte=0ul; iByte<rowBytes; ++iByte) {
+                unsigned char byte = 0;
+                const std::size_t iColumnEnd = std::min(8 * iByte + 8, imageWidth);
+                for (std::size_t iColumn=8 * iByte; iColumn<iColumnEnd; ++iColumn) {
+                    if (pRow[iColumn] != TPixel(0)) {
+                        byte |= static_cast<unsigned char>(0x80u >> (iColumn % 8));
+                    }
+                }
+                bits[iRow * rowBytes + iByte] = byte;
+            }
+        }
+    });
+}
+
+
+/// @brief Aggregate matrix entries into pixels and apply the colormap.
+/// @details Bit-packed images mark the pixels with a nonzero aggregate instead (see @ref markNonzeros).
+/// @param pCollector Forwarded to @p rAccumulate (may be null).
+/// @param pPartial Gets the aggregated pixel values before they're colored, if not null.
+/// @param rAccumulate Functor that maps the entries of the input to pixels
+///                    and returns the number of entries it read. It's invoked
+///                    as @p rAccumulate.operator()<TAggregation>(values,imageSize,pCollector).
+template <Aggregation TAggregation, class TPixel, class TAccumulate>
+void fill(const format::Properties& rProperties,
+          std::span<unsigned char> image,
+          std::pair<std::size_t,std::size_t> imageSize,
+          const std::string& rColormapName,
+          const Normalization& rNormalization,
+          std::size_t threadCount,
+          StructureCollector* pCollector,
+          const PartialWriter* pPartial,
+          TAccumulate&& rAccumulate)
+{
+    // Check image buffer size
+    const std::size_t pixelCount = imageSize.first * imageSize.second;
+    const bool isBinary = isBitPacked(rColormapName);
+    assert(image.size() == (isBinary ? getRowElements<Occupancy>(imageSize.first) * imageSize.second
+                                     : pixelCount * CHANNELS));
+
+    // A buffer for mapping regions in the matrix to each pixel.
+    // Its value type is chosen by the caller to be as narrow as possible
+    // (see getMaxEntriesPerPixel) to reduce the memory traffic of the
+    // random access updates.
+    Buffer<TPixel>& values = getPixelBuffer<TPixel>();
+    if (isEmptyImage(rProperties, imageSize)) {
+        if (pPartial) {
+            assignZeros(values, pixelCount, threadCount);
+            pPartial->write(std::span<const TPixel>(values));
+        }
+        parallelFill(image, static_cast<unsigned char>(isBinary ? 0x00 : 0xff), threadCount);
+        return;
+    }
+
+    assignZeros(values, pixelCount, threadCount);
+    accumulate<TAggregation>(rProperties, std::span<TPixel>(values), imageSize, pCollector, rAccumulate);
+    if (pPartial) {
+        pPartial->write(std::span<const TPixel>(values));
+    }
+
+    if (isBinary) {
+        markNonzeros(std::span<const TPixel>(values), image, imageSize.first, threadCount);
+    } else {
+        paint(std::span<const TPixel>(values), image, rColormapName, rNormalization, threadCount);
+    }
+}
+
+
+/// @brief Mirror the lower triangle of a square bit-packed image to its upper triangle.
+void fillSymmetricOccupancy(std::span<Occupancy> bits, std::size_t imageWidth)
+{
+    const std::size_t rowBytes = getRowElements<Occupancy>(imageWidth);
+    std::uint8_t* pBytes = reinterpret_cast<std::uint8_t*>(bits.data());
+    assert(bits.size() == rowBytes * imageWidth);
+
+    for (std::size_t iRow=0ul; iRow<imageWidth; ++iRow) {
+        const std::uint8_t* pRow = pBytes + iRow * rowBytes;
+        const std::uint8_t rowMask = static_cast<std::uint8_t>(0x80u >> (iRow % 8));
+        for (std::size_t iByte=0ul; 8 * iByte<iRow; ++iByte) {
+            // Visit the set bits left of the diagonal.
+            for (std::uint8_t byte=pRow[iByte]; byte; ) {
+                const std::size_t iBit = static_cast<std::size_t>(std::countl_zero(byte));
+                byte = static_cast<std::uint8_t>(byte & ~(0x80u >> iBit));
+                const std::size_t iColumn = 8 * iByte + iBit;
+                if (iRow <= iColumn) break;
+                pBytes[iColumn * rowBytes + iRow / 8] |= rowMask;
+            }
+        }
+    }
+}
+
+
+/// @brief Mark the pixels holding entries in a bit-packed image.
+/// @details The colors of the binary colormap only depend on which pixels hold entries,
+///          so entries are scattered straight into the bit-packed output image, instead
+///          of aggregating them in a pixel buffer and coloring a 3 byte per pixel image.
+///          Entries with a zero value don't mark their pixel with the sum and max aggregations.
+/// @param rAccumulate Functor that maps the entries of the input to pixels (see @ref fill),
+///                    invoked with a span of @ref Occupancy.
+template <Aggregation TAggregation, class TAccumulate>
+void fillOccupancy(const format::Properties& rProperties,
+                   Image& rImage,
+                   std::pair<std::size_t,std::size_t> imageSize,
+                   StructureCollector* pCollector,
+                   TAccumulate&& rAccumulate)
+{
+    // Fresh images are zero already, so only the pages entries are marked on get faulted in here.
+    assert(rImage.empty());
+    rImage.resize(getRowElements<Occupancy>(imageSize.first) * imageSize.second);
+    if (isEmptyImage(rProperties, imageSize)) {
+        return;
+    }
+
+    // Read the input and mark the pixels its entries map to.
+    const std::span<Occupancy> bits(reinterpret_cast<Occupancy*>(rImage.data()), rImage.size());
+    const std::size_t entryCount = rAccumulate.template operator()<TAggregation>(bits,
+                                                                                 imageSize,
+                                                                                 pCollector);
+
+    // Check the read number of entries
+    if (entryCount != rProperties.nonzeros.value()) {
+        throw ParsingException(std::format(
+            "Expecting {} entries, but read {}\n",
+            rProperties.nonzeros.value(),
+            entryCount
+        ));
+    }
+
+    // Skewness and conjugation don't change which pixels hold entries.
+    if (rProperties.structure.value_or(format::Structure::General) != format::Structure::General) {
+        fillSymmetricOccupancy(bits, imageSize.first);
+    }
+}
+
+
+/// @brief Check whether the properties of an input are supported.
+void validateProperties(const format::Properties& rProperties)
+{
+    // Validate object type
+    if (rProperties.object.has_value()) {
+        switch (rProperties.object.value()) {
+            case format::Object::Matrix: break; // <== ok
+            case format::Object::Vector: throw UnsupportedFormat("Error: vector input is not supported yet\n"); // <== @todo
+            default: throw UnsupportedFormat("Error: unsupported input object type\n");
+        }
+    } else {
+        throw ParsingException("Error: missing input object type specifier\n");
+    }
+
+    // Validate format type
+    if (rProperties.format.has_value()) {
+        switch (rProperties.format.value()) {
+            case format::Format::Coordinate: break; // <== ok
+            case format::Format::Array: break; // <== ok
+            default: throw UnsupportedFormat("Error: unsupported input format type\n");
+        }
+    } else {
+        throw ParsingException("Error: missing input format type specifier\n");
+    }
+
+    // Validate data type (optional qualifier - no error if missing)
+    if (rProperties.data.has_value()) {
+        switch (rProperties.data.value()) {
+            case format::Data::Real: break;     // <== ok
             case format::Data::Integer: break;  // <== ok
             case format::Data::Complex: break;  // <== ok
             case format::Data::Pattern: break;  // <== ok
@@ -852,70 +4600,1017 @@ std::vector<unsigned char> convert(std::istream& rStream,
     }
 
     // Validate object structure (optional qualifier - no error if missing)
-    if (inputProperties.structure.has_value()) {
-        switch (inputProperties.structure.value()) {
+    if (rProperties.structure.has_value()) {
+        switch (rProperties.structure.value()) {
             case format::Structure::General: break;         // <== ok
             case format::Structure::Symmetric: break;       // <== ok
             case format::Structure::SkewSymmetric: break;   // <== ok
             case format::Structure::Hermitian: break;       // <== ok
             default: throw UnsupportedFormat("Error: unsupported input object format.\n");
         }
+
+        // Symmetric matrices must be square.
+        if (rProperties.structure.value() != format::Structure::General
+            && rProperties.rows.value() != rProperties.columns.value()) {
+            throw InvalidFormat(std::format(
+                "Error: input is declared symmetric, but it is not square ({}x{})\n",
+                rProperties.rows.value(),
+                rProperties.columns.value()
+            ));
+        }
+    }
+}
+
+
+/// @brief Check whether the percentile range of a normalization is valid.
+void validateNormalization(const Normalization& rNormalization)
+{
+    if (!(0 <= rNormalization.lowPercentile
+          && rNormalization.lowPercentile < rNormalization.highPercentile
+          && rNormalization.highPercentile <= 100)) {
+        throw std::invalid_argument(std::format(
+            "Error: invalid percentile range for normalization: {}:{}\n",
+            rNormalization.lowPercentile,
+            rNormalization.highPercentile
+        ));
+    }
+}
+
+
+/// @brief Restrict the requested image size to the dimensions of the input matrix.
+void fitImageSize(const format::Properties& rProperties,
+                  std::size_t& rImageWidth,
+                  std::size_t& rImageHeight)
+{
+    #ifndef NDEBUG
+        // Print changes to the output dimension in debug mode
+        const std::pair<std::size_t,std::size_t> requestedImageSize {rImageWidth, rImageHeight};
+    #endif
+
+    // Preserve the aspect ratio of the input matrix (as much as possible),
+    // by restricting the resolution of the output image corresponding to the
+    // shorter dimension.
+    if (rProperties.columns.value() < rProperties.rows.value()) {
+        rImageWidth = std::max(rProperties.columns.value() * rImageWidth / rProperties.rows.value(), 1ul);
+    } else {
+        rImageHeight = std::max(rProperties.rows.value() * rImageHeight / rProperties.columns.value(), 1ul);
+    }
+
+    // Restrict output image size
+    if (rProperties.columns.value() < rImageWidth) {
+        rImageWidth = rProperties.columns.value();
+        rImageHeight = std::max(rProperties.rows.value() * rProperties.columns.value() / rImageWidth, 1ul);
+    }
+
+    if (rProperties.rows.value() < rImageHeight) {
+        rImageHeight = rProperties.rows.value();
+        rImageWidth = std::max(rProperties.columns.value() * rProperties.rows.value() / rImageHeight, 1ul);
+    }
+
+    #ifndef NDEBUG
+        // Print changes to the output dimension in debug mode
+        if (rImageWidth != requestedImageSize.first || rImageHeight != requestedImageSize.second) {
+            std::cout << std::format("mtx2img: restrict output image size from {}x{} to {}x{}\n",
+                requestedImageSize.first,
+                requestedImageSize.second,
+                rImageWidth,
+                rImageHeight
+            );
+        }
+    #endif
+}
+
+
+/// @brief Validate the input, fit the output image to the window and fill the image.
+/// @param rWindow Window resolved against the input (see @ref resolveWindow).
+/// @param pStatistics Structure of the matrix in the window, if not null. It's gathered
+///                    by @p rAccumulate, which gets a @ref StructureCollector for it.
+/// @param pPartial Gets the pixel values before they're colored, if not null (see @ref PartialHeader).
+/// @param rAccumulate Functor that maps the entries of the input to pixels (see @ref fill).
+template <class TAccumulate>
+Image makeImage(const format::Properties& rInputProperties,
+                const Window& rWindow,
+                std::size_t& rImageWidth,
+                std::size_t& rImageHeight,
+                const Aggregation aggregation,
+                const std::string& rColormapName,
+                const Normalization& rNormalization,
+                std::size_t threadCount,
+                Statistics* pStatistics,
+                std::ostream* pPartial,
+                TAccumulate&& rAccumulate)
+{
+    Image image;
+    validateProperties(rInputProperties);
+    validateNormalization(rNormalization);
+
+    // Everything from here on sees the submatrix in the window only.
+    const format::Properties properties = getWindowProperties(rInputProperties, rWindow);
+    fitImageSize(properties, rImageWidth, rImageHeight);
+    const std::pair<std::size_t,std::size_t> imageSize {rImageWidth, rImageHeight};
+
+    std::optional<StructureCollector> maybeCollector;
+    if (pStatistics) {
+        maybeCollector.emplace(rInputProperties, rWindow, aggregation != Aggregation::Count, 1ul < threadCount);
+    }
+
+    std::optional<PartialWriter> maybePartial;
+    if (pPartial) {
+        maybePartial.emplace(*pPartial, rInputProperties, rWindow, imageSize, aggregation);
+    }
+
+    // The binary colormap only tells which pixels hold entries, so those are marked
+    // in a bit-packed image directly (except for dense inputs, which are nearly
+    // full anyway, and partial renders, which keep the pixel values for merging
+    // them later). The others mark the pixels with a nonzero aggregate, which are
+    // the same pixels, so writing a partial doesn't change the image.
+    const bool isBinary = isBitPacked(rColormapName);
+    if (isBinary
+        && !pPartial
+        && properties.format.value() != format::Format::Array) {
+        switch (aggregation) {
+            #define MTX2IMG_FILL_OCCUPANCY(AGGREGATION) \
+                fillOccupancy<AGGREGATION>(properties, image, imageSize, maybeCollector ? &maybeCollector.value() : nullptr, rAccumulate)
+            case Aggregation::Count:    MTX2IMG_FILL_OCCUPANCY(Aggregation::Count); break;
+            case Aggregation::Sum:      MTX2IMG_FILL_OCCUPANCY(Aggregation::Sum);   break;
+            case Aggregation::Max:      MTX2IMG_FILL_OCCUPANCY(Aggregation::Max);   break;
+            #undef MTX2IMG_FILL_OCCUPANCY
+            default:
+                throw std::runtime_error(std::format(
+                    "Error: missing implementation for aggregation {}\n",
+                    (int)aggregation
+                ));
+        }
+
+        if (pStatistics) {
+            *pStatistics = maybeCollector->finish();
+        }
+        return image;
+    }
+
+    // Resize image buffer to final size
+    // Note: the image is left untouched here, so that its pages are faulted in by
+    //       the threads painting it (see @ref fill).
+    image.resize(isBinary ? getRowElements<Occupancy>(imageSize.first) * imageSize.second
+                          : imageSize.first * imageSize.second * CHANNELS);
+
+    // Read the input and fill the output image buffer
+    // Note: the pixel type of counting aggregations is picked from the
+    //       number of entries that can possibly map to the same pixel.
+    //       Sums and maxima are accumulated in single precision, since
+    //       the final colors are quantized to at most 256 levels anyway.
+    const std::size_t maxEntriesPerPixel = getMaxEntriesPerPixel(properties, imageSize);
+    switch (aggregation) {
+        #define MTX2IMG_FILL(AGGREGATION, PIXEL)                                                \
+            fill<AGGREGATION,PIXEL>(properties,         /* input matrix properties      */  \
+                              image,                        /* buffer                       */  \
+                              imageSize,                    /* buffer dimensions            */  \
+                              rColormapName,                /* name of the colormap to use  */  \
+                              rNormalization,               /* colormap normalization       */  \
+                              threadCount,                  /* threads for the pixel passes */  \
+                              maybeCollector ? &maybeCollector.value() : nullptr,                 \
+                              maybePartial ? &maybePartial.value() : nullptr,                     \
+                              rAccumulate)                  /* input reader                 */
+        case Aggregation::Count:
+            if (maxEntriesPerPixel <= std::numeric_limits<std::uint8_t>::max()) {
+                MTX2IMG_FILL(Aggregation::Count, std::uint8_t);
+            } else if (maxEntriesPerPixel <= std::numeric_limits<std::uint16_t>::max()) {
+                MTX2IMG_FILL(Aggregation::Count, std::uint16_t);
+            } else {
+                MTX2IMG_FILL(Aggregation::Count, std::uint32_t);
+            }
+            break;
+        case Aggregation::Sum:      MTX2IMG_FILL(Aggregation::Sum, float);  break;
+        case Aggregation::Max:      MTX2IMG_FILL(Aggregation::Max, float);  break;
+        #undef MTX2IMG_FILL
+        default:
+            throw std::runtime_error(std::format(
+                "Error: missing implementation for aggregation {}\n",
+                (int)aggregation
+            ));
+    }
+
+    if (pStatistics) {
+        *pStatistics = maybeCollector->finish();
+    }
+
+    return image;
+}
+
+
+bool isBitPacked(const std::string& rColormapName)
+{
+    return rColormapName == "binary";
+}
+
+
+/// @brief Number of leading entries the block size of an input is detected from (see @ref detectBlockSize).
+constexpr std::size_t blockSampleSize = 0x4000ul;
+
+
+/// @brief Largest block size @ref detectBlockSize reports.
+constexpr std::size_t maxBlockSize = 64ul;
+
+
+/// @brief Detect the size of the dense square blocks the leading entries of an input are made of.
+/// @details Entries of a matrix assembled from dense b x b blocks (e.g.: finite element matrices
+///          with b degrees of freedom per node) form runs of consecutive columns that start and end
+///          on multiples of b, and each group of b consecutive rows shares the same columns. The
+///          block size is the greatest common divisor of all run and row group boundaries in the
+///          complete rows of the sample.
+/// @return The detected block size, or 1 if the sample is not sorted by rows or has no block structure.
+template <class TValue>
+std::size_t detectBlockSize(std::span<const std::pair<std::unique_ptr<EntryBatch<TValue>>,std::size_t>> batches)
+{
+    std::vector<std::pair<std::size_t,std::size_t>> entries;
+    for (const auto& [rpBatch, batchSize] : batches) {
+        for (std::size_t iEntry=0ul; iEntry<batchSize; ++iEntry) {
+            if (!entries.empty() && rpBatch->rows[iEntry] < entries.back().first) return 1ul;
+            entries.emplace_back(rpBatch->rows[iEntry], rpBatch->columns[iEntry]);
+        }
+    }
+
+    // The last row may continue past the sample.
+    if (entries.empty()) return 1ul;
+    const std::size_t lastRow = entries.back().first;
+    std::erase_if(entries, [lastRow](const auto& rEntry) {return rEntry.first == lastRow;});
+    if (entries.empty()) return 1ul;
+    std::sort(entries.begin(), entries.end());
+    entries.erase(std::unique(entries.begin(), entries.end()), entries.end());
+
+    std::size_t divisor = 0ul;
+    std::vector<std::size_t> columns, previousColumns;
+    std::optional<std::size_t> maybePreviousRow;
+    for (auto itEntry=entries.begin(); itEntry!=entries.end();) {
+        const std::size_t row = itEntry->first;
+        columns.clear();
+        for (; itEntry!=entries.end() && itEntry->first == row; ++itEntry) {
+            columns.push_back(itEntry->second);
+        }
+
+        // Boundaries of runs of consecutive columns.
+        std::size_t runBegin = columns.front();
+        for (std::size_t iColumn=1ul; iColumn<=columns.size(); ++iColumn) {
+            if (iColumn == columns.size() || columns[iColumn] != columns[iColumn - 1] + 1) {
+                divisor = std::gcd(divisor, std::gcd(runBegin, columns[iColumn - 1] + 1));
+                if (iColumn < columns.size()) runBegin = columns[iColumn];
+            }
+        }
+
+        // Boundaries of groups of rows sharing their columns.
+        if (!maybePreviousRow.has_value()) {
+            divisor = std::gcd(divisor, row);
+        } else if (*maybePreviousRow + 1 != row || columns != previousColumns) {
+            divisor = std::gcd(divisor, std::gcd(*maybePreviousRow + 1, row));
+        }
+
+        maybePreviousRow = row;
+        columns.swap(previousColumns);
+    }
+
+    return (2ul <= divisor && divisor <= maxBlockSize) ? divisor : 1ul;
+}
+
+
+/// @brief Aggregates the entries of each block row in a small staging buffer before merging them into the pixel buffer.
+/// @details Entries of a block row of a row sorted input map to few distinct pixels (usually
+///          a single image row), which the entries of each of its matrix rows visit in the same
+///          order. Pixels are staged sorted by their position, and a cursor that restarts on
+///          each matrix row finds the pixel of the next entry in one or two comparisons, so
+///          the pixel buffer is only touched once per pixel and block row instead of once per entry.
+///          Consecutive block rows within the same image row share the stage.
+template <Aggregation TAggregation, class TPixel>
+class BlockScatter
+{
+public:
+    /// @brief Number of pixels staged before they're merged into the pixel buffer regardless of the block row.
+    static constexpr std::size_t stageCapacity = 0x1000ul;
+
+    BlockScatter(std::span<TPixel> values,
+                 std::pair<std::size_t,std::size_t> imageSize,
+                 std::size_t blockSize)
+        : _values(values),
+          _imageWidth(imageSize.first),
+          _rowElements(getRowElements<TPixel>(imageSize.first)),
+          _blockSize(blockSize),
+          _blockRow(std::numeric_limits<std::size_t>::max()),
+          _row(std::numeric_limits<std::size_t>::max()),
+          _imageRow(std::numeric_limits<std::size_t>::max()),
+          _cursor(0ul),
+          _stage()
+    {
+        _stage.reserve(stageCapacity);
+    }
+
+    /// @param row Row of the entry in the matrix.
+    void insert(std::size_t row,
+                std::size_t imageRow,
+                std::size_t imageColumn,
+                ParsedValue<TAggregation> value)
+    {
+        // Pixels of a block row are merged once it ends and the image moves on
+        // to the next row, which is only checked when the matrix row changes.
+        if (row != _row) [[unlikely]] {
+            if (row / _blockSize != _blockRow && imageRow != _imageRow) {
+                this->flush();
+            }
+            _blockRow = row / _blockSize;
+            _row = row;
+            _imageRow = imageRow;
+            _cursor = 0ul;
+        }
+
+        const std::size_t offset = imageRow * _imageWidth + imageColumn;
+        const auto isStagedAt = [this, offset](std::size_t iPixel) {
+            return iPixel < _stage.size() && _stage[iPixel].offset == offset;
+        };
+        if (isStagedAt(_cursor)) {
+            // Same pixel as the previous entry
+        } else if (isStagedAt(_cursor + 1)) {
+            ++_cursor;
+        } else {
+            this->stage(offset);
+        }
+
+        registerEntry<TAggregation>(value, _stage[_cursor].aggregate);
+    }
+
+    void flush()
+    {
+        for (const Pixel& rPixel : _stage) {
+            if constexpr (std::is_same_v<TPixel,Occupancy>) {
+                const std::size_t imageRow = rPixel.offset / _imageWidth;
+                registerPixel<TAggregation,false>(rPixel.aggregate,
+                                                  _values.data() + imageRow * _rowElements,
+                                                  rPixel.offset - imageRow * _imageWidth);
+            } else {
+                assert(rPixel.offset < _values.size());
+                mergePixel<TAggregation>(_values[rPixel.offset], rPixel.aggregate);
+            }
+        }
+        _stage.clear();
+        _cursor = 0ul;
+    }
+
+private:
+    /// @brief Point the cursor to the staged pixel at an offset, staging it first if necessary.
+    void stage(std::size_t offset)
+    {
+        if (_stage.size() == stageCapacity) [[unlikely]] {
+            this->flush();
+        }
+
+        const auto itPixel = std::lower_bound(_stage.begin(),
+                                              _stage.end(),
+                                              offset,
+                                              [](const Pixel& rPixel, std::size_t offset) {return rPixel.offset < offset;});
+        _cursor = static_cast<std::size_t>(itPixel - _stage.begin());
+        if (itPixel == _stage.end() || itPixel->offset != offset) {
+            _stage.insert(itPixel, Pixel {offset, Aggregate(0)});
+        }
+    }
+
+    /// @brief Counts are staged in full width, the magnitudes of bit-packed pixels in double precision
+    ///        (so that tiny values still mark their pixel, see @ref registerPixel).
+    using Aggregate = std::conditional_t<
+        TAggregation == Aggregation::Count,
+        std::uint32_t,
+        std::conditional_t<std::is_same_v<TPixel,Occupancy>,double,TPixel>
+    >;
+
+    struct Pixel
+    {
+        std::size_t offset; // <== imageRow * imageWidth + imageColumn
+        Aggregate aggregate;
+    }; // struct Pixel
+
+    std::span<TPixel> _values;
+
+    std::size_t _imageWidth;
+
+    std::size_t _rowElements;
+
+    std::size_t _blockSize;
+
+    std::size_t _blockRow;
+
+    std::size_t _row;
+
+    std::size_t _imageRow;
+
+    std::size_t _cursor;
+
+    std::vector<Pixel> _stage;
+}; // class BlockScatter
+
+
+/// @brief Parse all entries from the input and aggregate them block row by block row (see @ref BlockScatter).
+/// @details Inputs without a detected block structure are scattered entry by entry, like in @ref scatterEntries.
+/// @param blockSize Size of the dense blocks of the input, or 0 to detect it from its leading entries
+///                  (see @ref detectBlockSize).
+/// @param pCollector Gathers the structure of the entries in the window if not null.
+/// @return Number of entries read from the input.
+template <Aggregation TAggregation, class TPixel>
+std::size_t scatterBlocks(Parser& rParser,
+                          std::span<TPixel> values,
+                          std::pair<std::size_t,std::size_t> imageSize,
+                          const Window& rWindow,
+                          std::size_t blockSize,
+                          StructureCollector* pCollector)
+{
+    const format::Properties properties = rParser.getProperties();
+    const bool isCropped = !isFullWindow(properties, rWindow);
+    const IndexMap rowMap(rWindow.rowEnd - rWindow.rowBegin, imageSize.second);
+    const IndexMap columnMap(rWindow.columnEnd - rWindow.columnBegin, imageSize.first);
+    assert(!mirrorsEntries(properties, rWindow));
+
+    using Batch = EntryBatch<ParsedValue<TAggregation>>;
+    using ParsedBatch = std::pair<std::unique_ptr<Batch>,std::size_t>;
+
+    // Parse the leading entries to detect the block size from, if it wasn't given.
+    std::vector<ParsedBatch> leadingBatches;
+    if (blockSize == 0ul) {
+        std::size_t sampleSize = 0ul;
+        while (sampleSize < blockSampleSize) {
+            auto pBatch = std::make_unique<Batch>();
+            const std::size_t batchSize = rParser.parseBatch(*pBatch);
+            if (!batchSize) break;
+            sampleSize += batchSize;
+            leadingBatches.emplace_back(std::move(pBatch), batchSize);
+        }
+        blockSize = detectBlockSize(std::span<const ParsedBatch>(leadingBatches));
+        #ifndef NDEBUG
+        std::cout << "mtx2img: detected block size " << blockSize << std::endl;
+        #endif
+    }
+
+    // Crop the leading batches and the rest of the input, and hand them to the scatter.
+    // Note: statistics are gathered before the scatter maps indices to pixels.
+    std::optional<StructureCollector::Local> maybeStatistics;
+    if (pCollector) maybeStatistics.emplace(*pCollector);
+    auto pCropped = isCropped ? std::make_unique<Batch>() : nullptr;
+    std::size_t entryCount = 0ul;
+    const auto scatterAll = [&](auto&& rScatter) {
+        const auto process = [&](Batch& rBatch, std::size_t batchSize) {
+            entryCount += batchSize;
+            Batch* pEntries = &rBatch;
+            if (isCropped) {
+                batchSize = cropBatch(rBatch, batchSize, rWindow, false, *pCropped);
+                pEntries = pCropped.get();
+            }
+            if (maybeStatistics.has_value()) maybeStatistics->insert(*pEntries, batchSize);
+            rScatter(*pEntries, batchSize);
+        };
+
+        for (auto& [rpBatch, batchSize] : leadingBatches) process(*rpBatch, batchSize);
+        auto pBatch = std::make_unique<Batch>();
+        while (const std::size_t batchSize = rParser.parseBatch(*pBatch)) process(*pBatch, batchSize);
+    };
+
+    // Convert matrix indices to pixel indices in place, and register entries one by one.
+    const auto insertMapped = [&rowMap, &columnMap](auto& rScatter, Batch& rBatch, std::size_t batchSize) {
+        rowMap(std::span<std::size_t>(rBatch.rows.data(), batchSize));
+        columnMap(std::span<std::size_t>(rBatch.columns.data(), batchSize));
+        for (std::size_t iEntry=0ul; iEntry<batchSize; ++iEntry) {
+            if constexpr (std::is_same_v<ParsedValue<TAggregation>,std::monostate>) {
+                rScatter.insert(rBatch.rows[iEntry], rBatch.columns[iEntry], std::monostate());
+            } else {
+                rScatter.insert(rBatch.rows[iEntry], rBatch.columns[iEntry], rBatch.values[iEntry]);
+            }
+        }
+    };
+
+    // Block rows are told apart by the matrix rows of their entries, so rows
+    // are mapped to the image one by one (and only when they change).
+    if (1ul < blockSize) {
+        BlockScatter<TAggregation,TPixel> scatter(values, imageSize, blockSize);
+        std::size_t row = std::numeric_limits<std::size_t>::max();
+        std::size_t imageRow = 0ul;
+        scatterAll([&](Batch& rBatch, std::size_t batchSize) {
+            columnMap(std::span<std::size_t>(rBatch.columns.data(), batchSize));
+            for (std::size_t iEntry=0ul; iEntry<batchSize; ++iEntry) {
+                if (rBatch.rows[iEntry] != row) {
+                    row = rBatch.rows[iEntry];
+                    imageRow = rowMap(row);
+                }
+                if constexpr (std::is_same_v<ParsedValue<TAggregation>,std::monostate>) {
+                    scatter.insert(row + rWindow.rowBegin, imageRow, rBatch.columns[iEntry], std::monostate());
+                } else {
+                    scatter.insert(row + rWindow.rowBegin, imageRow, rBatch.columns[iEntry], rBatch.values[iEntry]);
+                }
+            }
+        });
+        scatter.flush();
+    } else if (binnedScatterThreshold < values.size() * sizeof(TPixel)) {
+        BinnedScatter<TAggregation,TPixel> scatter(values, imageSize);
+        scatterAll([&](Batch& rBatch, std::size_t batchSize) {insertMapped(scatter, rBatch, batchSize);});
+        scatter.flush();
+    } else {
+        DirectScatter<TAggregation,TPixel> scatter(values, imageSize);
+        scatterAll([&](Batch& rBatch, std::size_t batchSize) {insertMapped(scatter, rBatch, batchSize);});
+    }
+
+    return entryCount;
+}
+
+
+/// @brief Map the entries of a parsed input to pixels (the accumulator of @ref convertParsed, see @ref fill).
+template <Aggregation TAggregation, class TPixel>
+std::size_t accumulateParsed(Parser& rParser,
+                             std::span<TPixel> values,
+                             std::pair<std::size_t,std::size_t> imageSize,
+                             const Window& rWindow,
+                             const Reordering& rReordering,
+                             std::size_t threadCount,
+                             bool deterministic,
+                             StructureCollector* pCollector,
+                             std::size_t blockSize = 1ul)
+{
+    // Dense inputs have a dedicated engine. Sparse entries are binned
+    // by image tiles first if the pixel buffer is too large for the cache.
+    // Note: the fixed bin storage is not worth it for small images.
+    // Note: sparse entries are scattered by a single thread in file order,
+    //       so they are deterministic anyway.
+    // Note: dense inputs are never bit-packed (see makeImage).
+    if constexpr (!std::is_same_v<TPixel,Occupancy>) {
+        if (rParser.getProperties().format.value() == format::Format::Array) {
+            return fillDense<TAggregation,TPixel>(rParser,
+                                                  values,
+                                                  imageSize,
+                                                  rWindow,
+                                                  threadCount,
+                                                  deterministic);
+        }
+    }
+
+    // Block rows are only contiguous in inputs that are neither permuted nor mirrored.
+    if (blockSize != 1ul && rReordering.empty() && !mirrorsEntries(rParser.getProperties(), rWindow)) {
+        return scatterBlocks<TAggregation>(rParser,
+                                           values,
+                                           imageSize,
+                                           rWindow,
+                                           blockSize,
+                                           pCollector);
+    }
+
+    if (binnedScatterThreshold < values.size() * sizeof(TPixel)) {
+        return scatterEntries<TAggregation>(rParser,
+                                            imageSize,
+                                            rWindow,
+                                            BinnedScatter<TAggregation,TPixel>(values, imageSize),
+                                            pCollector,
+                                            &rReordering);
+    } else {
+        return scatterEntries<TAggregation>(rParser,
+                                            imageSize,
+                                            rWindow,
+                                            DirectScatter<TAggregation,TPixel>(values, imageSize),
+                                            pCollector,
+                                            &rReordering);
+    }
+}
+
+
+/// @brief Convert a MatrixMarket input whose header was parsed already (see @ref convert).
+Image convertParsed(Parser& rParser,
+                    std::size_t& rImageWidth,
+                    std::size_t& rImageHeight,
+                    const Aggregation aggregation,
+                    const std::string& rColormapName,
+                    std::size_t threadCount,
+                    const Window& rWindow,
+                    const Normalization& rNormalization,
+                    Statistics* pStatistics,
+                    bool deterministic,
+                    const Permutation& rPermutation,
+                    std::ostream* pPartial,
+                    std::size_t blockSize = 1ul)
+{
+    const Window window = resolveWindow(rParser.getProperties(), rWindow);
+    const Reordering reordering = loadReordering(rPermutation, rParser.getProperties());
+
+    // The dense engine can't mirror values on the fly.
+    if (rParser.getProperties().format == format::Format::Array && mirrorsEntries(rParser.getProperties(), window)) {
+        throw UnsupportedFormat("Error: dense symmetric inputs only support windows on the main diagonal\n");
+    } else if (rParser.getProperties().format == format::Format::Array && pStatistics) {
+        throw UnsupportedFormat("Error: statistics are not supported for dense inputs\n");
+    }
+
+    return makeImage(
+        getPermutedProperties(rParser.getProperties(), reordering),
+        window,
+        rImageWidth,
+        rImageHeight,
+        aggregation,
+        rColormapName,
+        rNormalization,
+        threadCount,
+        pStatistics,
+        pPartial,
+        [&rParser, &window, &reordering, threadCount, deterministic, blockSize]<Aggregation TAggregation, class TPixel>(std::span<TPixel> values,
+                                                                                                                        std::pair<std::size_t,std::size_t> imageSize,
+                                                                                                                        StructureCollector* pCollector) {
+            return accumulateParsed<TAggregation>(rParser, values, imageSize, window, reordering, threadCount, deterministic, pCollector, blockSize);
+        }
+    );
+}
+
+
+Image convert(std::istream& rStream,
+              std::size_t& rImageWidth,
+              std::size_t& rImageHeight,
+              const Aggregation aggregation,
+              const std::string& rColormapName,
+              std::size_t threadCount,
+              const Window& rWindow,
+              const Normalization& rNormalization,
+              Statistics* pStatistics,
+              bool deterministic,
+              const Permutation& rPermutation,
+              std::ostream* pPartial,
+              std::size_t blockSize)
+{
+    Parser parser(rStream);
+    return convertParsed(parser,
+                         rImageWidth,
+                         rImageHeight,
+                         aggregation,
+                         rColormapName,
+                         threadCount,
+                         rWindow,
+                         rNormalization,
+                         pStatistics,
+                         deterministic,
+                         rPermutation,
+                         pPartial,
+                         blockSize);
+}
+
+
+/// @brief Number of bytes the pixel buffer of a band should take at most (see @ref BandScatter).
+constexpr std::size_t bandBytes = 0x10000ul;
+
+
+/// @brief Aggregate the entries of a row sorted input band by band (see @ref BandScatter).
+template <Aggregation TAggregation, class TPixel, class TFinish>
+void scatterBands(Parser& rParser,
+                  const Window& rWindow,
+                  std::pair<std::size_t,std::size_t> imageSize,
+                  TFinish&& rFinish)
+{
+    const std::size_t rowBytes = getRowElements<TPixel>(imageSize.first) * sizeof(TPixel);
+    const std::size_t bandHeight = std::clamp<std::size_t>(bandBytes / rowBytes, 1ul, imageSize.second);
+    const std::size_t entryCount = scatterEntries<TAggregation>(
+        rParser,
+        imageSize,
+        rWindow,
+        BandScatter<TAggregation,TPixel,std::remove_reference_t<TFinish>>(imageSize, bandHeight, rFinish)
+    );
+
+    // Check the read number of entries
+    if (entryCount != rParser.getProperties().nonzeros.value()) {
+        throw ParsingException(std::format(
+            "Expecting {} entries, but read {}\n",
+            rParser.getProperties().nonzeros.value(),
+            entryCount
+        ));
     }
+}
 
-    #ifndef NDEBUG
-        // Print changes to the output dimension in debug mode
-        const std::pair<std::size_t,std::size_t> requestedImageSize {rImageWidth, rImageHeight};
-    #endif
 
-    // Preserve the aspect ratio of the input matrix (as much as possible),
-    // by restricting the resolution of the output image corresponding to the
-    // shorter dimension.
-    if (inputProperties.columns.value() < inputProperties.rows.value()) {
-        rImageWidth = std::max(inputProperties.columns.value() * rImageWidth / inputProperties.rows.value(), 1ul);
+/// @brief Render a row sorted input band by band and hand over the finished rows (see @ref convertBands).
+/// @details Bit-packed pixels need no normalization, so they're written in a single pass if the input
+///          can't seek. Seekable inputs take a first pass that only checks their row order, so that
+///          unsorted ones throw before any row was handed over. Other pixels are aggregated twice:
+///          the first pass gathers their distribution, and the second one reads the input again
+///          from @p begin to color each band as soon as it's finished.
+/// @param rParser Parser of the input, positioned past its header.
+/// @param begin Position of the header in @p rStream, or -1 if it can't seek.
+template <Aggregation TAggregation, class TPixel, class TWrite>
+void writeBands(Parser& rParser,
+                std::istream& rStream,
+                std::istream::pos_type begin,
+                const Window& rWindow,
+                std::pair<std::size_t,std::size_t> imageSize,
+                const std::string& rColormapName,
+                const Normalization& rNormalization,
+                TWrite&& rWriteRows)
+{
+    if constexpr (std::is_same_v<TPixel,Occupancy>) {
+        const auto writeBitBands = [&](Parser& rBandParser) {
+            scatterBands<TAggregation,Occupancy>(rBandParser, rWindow, imageSize, [&rWriteRows](std::span<const Occupancy> band, std::size_t) {
+                rWriteRows(std::span<const unsigned char>(reinterpret_cast<const unsigned char*>(band.data()), band.size()));
+            });
+        };
+
+        if (begin == std::istream::pos_type(-1)) {
+            writeBitBands(rParser);
+        } else {
+            scatterBands<TAggregation,Occupancy>(rParser, rWindow, imageSize, [](std::span<const Occupancy>, std::size_t) {});
+            rStream.clear();
+            rStream.seekg(begin);
+            Parser parser(rStream);
+            writeBitBands(parser);
+        }
     } else {
-        rImageHeight = std::max(inputProperties.rows.value() * rImageHeight / inputProperties.columns.value(), 1ul);
+        PixelDistribution distribution(!isDefaultNormalization(rNormalization));
+        scatterBands<TAggregation,TPixel>(rParser, rWindow, imageSize, [&distribution](std::span<const TPixel> band, std::size_t) {
+            distribution.add(band);
+        });
+
+        rStream.clear();
+        rStream.seekg(begin);
+        Parser parser(rStream);
+        const PixelPainter<TPixel> painter(distribution, rColormapName, rNormalization);
+        std::vector<unsigned char> colors;
+        scatterBands<TAggregation,TPixel>(parser, rWindow, imageSize, [&](std::span<const TPixel> band, std::size_t) {
+            colors.assign(CHANNELS * band.size(), 0xff);
+            if (!painter.isBlank()) {
+                painter(band, colors);
+            }
+            rWriteRows(std::span<const unsigned char>(colors));
+        });
     }
+}
 
-    // Restrict output image size
-    if (inputProperties.columns.value() < rImageWidth) {
-        rImageWidth = inputProperties.columns.value();
-        rImageHeight = std::max(inputProperties.rows.value() * inputProperties.columns.value() / rImageWidth, 1ul);
+
+void convertBands(std::istream& rStream,
+                  std::size_t& rImageWidth,
+                  std::size_t& rImageHeight,
+                  const Aggregation aggregation,
+                  const std::string& rColormapName,
+                  const std::function<void(std::span<const unsigned char>)>& rWriteRows,
+                  std::size_t threadCount,
+                  const Window& rWindow,
+                  const Normalization& rNormalization)
+{
+    // The second pass of normalized pixels rewinds the stream to where the input begins.
+    const std::istream::pos_type begin = rStream.tellg();
+    const bool isSeekable = begin != std::istream::pos_type(-1);
+
+    std::optional<Parser> maybeParser;
+    maybeParser.emplace(rStream);
+    const format::Properties inputProperties = maybeParser->getProperties();
+    validateProperties(inputProperties);
+    validateNormalization(rNormalization);
+    const Window window = resolveWindow(inputProperties, rWindow);
+    const format::Properties properties = getWindowProperties(inputProperties, window);
+    std::pair<std::size_t,std::size_t> imageSize {rImageWidth, rImageHeight};
+    fitImageSize(properties, imageSize.first, imageSize.second);
+
+    // Entries of the missing triangle of symmetric inputs are mirrored to rows above
+    // them, and dense inputs are stored by columns, so neither comes sorted by rows.
+    const bool isSingleBitPass = isBitPacked(rColormapName);
+    const bool isBanded = properties.format.value() == format::Format::Coordinate
+                          && inputProperties.structure.value_or(format::Structure::General) == format::Structure::General
+                          && (isSingleBitPass || isSeekable)
+                          && !isEmptyImage(properties, imageSize);
+
+    // Everything else is rendered in one piece.
+    const auto convertWhole = [&](Parser& rParser) {
+        const Image image = convertParsed(rParser,
+                                          rImageWidth,
+                                          rImageHeight,
+                                          aggregation,
+                                          rColormapName,
+                                          threadCount,
+                                          rWindow,
+                                          rNormalization,
+                                          nullptr,
+                                          false,
+                                          {},
+                                          nullptr);
+        if (!image.empty()) {
+            rWriteRows(image);
+        }
+    };
+
+    if (!isBanded) {
+        convertWhole(maybeParser.value());
+        return;
     }
 
-    if (inputProperties.rows.value() < rImageHeight) {
-        rImageHeight = inputProperties.rows.value();
-        rImageWidth = std::max(inputProperties.columns.value() * inputProperties.rows.value() / rImageHeight, 1ul);
+    const std::pair<std::size_t,std::size_t> requestedSize {rImageWidth, rImageHeight};
+    rImageWidth = imageSize.first;
+    rImageHeight = imageSize.second;
+
+    bool isWritten = false;
+    const auto writeRows = [&rWriteRows, &isWritten](std::span<const unsigned char> rows) {
+        isWritten = true;
+        rWriteRows(rows);
+    };
+
+    try {
+        // Note: the pixel types match the ones of makeImage, so that
+        //       the bands are colored exactly like the whole image.
+        const std::size_t maxEntriesPerPixel = getMaxEntriesPerPixel(properties, imageSize);
+        switch (aggregation) {
+            #define MTX2IMG_WRITE_BANDS(AGGREGATION, PIXEL) \
+                writeBands<AGGREGATION,PIXEL>(maybeParser.value(), rStream, begin, window, imageSize, rColormapName, rNormalization, writeRows)
+            case Aggregation::Count:
+                if (isSingleBitPass) {
+                    MTX2IMG_WRITE_BANDS(Aggregation::Count, Occupancy);
+                } else if (maxEntriesPerPixel <= std::numeric_limits<std::uint8_t>::max()) {
+                    MTX2IMG_WRITE_BANDS(Aggregation::Count, std::uint8_t);
+                } else if (maxEntriesPerPixel <= std::numeric_limits<std::uint16_t>::max()) {
+                    MTX2IMG_WRITE_BANDS(Aggregation::Count, std::uint16_t);
+                } else {
+                    MTX2IMG_WRITE_BANDS(Aggregation::Count, std::uint32_t);
+                }
+                break;
+            case Aggregation::Sum:
+                if (isSingleBitPass) MTX2IMG_WRITE_BANDS(Aggregation::Sum, Occupancy);
+                else MTX2IMG_WRITE_BANDS(Aggregation::Sum, float);
+                break;
+            case Aggregation::Max:
+                if (isSingleBitPass) MTX2IMG_WRITE_BANDS(Aggregation::Max, Occupancy);
+                else MTX2IMG_WRITE_BANDS(Aggregation::Max, float);
+                break;
+            #undef MTX2IMG_WRITE_BANDS
+            default:
+                throw std::runtime_error(std::format(
+                    "Error: missing implementation for aggregation {}\n",
+                    (int)aggregation
+                ));
+        }
+    } catch (const UnsortedRows&) {
+        // Bands are only handed over without a first pass if they're bit-packed and the input
+        // can't seek, so there's no going back once an unsorted entry shows up in them.
+        if (isWritten) {
+            throw InvalidFormat("Error: the input is not sorted by rows, but the rows above were written already\n");
+        }
+
+        // The first pass found the input unsorted => start over and render it in one piece.
+        assert(isSeekable);
+        #ifndef NDEBUG
+            std::cout << "mtx2img: input is not sorted by rows, rendering it in one piece\n";
+        #endif
+        rStream.clear();
+        rStream.seekg(begin);
+        maybeParser.emplace(rStream);
+        rImageWidth = requestedSize.first;
+        rImageHeight = requestedSize.second;
+        convertWhole(maybeParser.value());
     }
+}
 
-    #ifndef NDEBUG
-        // Print changes to the output dimension in debug mode
-        if (rImageWidth != requestedImageSize.first || rImageHeight != requestedImageSize.second) {
-            std::cout << std::format("mtx2img: restrict output image size from {}x{} to {}x{}\n",
-                requestedImageSize.first,
-                requestedImageSize.second,
-                rImageWidth,
-                rImageHeight
+
+/// @brief Aggregate two inputs into separate pixel buffers, and paint their difference (see @ref convertDifference).
+template <Aggregation TAggregation, class TPixel>
+void fillDifference(std::array<Parser*,2> parsers,
+                    std::array<const std::filesystem::path*,2> paths,
+                    const Window& rWindow,
+                    std::pair<std::size_t,std::size_t> imageSize,
+                    std::size_t threadCount,
+                    bool deterministic,
+                    std::span<unsigned char> image)
+{
+    const std::size_t pixelCount = imageSize.first * imageSize.second;
+    assert(image.size() == CHANNELS * pixelCount);
+
+    // Each input is parsed by its own group of threads, into a fresh buffer faulted in by that group.
+    std::array<Buffer<TPixel>,2> values;
+    const std::array<std::size_t,2> groupThreads {std::max(threadCount - threadCount / 2, 1ul),
+                                                  std::max(threadCount / 2, 1ul)};
+    const Reordering reordering;
+    parallelFor(2ul, [&](std::size_t iInput){
+        Parser& rParser = *parsers[iInput];
+        values[iInput].resize(pixelCount);
+        try {
+            accumulate<TAggregation>(
+                getWindowProperties(rParser.getProperties(), rWindow),
+                std::span<TPixel>(values[iInput]),
+                imageSize,
+                nullptr,
+                [&]<Aggregation TAccumulation, class TValue>(std::span<TValue> accumulators,
+                                                             std::pair<std::size_t,std::size_t> size,
+                                                             StructureCollector* pCollector) {
+                    return accumulateParsed<TAccumulation>(rParser, accumulators, size, rWindow, reordering, groupThreads[iInput], deterministic, pCollector);
+                }
             );
+        } catch (ParsingException& rException) {
+            // Point to the input the error is in.
+            throw ParsingException(std::format(
+                "In {}:\n{}",
+                paths[iInput]->string(),
+                rException.what()
+            ));
         }
-    #endif
+    });
+
+    // Changes of pixels holding entries in both inputs are scaled by the largest one.
+    const std::size_t colorThreads = std::clamp<std::size_t>(pixelCount / 0x100000, 1ul, std::max(threadCount, 1ul));
+    std::vector<double> maxChanges(colorThreads, 0.0);
+    parallelFor(colorThreads, [&](std::size_t iThread){
+        const std::size_t iEnd = (iThread + 1) * pixelCount / colorThreads;
+        for (std::size_t iPixel=iThread * pixelCount / colorThreads; iPixel<iEnd; ++iPixel) {
+            const TPixel first = values[0][iPixel], second = values[1][iPixel];
+            if (first != TPixel(0) && second != TPixel(0)) {
+                maxChanges[iThread] = std::max(maxChanges[iThread], std::abs(static_cast<double>(second) - static_cast<double>(first)));
+            }
+        }
+    });
+    const double maxChange = *std::max_element(maxChanges.begin(), maxChanges.end());
 
+    // Pixels that gained or lost all of their entries get the extreme colors, changed ones
+    // the middle half of each side (so that small changes still stand out from the gray).
+    const auto& rColormap = getDivergingColormap();
+    const std::size_t iNeutral = rColormap.size() / 2;
+    parallelFor(colorThreads, [&](std::size_t iThread){
+        const std::size_t iEnd = (iThread + 1) * pixelCount / colorThreads;
+        for (std::size_t iPixel=iThread * pixelCount / colorThreads; iPixel<iEnd; ++iPixel) {
+            const TPixel first = values[0][iPixel], second = values[1][iPixel];
+            std::array<unsigned char, CHANNELS> color {0xff, 0xff, 0xff};
+            if (first == TPixel(0) && second != TPixel(0)) {
+                color = rColormap.back();
+            } else if (first != TPixel(0) && second == TPixel(0)) {
+                color = rColormap.front();
+            } else if (first != second) {
+                const double change = static_cast<double>(second) - static_cast<double>(first);
+                const std::size_t offset = static_cast<std::size_t>(std::lround(iNeutral * (0.25 + 0.5 * std::abs(change) / maxChange)));
+                color = rColormap[0 < change ? iNeutral + offset : iNeutral - offset];
+            } else if (first != TPixel(0)) {
+                color = rColormap[iNeutral];
+            }
+            std::copy(color.begin(), color.end(), image.begin() + CHANNELS * iPixel);
+        }
+    });
+}
+
+
+Image convertDifference(const std::filesystem::path& rFirstPath,
+                        const std::filesystem::path& rSecondPath,
+                        std::size_t& rImageWidth,
+                        std::size_t& rImageHeight,
+                        const Aggregation aggregation,
+                        std::size_t threadCount,
+                        const Window& rWindow,
+                        bool deterministic)
+{
+    const std::array<const std::filesystem::path*,2> paths {&rFirstPath, &rSecondPath};
+    std::array<std::ifstream,2> streams;
+    std::array<std::optional<Parser>,2> maybeParsers;
+    for (std::size_t iInput=0ul; iInput<paths.size(); ++iInput) {
+        streams[iInput].open(*paths[iInput]);
+        if (!streams[iInput].good()) {
+            throw IOError(std::format("Error: failed to open input file: {}\n", paths[iInput]->string()));
+        }
+        try {
+            maybeParsers[iInput].emplace(streams[iInput]);
+        } catch (ParsingException& rException) {
+            throw ParsingException(std::format(
+                "In {}:\n{}",
+                paths[iInput]->string(),
+                rException.what()
+            ));
+        }
+    }
+
+    const std::array<Parser*,2> parsers {&maybeParsers[0].value(), &maybeParsers[1].value()};
+    const format::Properties& rFirstProperties = parsers[0]->getProperties();
+    const format::Properties& rSecondProperties = parsers[1]->getProperties();
+    validateProperties(rFirstProperties);
+    validateProperties(rSecondProperties);
+    if (rFirstProperties.rows != rSecondProperties.rows || rFirstProperties.columns != rSecondProperties.columns) {
+        throw InvalidFormat(std::format(
+            "Error: can't compare the {}x{} matrix in {} to the {}x{} matrix in {}\n",
+            rFirstProperties.rows.value(),
+            rFirstProperties.columns.value(),
+            rFirstPath.string(),
+            rSecondProperties.rows.value(),
+            rSecondProperties.columns.value(),
+            rSecondPath.string()
+        ));
+    }
+
+    // Both inputs are rendered with the same geometry.
+    const Window window = resolveWindow(rFirstProperties, rWindow);
+    for (const Parser* pParser : parsers) {
+        // The dense engine can't mirror values on the fly.
+        if (pParser->getProperties().format == format::Format::Array && mirrorsEntries(pParser->getProperties(), window)) {
+            throw UnsupportedFormat("Error: dense symmetric inputs only support windows on the main diagonal\n");
+        }
+    }
+    fitImageSize(getWindowProperties(rFirstProperties, window), rImageWidth, rImageHeight);
     const std::pair<std::size_t,std::size_t> imageSize {rImageWidth, rImageHeight};
 
-    // Resize image buffer to final size and initialize it to full white
-    image.resize(imageSize.first * imageSize.second * CHANNELS, 0xff);
+    Image image(CHANNELS * imageSize.first * imageSize.second);
+    if (image.empty()) {
+        return image;
+    }
 
-    // Parse input stream and fill the output image buffer
+    // Counts are compared exactly, values at the precision they're aggregated with
+    // in regular renders (see makeImage).
     switch (aggregation) {
-        #define MTX2IMG_FILL(AGGREGATION)                                                       \
-            fill<AGGREGATION>(parser,                       /* mtx/mm parser                */  \
-                              image,                        /* buffer                       */  \
-                              imageSize,                    /* buffer dimensions            */  \
-                              rColormapName,                /* name of the colormap to use  */  \
-                              inputProperties.structure)    /* input matrix symmetry)       */
-        case Aggregation::Count:    MTX2IMG_FILL(Aggregation::Count);   break;
-        case Aggregation::Sum:      MTX2IMG_FILL(Aggregation::Sum);     break;
-        case Aggregation::Max:      MTX2IMG_FILL(Aggregation::Max);     break;
-        #undef MTX2IMG_FILL
+        case Aggregation::Count:
+            fillDifference<Aggregation::Count,std::uint32_t>(parsers, paths, window, imageSize, threadCount, deterministic, image);
+            break;
+        case Aggregation::Sum:
+            fillDifference<Aggregation::Sum,float>(parsers, paths, window, imageSize, threadCount, deterministic, image);
+            break;
+        case Aggregation::Max:
+            fillDifference<Aggregation::Max,float>(parsers, paths, window, imageSize, threadCount, deterministic, image);
+            break;
         default:
             throw std::runtime_error(std::format(
                 "Error: missing implementation for aggregation {}\n",
@@ -927,4 +5622,582 @@ std::vector<unsigned char> convert(std::istream& rStream,
 }
 
 
+Image convertParts(const std::vector<std::filesystem::path>& rPartPaths,
+                   std::size_t& rImageWidth,
+                   std::size_t& rImageHeight,
+                   const Aggregation aggregation,
+                   const std::string& rColormapName,
+                   std::size_t threadCount,
+                   const GlobalShape& rShape,
+                   const Window& rWindow,
+                   const Normalization& rNormalization,
+                   Statistics* pStatistics,
+                   bool deterministic,
+                   const Permutation& rPermutation,
+                   std::ostream* pPartial)
+{
+    if (rPartPaths.empty()) {
+        throw std::invalid_argument("Error: no input parts\n");
+    }
+
+    const auto openPart = [](const std::filesystem::path& rPath) {
+        std::ifstream stream(rPath);
+        if (!stream.good()) {
+            throw IOError(std::format("Error: failed to open input file: {}\n", rPath.string()));
+        }
+        return stream;
+    };
+
+    // Read the header of each part and combine them into the properties of the global matrix.
+    std::vector<std::size_t> partNonzeros;
+    partNonzeros.reserve(rPartPaths.size());
+    format::Properties properties;
+    std::size_t rows = 0ul, columns = 0ul, nonzeros = 0ul;
+
+    for (const auto& rPath : rPartPaths) {
+        std::ifstream stream = openPart(rPath);
+        // Note: parts are validated as a whole later on, since a block of
+        //       a symmetric matrix is not necessarily square on its own.
+        const format::Properties partProperties = Parser(stream).getProperties();
+        if (partProperties.format != format::Format::Coordinate) {
+            throw UnsupportedFormat(std::format(
+                "Error: partitioned input must be in coordinate format: {}\n",
+                rPath.string()
+            ));
+        }
+
+        if (partNonzeros.empty()) {
+            properties = partProperties;
+        } else if (partProperties.object != properties.object
+                   || partProperties.data != properties.data
+                   || partProperties.structure != properties.structure) {
+            throw InvalidFormat(std::format(
+                "Error: the header of {} doesn't match the header of {}\n",
+                rPath.string(),
+                rPartPaths.front().string()
+            ));
+        }
+
+        rows = std::max(rows, partProperties.rows.value());
+        columns = std::max(columns, partProperties.columns.value());
+        nonzeros += partProperties.nonzeros.value();
+        partNonzeros.push_back(partProperties.nonzeros.value());
+    } // for rPath in rPartPaths
+
+    // Explicit global dimensions must cover every part.
+    if (rShape.rows.has_value() || rShape.columns.has_value()) {
+        if (rShape.rows.value_or(rows) < rows || rShape.columns.value_or(columns) < columns) {
+            throw InvalidFormat(std::format(
+                "Error: the parts declare dimensions up to {}x{}, exceeding the global dimensions {}x{}\n",
+                rows,
+                columns,
+                rShape.rows.value_or(rows),
+                rShape.columns.value_or(columns)
+            ));
+        }
+        rows = rShape.rows.value_or(rows);
+        columns = rShape.columns.value_or(columns);
+    }
+
+    if (rShape.nonzeros.has_value() && rShape.nonzeros.value() != nonzeros) {
+        throw ParsingException(std::format(
+            "Error: expecting {} nonzeros in total, but the parts declare {}\n",
+            rShape.nonzeros.value(),
+            nonzeros
+        ));
+    }
+
+    properties.rows = rows;
+    properties.columns = columns;
+    properties.nonzeros = nonzeros;
+
+    #ifndef NDEBUG
+        std::cout << "mtx2img: " << rPartPaths.size() << " parts make up a "
+                  << rows << "x" << columns << " matrix with "
+                  << nonzeros << " entries\n";
+    #endif
+
+    const Window window = resolveWindow(properties, rWindow);
+    const Reordering reordering = loadReordering(rPermutation, properties);
+    return makeImage(
+        getPermutedProperties(properties, reordering),
+        window,
+        rImageWidth,
+        rImageHeight,
+        aggregation,
+        rColormapName,
+        rNormalization,
+        threadCount,
+        pStatistics,
+        pPartial,
+        [&]<Aggregation TAggregation, class TPixel>(std::span<TPixel> values,
+                                                    std::pair<std::size_t,std::size_t> imageSize,
+                                                    StructureCollector* pCollector) {
+            // Each thread parses whole parts straight into the shared pixel buffer.
+            const std::size_t partThreads = std::clamp<std::size_t>(threadCount, 1ul, rPartPaths.size());
+            std::atomic<std::size_t> nextPart = 0ul;
+            std::atomic<std::size_t> entryCount = 0ul;
+
+            const auto scatterPart = [&]<class TScatter>(std::size_t iPart, TScatter&& rScatter) {
+                std::ifstream stream = openPart(rPartPaths[iPart]);
+                Parser parser(stream);
+                parser.setDimensions(rows, columns);
+                std::size_t partEntryCount = 0ul;
+                try {
+                    partEntryCount = scatterEntries<TAggregation>(parser, imageSize, window, rScatter, pCollector, &reordering);
+                } catch (ParsingException& rException) {
+                    // Point to the part the error is in.
+                    throw ParsingException(std::format(
+                        "In {}:\n{}",
+                        rPartPaths[iPart].string(),
+                        rException.what()
+                    ));
+                }
+
+                if (partEntryCount != partNonzeros[iPart]) {
+                    throw ParsingException(std::format(
+                        "Error: expecting {} entries in {}, but read {}\n",
+                        partNonzeros[iPart],
+                        rPartPaths[iPart].string(),
+                        partEntryCount
+                    ));
+                }
+                entryCount += partEntryCount;
+            };
+
+            const auto scatterParts = [&]<class TScatter>(TScatter&& rScatter) {
+                for (std::size_t iPart=nextPart++; iPart<rPartPaths.size(); iPart=nextPart++) {
+                    scatterPart(iPart, rScatter);
+                }
+            };
+
+            if constexpr (TAggregation == Aggregation::Sum) {
+                if (deterministic) {
+                    // Group consecutive parts into chunks by the number of entries they declare.
+                    std::vector<std::size_t> chunkBegins {0ul};
+                    for (std::size_t iPart=0ul, chunkEntries=0ul; iPart<rPartPaths.size(); ++iPart) {
+                        chunkEntries += partNonzeros[iPart];
+                        if (deterministicChunkEntries <= chunkEntries || iPart + 1 == rPartPaths.size()) {
+                            chunkBegins.push_back(iPart + 1);
+                            chunkEntries = 0ul;
+                        }
+                    }
+
+                    reduceChunksInOrder<TAggregation>(values, chunkBegins.size() - 1, threadCount, [&](std::size_t iChunk, std::span<TPixel> partials){
+                        const auto scatterChunk = [&]<class TScatter>(TScatter&& rScatter) {
+                            for (std::size_t iPart=chunkBegins[iChunk]; iPart<chunkBegins[iChunk + 1]; ++iPart) {
+                                scatterPart(iPart, rScatter);
+                            }
+                        };
+                        if (binnedScatterThreshold < partials.size() * sizeof(TPixel)) {
+                            scatterChunk(BinnedScatter<TAggregation,TPixel>(partials, imageSize));
+                        } else {
+                            scatterChunk(DirectScatter<TAggregation,TPixel>(partials, imageSize));
+                        }
+                    });
+                    return entryCount.load();
+                }
+            }
+
+            scatterShared<TAggregation>(values, imageSize, partThreads, [&](std::size_t, auto&& rScatter){
+                scatterParts(rScatter);
+            });
+
+            return entryCount.load();
+        }
+    );
+}
+
+
+std::filesystem::path getRowIndexPath(const std::filesystem::path& rInputPath)
+{
+    std::filesystem::path indexPath = rInputPath;
+    indexPath += ".idx";
+    return indexPath;
+}
+
+
+void writeRowIndex(const std::filesystem::path& rInputPath,
+                   const std::filesystem::path& rIndexPath)
+{
+    RowIndex::build(rInputPath).write(rIndexPath);
+}
+
+
+bool isRowIndexCurrent(const std::filesystem::path& rInputPath,
+                       const std::filesystem::path& rIndexPath)
+{
+    std::ifstream stream(rInputPath, std::ios::binary);
+    if (!std::filesystem::exists(rIndexPath) || !stream.good()) {
+        return false;
+    }
+
+    try {
+        const format::Properties properties = Parser(stream).getProperties();
+        return RowIndex::load(rIndexPath, rInputPath).matches(properties);
+    } catch (const std::runtime_error&) {
+        return false;
+    }
+}
+
+
+Image convertIndexed(const std::filesystem::path& rInputPath,
+                     const std::filesystem::path& rIndexPath,
+                     std::size_t& rImageWidth,
+                     std::size_t& rImageHeight,
+                     const Aggregation aggregation,
+                     const std::string& rColormapName,
+                     std::size_t threadCount,
+                     const Window& rWindow,
+                     const Normalization& rNormalization,
+                     Statistics* pStatistics,
+                     bool deterministic,
+                     const Permutation& rPermutation,
+                     std::ostream* pPartial)
+{
+    std::ifstream stream(rInputPath, std::ios::binary);
+    if (!stream.good()) {
+        throw IOError(std::format("Error: failed to open input file: {}\n", rInputPath.string()));
+    }
+
+    const format::Properties properties = Parser(stream).getProperties();
+    const RowIndex index = RowIndex::load(rIndexPath, rInputPath);
+    if (!index.matches(properties)) {
+        throw InvalidFormat(std::format("Error: row index {} doesn't match its input\n", rIndexPath.string()));
+    }
+    const Window window = resolveWindow(properties, rWindow);
+    const Reordering reordering = loadReordering(rPermutation, properties);
+
+    // Read every row range the window needs (mirrored entries come from the rows of its columns).
+    // Permutations scatter the rows of the window over the input, so all of them are read then.
+    std::size_t rowBegin = window.rowBegin, rowEnd = window.rowEnd;
+    if (!reordering.empty()) {
+        rowBegin = 0ul;
+        rowEnd = properties.rows.value();
+    } else if (mirrorsEntries(properties, window)) {
+        rowBegin = std::min(rowBegin, window.columnBegin);
+        rowEnd = std::max(rowEnd, std::min(window.columnEnd, properties.rows.value()));
+    }
+    const std::span<const RowIndex::Checkpoint> checkpoints = index.getCheckpoints();
+    const auto [iCheckpointBegin, iCheckpointEnd] = index.getCheckpointRange(rowBegin, rowEnd);
+    const std::size_t skippedEntryCount = properties.nonzeros.value()
+                                        - (checkpoints[iCheckpointEnd].entry - checkpoints[iCheckpointBegin].entry);
+
+    // Split the byte range between threads at checkpoints.
+    const std::uint64_t byteCount = checkpoints[iCheckpointEnd].offset - checkpoints[iCheckpointBegin].offset;
+    const std::size_t rangeThreads = std::clamp<std::size_t>(threadCount, 1ul, iCheckpointEnd - iCheckpointBegin);
+    std::vector<std::size_t> threadCheckpoints(rangeThreads + 1, iCheckpointEnd);
+    threadCheckpoints.front() = iCheckpointBegin;
+    for (std::size_t iThread=1ul, iCheckpoint=iCheckpointBegin; iThread<rangeThreads; ++iThread) {
+        const std::uint64_t target = checkpoints[iCheckpointBegin].offset + iThread * byteCount / rangeThreads;
+        while (iCheckpoint < iCheckpointEnd && checkpoints[iCheckpoint].offset < target) ++iCheckpoint;
+        threadCheckpoints[iThread] = iCheckpoint;
+    }
+
+    return makeImage(
+        getPermutedProperties(properties, reordering),
+        window,
+        rImageWidth,
+        rImageHeight,
+        aggregation,
+        rColormapName,
+        rNormalization,
+        threadCount,
+        pStatistics,
+        pPartial,
+        [&]<Aggregation TAggregation, class TPixel>(std::span<TPixel> values,
+                                                    std::pair<std::size_t,std::size_t> imageSize,
+                                                    StructureCollector* pCollector) {
+            std::atomic<std::size_t> entryCount = skippedEntryCount;
+
+            const auto scatterRange = [&]<class TScatter>(std::size_t iCheckpointBegin, std::size_t iCheckpointEnd, TScatter&& rScatter) {
+                const RowIndex::Checkpoint begin = checkpoints[iCheckpointBegin];
+                const RowIndex::Checkpoint end = checkpoints[iCheckpointEnd];
+                if (begin.offset == end.offset) return;
+
+                std::ifstream rangeStream(rInputPath, std::ios::binary);
+                rangeStream.seekg(static_cast<std::streamoff>(begin.offset));
+                format::Properties rangeProperties = properties;
+                rangeProperties.nonzeros = end.entry;
+                Parser parser(rangeStream, rangeProperties, end.offset - begin.offset, begin.entry);
+
+                const std::size_t rangeEntryCount = scatterEntries<TAggregation>(parser, imageSize, window, rScatter, pCollector, &reordering);
+                if (rangeEntryCount != end.entry - begin.entry) {
+                    throw ParsingException(std::format(
+                        "Error: expecting {} entries between bytes {} and {}, but read {} (is the row index up to date?)\n",
+                        end.entry - begin.entry,
+                        begin.offset,
+                        end.offset,
+                        rangeEntryCount
+                    ));
+                }
+                entryCount += rangeEntryCount;
+            };
+
+            if constexpr (TAggregation == Aggregation::Sum) {
+                if (deterministic) {
+                    // Split the rows into chunks at checkpoints by their number of entries.
+                    std::vector<std::size_t> chunkBegins {iCheckpointBegin};
+                    for (std::size_t iCheckpoint=iCheckpointBegin + 1; iCheckpoint<=iCheckpointEnd; ++iCheckpoint) {
+                        if (deterministicChunkEntries <= checkpoints[iCheckpoint].entry - checkpoints[chunkBegins.back()].entry
+                            || iCheckpoint == iCheckpointEnd) {
+                            chunkBegins.push_back(iCheckpoint);
+                        }
+                    }
+
+                    reduceChunksInOrder<TAggregation>(values, chunkBegins.size() - 1, threadCount, [&](std::size_t iChunk, std::span<TPixel> partials){
+                        if (binnedScatterThreshold < partials.size() * sizeof(TPixel)) {
+                            scatterRange(chunkBegins[iChunk], chunkBegins[iChunk + 1], BinnedScatter<TAggregation,TPixel>(partials, imageSize));
+                        } else {
+                            scatterRange(chunkBegins[iChunk], chunkBegins[iChunk + 1], DirectScatter<TAggregation,TPixel>(partials, imageSize));
+                        }
+                    });
+                    return entryCount.load();
+                }
+            }
+
+            scatterShared<TAggregation>(values, imageSize, rangeThreads, [&](std::size_t iThread, auto&& rScatter){
+                scatterRange(threadCheckpoints[iThread], threadCheckpoints[iThread + 1], rScatter);
+            });
+
+            return entryCount.load();
+        }
+    );
+}
+
+
+bool isPETScBinary(const std::filesystem::path& rPath)
+{
+    std::ifstream file(rPath, std::ios::binary);
+    std::array<char,sizeof(std::int64_t)> header {};
+    file.read(header.data(), header.size());
+    const std::byte* pHeader = reinterpret_cast<const std::byte*>(header.data());
+    return file.good() && (loadBigEndian<std::int32_t>(pHeader) == PETScBinaryMatrix::classID
+                           || loadBigEndian<std::int64_t>(pHeader) == PETScBinaryMatrix::classID);
+}
+
+
+Image convertPETSc(const std::filesystem::path& rPath,
+                   std::size_t& rImageWidth,
+                   std::size_t& rImageHeight,
+                   const Aggregation aggregation,
+                   const std::string& rColormapName,
+                   std::size_t threadCount,
+                   const Window& rWindow,
+                   const Normalization& rNormalization,
+                   Statistics* pStatistics,
+                   std::ostream* pPartial)
+{
+    const PETScBinaryMatrix matrix(rPath);
+    const Window window = resolveWindow(matrix.getProperties(), rWindow);
+    return makeImage(
+        matrix.getProperties(),
+        window,
+        rImageWidth,
+        rImageHeight,
+        aggregation,
+        rColormapName,
+        rNormalization,
+        threadCount,
+        pStatistics,
+        pPartial,
+        [&matrix, &window, threadCount]<Aggregation TAggregation, class TPixel>(std::span<TPixel> values,
+                                                                                std::pair<std::size_t,std::size_t> imageSize,
+                                                                                StructureCollector* pCollector) {
+            // Dispatch on the index and value types of the file.
+            #define MTX2IMG_FILL_PETSC(INDEX, SCALAR) \
+                fillPETSc<TAggregation,INDEX,SCALAR>(matrix, values, imageSize, window, threadCount, pCollector)
+            const bool isWide = matrix.getIndexSize() == sizeof(std::int64_t);
+            switch (matrix.getScalar()) {
+                case PETScBinaryMatrix::Scalar::Float:
+                    return isWide ? MTX2IMG_FILL_PETSC(std::int64_t, float) : MTX2IMG_FILL_PETSC(std::int32_t, float);
+                case PETScBinaryMatrix::Scalar::ComplexDouble:
+                    return isWide ? MTX2IMG_FILL_PETSC(std::int64_t, std::complex<double>) : MTX2IMG_FILL_PETSC(std::int32_t, std::complex<double>);
+                default:
+                    return isWide ? MTX2IMG_FILL_PETSC(std::int64_t, double) : MTX2IMG_FILL_PETSC(std::int32_t, double);
+            }
+            #undef MTX2IMG_FILL_PETSC
+        }
+    );
+}
+
+
+bool isHarwellBoeing(const std::filesystem::path& rPath)
+{
+    // The header takes four lines of at most 80 characters.
+    std::ifstream file(rPath, std::ios::binary);
+    std::array<char,0x200> header {};
+    file.read(header.data(), header.size());
+    return HarwellBoeingMatrix::isHeader(std::string_view(header.data(), static_cast<std::size_t>(file.gcount())));
+}
+
+
+Image convertHarwellBoeing(const std::filesystem::path& rPath,
+                           std::size_t& rImageWidth,
+                           std::size_t& rImageHeight,
+                           const Aggregation aggregation,
+                           const std::string& rColormapName,
+                           std::size_t threadCount,
+                           const Window& rWindow,
+                           const Normalization& rNormalization,
+                           Statistics* pStatistics,
+                           std::ostream* pPartial)
+{
+    const HarwellBoeingMatrix matrix(rPath);
+    const Window window = resolveWindow(matrix.getProperties(), rWindow);
+    return makeImage(
+        matrix.getProperties(),
+        window,
+        rImageWidth,
+        rImageHeight,
+        aggregation,
+        rColormapName,
+        rNormalization,
+        threadCount,
+        pStatistics,
+        pPartial,
+        [&matrix, &window, threadCount]<Aggregation TAggregation, class TPixel>(std::span<TPixel> values,
+                                                                                std::pair<std::size_t,std::size_t> imageSize,
+                                                                                StructureCollector* pCollector) {
+            return fillHarwellBoeing<TAggregation>(matrix, values, imageSize, window, threadCount, pCollector);
+        }
+    );
+}
+
+
+/// @brief Reduce the pixel values of partial renders into a buffer (see @ref mergePartials).
+/// @details Each thread merges its own range of pixels from every partial in turn, so the
+///          pages of the buffer are faulted in by the thread merging them, and the order in
+///          which partials are merged into a pixel doesn't depend on the number of threads.
+template <Aggregation TAggregation, class TPixel>
+void mergePartialValues(const std::vector<std::filesystem::path>& rPartialPaths,
+                        std::span<const PartialHeader> headers,
+                        std::span<TPixel> values,
+                        std::size_t threadCount)
+{
+    constexpr std::uint64_t headerBytes = PartialHeader::magic.size() + 10 * sizeof(std::uint64_t);
+    const std::size_t pixelCount = values.size();
+    const std::size_t mergeThreads = std::clamp<std::size_t>(pixelCount / 0x100000, 1ul, std::max(threadCount, 1ul));
+
+    parallelFor(mergeThreads, [&](std::size_t iThread){
+        const std::size_t iBegin = iThread * pixelCount / mergeThreads;
+        const std::size_t iEnd = (iThread + 1) * pixelCount / mergeThreads;
+        std::vector<char> block;
+
+        for (std::size_t iPartial=0ul; iPartial<rPartialPaths.size(); ++iPartial) {
+            std::ifstream file(rPartialPaths[iPartial], std::ios::binary);
+            const auto mergeRange = [&]<class TPartial>() {
+                // Counts are stored in integers, sums and maxima in floats (see PartialHeader::read).
+                if constexpr ((TAggregation == Aggregation::Count) == std::is_integral_v<TPartial>) {
+                    file.seekg(static_cast<std::streamoff>(headerBytes + iBegin * sizeof(TPartial)));
+                    for (std::size_t iBlock=iBegin; iBlock<iEnd; iBlock+=0x10000) {
+                        const std::size_t blockPixels = std::min<std::size_t>(iEnd - iBlock, 0x10000);
+                        block.resize(blockPixels * sizeof(TPartial));
+                        file.read(block.data(), static_cast<std::streamsize>(block.size()));
+                        if (file.fail()) {
+                            throw InvalidFormat(std::format("Error: truncated partial render: {}\n", rPartialPaths[iPartial].string()));
+                        }
+                        for (std::size_t iPixel=0ul; iPixel<blockPixels; ++iPixel) {
+                            TPartial partial;
+                            std::memcpy(&partial, block.data() + iPixel * sizeof(TPartial), sizeof(TPartial));
+                            mergePixel<TAggregation>(values[iBlock + iPixel], partial);
+                        }
+                    }
+                }
+            };
+
+            switch (static_cast<PartialPixel>(headers[iPartial].pixel)) {
+                case PartialPixel::UInt8:   mergeRange.template operator()<std::uint8_t>();     break;
+                case PartialPixel::UInt16:  mergeRange.template operator()<std::uint16_t>();    break;
+                case PartialPixel::UInt32:  mergeRange.template operator()<std::uint32_t>();    break;
+                case PartialPixel::Float:   mergeRange.template operator()<float>();            break;
+            }
+        } // for iPartial in range(rPartialPaths.size())
+    });
+}
+
+
+Image mergePartials(const std::vector<std::filesystem::path>& rPartialPaths,
+                    std::size_t& rImageWidth,
+                    std::size_t& rImageHeight,
+                    const std::string& rColormapName,
+                    std::size_t threadCount,
+                    const Normalization& rNormalization)
+{
+    if (rPartialPaths.empty()) {
+        throw std::invalid_argument("Error: no partial renders to merge\n");
+    }
+    validateNormalization(rNormalization);
+
+    // Every partial must render the same pixels as the first one.
+    std::vector<PartialHeader> headers;
+    headers.reserve(rPartialPaths.size());
+    for (const auto& rPath : rPartialPaths) {
+        std::ifstream file(rPath, std::ios::binary);
+        if (!file.good()) {
+            throw IOError(std::format("Error: failed to open partial render: {}\n", rPath.string()));
+        }
+        headers.push_back(PartialHeader::read(file, rPath));
+
+        const PartialHeader& rHeader = headers.back();
+        if (rHeader.aggregation != headers.front().aggregation) {
+            throw InvalidFormat(std::format(
+                "Error: can't merge {} with {}, their pixels are aggregated differently\n",
+                rPath.string(),
+                rPartialPaths.front().string()
+            ));
+        } else if (!rHeader.isCompatible(headers.front())) {
+            throw InvalidFormat(std::format(
+                "Error: can't merge {} (window {}:{},{}:{} of a {}x{} matrix in {}x{} pixels) "
+                "with {} (window {}:{},{}:{} of a {}x{} matrix in {}x{} pixels)\n",
+                rPath.string(),
+                rHeader.rowBegin, rHeader.rowEnd, rHeader.columnBegin, rHeader.columnEnd,
+                rHeader.rows, rHeader.columns, rHeader.width, rHeader.height,
+                rPartialPaths.front().string(),
+                headers.front().rowBegin, headers.front().rowEnd, headers.front().columnBegin, headers.front().columnEnd,
+                headers.front().rows, headers.front().columns, headers.front().width, headers.front().height
+            ));
+        }
+    }
+
+    rImageWidth = headers.front().width;
+    rImageHeight = headers.front().height;
+    const std::size_t pixelCount = rImageWidth * rImageHeight;
+    const bool isBinary = isBitPacked(rColormapName);
+
+    #ifndef NDEBUG
+        std::cout << std::format("mtx2img: merge {} partial renders into {}x{} pixels\n",
+                                 rPartialPaths.size(),
+                                 rImageWidth,
+                                 rImageHeight);
+    #endif
+
+    // Counts are merged into the widest counters, sums and maxima in single precision like
+    // the partials themselves. The binary colormap marks the pixels holding entries like
+    // renders of the whole matrix do (see makeImage).
+    Image image;
+    const auto mergeImage = [&]<Aggregation TAggregation, class TPixel>() {
+        Buffer<TPixel>& values = getPixelBuffer<TPixel>();
+        assignZeros(values, pixelCount, threadCount);
+        mergePartialValues<TAggregation>(rPartialPaths, headers, std::span<TPixel>(values), threadCount);
+
+        if (isBinary) {
+            image.resize(getRowElements<Occupancy>(rImageWidth) * rImageHeight);
+            markNonzeros(std::span<const TPixel>(values), std::span<unsigned char>(image), rImageWidth, threadCount);
+        } else {
+            image.resize(pixelCount * CHANNELS);
+            paint(std::span<const TPixel>(values), std::span<unsigned char>(image), rColormapName, rNormalization, threadCount);
+        }
+    };
+
+    switch (static_cast<Aggregation>(headers.front().aggregation)) {
+        case Aggregation::Count:    mergeImage.template operator()<Aggregation::Count,std::uint32_t>(); break;
+        case Aggregation::Sum:      mergeImage.template operator()<Aggregation::Sum,float>();           break;
+        case Aggregation::Max:      mergeImage.template operator()<Aggregation::Max,float>();           break;
+    }
+
+    return image;
+}
+
+
 } // namespace mtx2img